@@ -1,658 +1,9597 @@
 #define _GNU_SOURCE
 #define JOURNAL_FILE "reading_journal.txt"
+#define JOURNAL_INDEX_FILE "reading_journal.idx"
+#define JOURNAL_INDEX_MAGIC 0x58444a52u
+#define JOURNAL_INDEX_VERSION 3
+#define JOURNAL_FIELD_COUNT 7
+#define DATE_NONE INT32_MIN
+#define GENRE_NONE UINT32_MAX
+#define INDEX_GENRE_OVERFLOW UINT16_MAX
+#define LIST_BLOCK_SIZE 256
+#define FILTER_MAX_PREDICATES 16
+#define FILTER_NEEDS_END_DATE 0x1u
+#define FILTER_NEEDS_SCORE 0x2u
+#define FILTER_NEEDS_GENRE 0x4u
+#define FILTER_NEEDS_START_DAY 0x8u
+#define FILTER_NEEDS_END_DAY 0x10u
+#define FILTER_NEEDS_AUTHOR 0x20u
+#define LIST_CHUNK_SIZE (4 * 1024 * 1024)
+#define LIST_MAX_THREADS 256
+#define SCAN_WINDOW_SIZE (16 * 1024)
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+#define JOURNAL_SYNC_FILE "reading_journal.sync"
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define SORT_MEMORY_BUDGET (64 * 1024 * 1024)
+#define SORT_MAX_RUNS 64
+#define JOURNAL_STATS_FILE "reading_journal.stats"
+#define JOURNAL_STATS_MAGIC 0x54534a52u
+#define JOURNAL_STATS_VERSION 1
+#define STATS_TAIL_CHECK 4096
+#define JOURNAL_SEARCH_FILE "reading_journal.tri"
+#define JOURNAL_SEARCH_DELTA_FILE "reading_journal.trd"
+#define JOURNAL_SEARCH_MAGIC 0x49524a52u
+#define JOURNAL_SEARCH_DELTA_MAGIC 0x44524a52u
+#define JOURNAL_SEARCH_VERSION 1
+#define SEARCH_BUCKET_BITS 18
+#define SEARCH_BUCKETS (1u << SEARCH_BUCKET_BITS)
+#define SEARCH_DELTA_MERGE_LINES 4096
+#define JOURNAL_SOCKET_FILE "reading_journal.sock"
+#define SERVE_MAX_REQUEST (64 * 1024)
+#define SERVE_MAX_ARGUMENTS 256
+#define SERVE_MAX_PENDING 64
+#define SERVE_REQUEST_TIMEOUT 5
+#define FOLLOW_READ_SIZE (1024 * 1024)
+#define JOURNAL_STORE_FILE "reading_journal.jz"
+#define JOURNAL_STORE_MAGIC 0x5a4a4a52u
+#define JOURNAL_STORE_VERSION 1
+#define STORE_BLOCK_LINES 4096
+#define STORE_BLOCK_SIZE (4 * 1024 * 1024)
+#define STORE_GENRE_BITS 63
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define JOURNAL_OFFSETS_FILE "reading_journal.off"
+#define JOURNAL_OFFSETS_MAGIC 0x464f4a52u
+#define JOURNAL_OFFSETS_VERSION 1
+#define LINE_OFFSET_STRIDE 1024
+#define JOURNAL_AUTHOR_FILE "reading_journal.aut"
+#define JOURNAL_AUTHOR_DELTA_FILE "reading_journal.aud"
+#define JOURNAL_AUTHOR_MAGIC 0x41414a52u
+#define JOURNAL_AUTHOR_DELTA_MAGIC 0x44414a52u
+#define JOURNAL_AUTHOR_VERSION 1
+#define AUTHOR_DELTA_MERGE_LINES 4096
+#define JOURNAL_CHANGES_FILE "reading_journal.chg"
+#define JOURNAL_CHANGES_MAGIC 0x43434a52u
+#define JOURNAL_CHANGES_VERSION 1
+#define COMPACT_CHANGE_THRESHOLD 1024
+#define ENTRY_ID_NONE UINT64_MAX
+#define BENCH_BLOCK_LINES 4096
+#define BENCH_APPENDS 10000
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
-int days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
+// Days of every month in a common year (row 0) and in a leap year (row 1)
+const uint8_t days_in_month[2][12] = {
+    {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+    {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31},
+};
+bool alloc_stats_enabled = false;
+bool daemon_enabled = true;
+bool profile_enabled = false;
+bool list_show_ids = false;
+
+/**
+ * @brief Read-only view of a text field, given as a pointer and a length.
+ *
+ * Slices point into a buffer owned by someone else (a mapped journal file, a line buffer or the program
+ * arguments) and are not null-terminated. An absent field is represented by a slice with `data == NULL`.
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+} TextSlice;
+
+/**
+ * @brief One book of the journal.
+ *
+ * Besides the text of the dates, `start_day` and `end_day` can hold them packed as day numbers
+ * (`date_to_day_number`), so date filters compare integers. They are packed only for filters which compare
+ * dates (`pack_entry_days`) and are `DATE_NONE` otherwise, or if the date is absent or malformed.
+ *
+ * `id` is the offset of the journal line of the entry and `id_check` the hash of that line as it is in the
+ * journal, set only while record IDs are printed (`list_show_ids`). Together they are the record ID which
+ * `update` and `delete` take (`output_record_id`). It stays the same when the entry is changed, but not when
+ * `compact` moves the lines, and the check rejects an ID which names another line since. `id` is
+ * `ENTRY_ID_NONE` where the offset is not known.
+ */
 typedef struct {
-    char *book_name;
-    char *author;
-    char *genre;
-    char *start_date;
-    char *end_date;
+    TextSlice book_name;
+    TextSlice author;
+    TextSlice genre;
+    TextSlice start_date;
+    TextSlice end_date;
     unsigned int score;
-    char *note;
+    TextSlice note;
+    uint32_t genre_id;
+    int32_t start_day;
+    int32_t end_day;
+    uint64_t id;
+    uint32_t id_check;
 } JournalEntry;
 
-void print_help() {
-    printf("Help for Reading Journal program\n");
-    printf("Usage:\n");
-    printf("  journal <command> [options]\n\n");
-    printf("Commands:\n");
-    printf("  new     Create a new journal entry\n");
-    printf("  list    List existing journal entries\n");
-    printf("  -h, --help    Show this help message\n\n");
-    printf("Options for 'new':\n");
-    printf("  --name <string>     (Required) Book name\n");
-    printf("  --author <string>   (Required) Author's name\n");
-    printf("  --genre <string>    (Required) Book genre\n");
-    printf("  --start <ISO date>  (Required) Start date (YYYY-MM-DD)\n");
-    printf("  --end <ISO date>    Finish date (YYYY-MM-DD)\n");
-    printf("  --score <int>       Personal score (1-5)\n");
-    printf("  --note <string>     Additional note\n\n");
-    printf("Options for 'list':\n");
-    printf("  --genre <string>    List books by specific genre\n");
-    printf("  --reading           List books currently being read\n");
-    printf("  --completed         List completed books\n");
-    printf("  --score <int>       List books with score equal or higher\n\n");
-    printf("Examples:\n");
-    printf(
-        "  ./journal new --name \"Hobbit\" --author \"J.R.R. Tolkien\" --genre fantasy --start \"2022-01-01\" --score 4\n");
-    printf("  ./journal list --genre fantasy\n");
+/**
+ * @brief Finds the offsets of all '|' and '\n' bytes of a buffer, in increasing order.
+ *
+ * @param data The buffer to scan.
+ * @param length Length of the buffer, at most `SCAN_WINDOW_SIZE` bytes.
+ * @param positions Receives the offsets. Must have room for `length` offsets.
+ *
+ * @return The number of delimiters found.
+ */
+typedef size_t (*DelimiterScanner)(const char *data, size_t length, uint32_t *positions);
+
+/**
+ * @brief Splits a range of journal text into lines and fields, one scanner window at a time.
+ *
+ * The delimiters of a whole window (`SCAN_WINDOW_SIZE` bytes) are found in one pass by `scan`, and
+ * `next_tokenized_line` then only walks the list of their positions. A line cut by the end of a window is
+ * scanned again at the start of the next one.
+ */
+typedef struct {
+    DelimiterScanner scan;
+    const char *window;
+    const char *end;
+    size_t window_length;
+    size_t line_start;
+    size_t count;
+    size_t next;
+    uint32_t positions[SCAN_WINDOW_SIZE];
+} LineTokenizer;
+
+/**
+ * @brief One line returned by `next_tokenized_line`. The line and its fields point into the tokenized text.
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+    TextSlice fields[JOURNAL_FIELD_COUNT];
+    int field_count;
+} TokenizedLine;
+
+/**
+ * @brief Output buffer of the listing, filled by copying text directly instead of formatting it.
+ *
+ * A buffer bound to a file descriptor is flushed with `write` whenever it is full. A buffer with `fd == -1`
+ * only collects text in memory and grows instead, list workers use it for the output of a chunk.
+ */
+typedef struct {
+    int fd;
+    char *data;
+    size_t used;
+    size_t capacity;
+    bool failed;
+} OutputBuffer;
+
+/**
+ * @brief How appended journal lines are made durable, see `append_journal`.
+ */
+typedef enum {
+    SYNC_NONE,
+    SYNC_EACH,
+    SYNC_GROUP
+} SyncMode;
+
+/**
+ * @brief One block of memory owned by an arena. Blocks are chained from the newest to the oldest.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t capacity;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+/**
+ * @brief Bump allocator for data that lives as long as one load or one command.
+ *
+ * Allocating only moves a pointer inside the current block, a new block is requested from `malloc`
+ * only when the current one is full. Everything allocated from the arena is released at once with
+ * `arena_reset` or `arena_free`, there is no way to free a single allocation.
+ */
+typedef struct {
+    ArenaBlock *head;
+    size_t allocations;
+    size_t block_allocations;
+    size_t bytes_used;
+    size_t peak_bytes;
+} Arena;
+
+/**
+ * @brief Dictionary of interned genre names.
+ *
+ * Every distinct genre is copied into the dictionary arena once and gets a small integer ID, so entries
+ * share one copy of their genre and genres can be compared by ID (or by pointer). Lookups use an open
+ * addressing hash table of IDs, which is kept at most half full.
+ */
+typedef struct {
+    Arena arena;
+    TextSlice *names;
+    uint32_t *hashes;
+    size_t count;
+    size_t capacity;
+    uint32_t *slots;
+    size_t slot_count;
+} GenreDictionary;
+
+/**
+ * @brief Journal file mapped into memory for reading.
+ *
+ * `data` is NULL when the file is empty, as an empty file cannot be mapped. `file_stat` describes the
+ * file at the time it was mapped and is used to check whether the sidecar index is up to date.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    struct stat file_stat;
+} MappedJournal;
+
+/**
+ * @brief Header of the sidecar index file.
+ *
+ * The index describes the journal it was built from by its size and modification time. When either no
+ * longer matches, the index is stale and gets rebuilt. The header is followed by:
+ * - `record_count` `IndexRecord`s, one per journal line,
+ * - at `genre_table_offset`, a genre table of `genre_count` entries, each a `uint32_t` length followed by
+ *   the genre bytes; the position in the table is the genre ID,
+ * - at `postings_offset`, `genre_count + 2` `uint64_t` list starts followed by the posting lists: the record
+ *   numbers (`uint32_t`, ascending) of each genre, then the record numbers of invalid lines,
+ * - at `start_order_offset`, `start_order_count` `IndexDateEntry`s of the valid lines with a start date,
+ *   ordered by the start date and then by record number.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+    uint64_t record_count;
+    uint64_t genre_table_offset;
+    uint64_t postings_offset;
+    uint32_t genre_count;
+    uint32_t reserved;
+    uint64_t start_order_offset;
+    uint64_t start_order_count;
+} IndexHeader;
+
+/**
+ * @brief Fixed-width description of one journal line in the sidecar index.
+ *
+ * Field offsets are relative to the start of the line, a field ends one byte before the next one starts
+ * (or at the end of the line for the last of `field_count` fields). Dates are packed as day numbers (days since
+ * 1970-01-01, `DATE_NONE` if missing or malformed) and the genre is stored as an ID into the genre table
+ * of the index. Lines which `parse_entry` rejects are kept with `INDEX_RECORD_INVALID` so they are
+ * reported the same way as when the text is parsed.
+ */
+typedef struct {
+    uint64_t line_offset;
+    uint32_t line_length;
+    uint32_t field_offset[JOURNAL_FIELD_COUNT];
+    int32_t start_day;
+    int32_t end_day;
+    uint32_t score;
+    uint16_t genre_id;
+    uint8_t field_count;
+    uint8_t flags;
+} IndexRecord;
+
+#define INDEX_RECORD_INVALID 0x1u
+
+/**
+ * @brief Start date of one record, an element of the start date order of the index.
+ *
+ * The order lets a start date range be found by binary search instead of a scan of all records.
+ */
+typedef struct {
+    int32_t day;
+    uint32_t record;
+} IndexDateEntry;
+
+/**
+ * @brief Header of the compressed store `JOURNAL_STORE_FILE`, an optional copy of the journal text made of
+ *        independently compressed blocks.
+ *
+ * The store covers the first `covered_size` bytes of the journal, which end with a newline. It stays usable
+ * while the journal is only appended to: it must be the same file (`journal_inode`) and the last bytes of
+ * the covered part must still hash to `tail_hash` (`journal_tail_hash`), the rest is read from the text.
+ * The header is followed by the compressed blocks, then at `genre_table_offset` a table of `genre_count`
+ * genres, each a `uint32_t` length followed by the genre bytes, and at `blocks_offset` the `block_count`
+ * `StoreBlock`s.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+    uint64_t covered_size;
+    uint64_t block_count;
+    uint64_t genre_table_offset;
+    uint64_t blocks_offset;
+    uint32_t genre_count;
+    uint32_t tail_hash;
+    uint32_t max_block_length;
+    uint32_t reserved;
+} StoreHeader;
+
+/**
+ * @brief One block of the compressed store with the zone map of its lines.
+ *
+ * The block holds the journal text from `text_offset`, `text_length` bytes of whole lines, compressed by
+ * `lz_compress` into `compressed_length` bytes at `data_offset` (`checksum` is their `store_checksum`). The
+ * zone map summarizes the `record_count`
+ * valid lines the same way the list filters see them, so a filter can tell that no line of the block can
+ * match without decompressing it: the score, start and end day ranges (`DATE_NONE` included), the number of
+ * books being read and finished, and a bitmap of genres, bit N for genre N of the store and the last bit
+ * for all genres past `STORE_GENRE_BITS`. Lines with fewer than 4 fields are counted in `invalid_count`.
+ */
+typedef struct {
+    uint64_t data_offset;
+    uint64_t text_offset;
+    uint32_t text_length;
+    uint32_t compressed_length;
+    uint32_t record_count;
+    uint32_t invalid_count;
+    uint32_t reading_count;
+    uint32_t completed_count;
+    uint32_t min_score;
+    uint32_t max_score;
+    int32_t min_start_day;
+    int32_t max_start_day;
+    int32_t min_end_day;
+    int32_t max_end_day;
+    uint64_t genre_bits;
+    uint64_t checksum;
+} StoreBlock;
+
+/**
+ * @brief Compressed store mapped into memory.
+ */
+typedef struct {
+    void *mapping;
+    size_t size;
+    const StoreHeader *header;
+    const StoreBlock *blocks;
+} JournalStore;
+
+/**
+ * @brief Sidecar index mapped into memory.
+ *
+ * `genre_map` translates the genre IDs of the index into IDs of the program wide `genre_dictionary`.
+ */
+typedef struct {
+    void *mapping;
+    size_t size;
+    const IndexHeader *header;
+    const IndexRecord *records;
+    const uint64_t *posting_starts;
+    const uint32_t *postings;
+    const IndexDateEntry *start_order;
+    uint32_t *genre_map;
+} JournalIndex;
+
+/**
+ * @brief Journal held in memory by the daemon (`serve`), described by index records built as it is loaded.
+ *
+ * `data` is a copy of the journal text and `records` describe its lines like the records of the sidecar
+ * index, with genre IDs into `genres`. When the journal grows, only the appended tail is read and parsed.
+ */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+    IndexRecord *records;
+    size_t record_count;
+    size_t record_capacity;
+    GenreDictionary genres;
+    struct stat file_stat;
+    bool loaded;
+} ServedJournal;
+
+/**
+ * @brief A connection of the daemon whose request is still being read.
+ *
+ * `output_fds` are the standard output and error of the client, passed with the request (`SCM_RIGHTS`), or
+ * -1 until they arrive. `started` is the second of a monotonic clock the connection was accepted in.
+ */
+typedef struct {
+    int fd;
+    int output_fds[2];
+    char *data;
+    size_t used;
+    time_t started;
+} PendingRequest;
+
+/**
+ * @brief Grouping of the stats command. Aggregates of all groupings are maintained together.
+ */
+typedef enum {
+    STATS_BY_GENRE,
+    STATS_BY_AUTHOR,
+    STATS_BY_YEAR,
+    STATS_GROUPINGS
+} StatsGrouping;
+
+/**
+ * @brief Running aggregates of one group of entries.
+ *
+ * Only counts and sums are kept, so the aggregates of appended entries can simply be added and the
+ * averages are computed when they are printed. `timed` counts the completed entries whose reading duration
+ * is known (both dates valid, the end not before the start) and `duration_sum` sums it in days.
+ */
+typedef struct {
+    uint64_t entries;
+    uint64_t completed;
+    uint64_t scored;
+    uint64_t score_sum;
+    uint64_t timed;
+    int64_t duration_sum;
+} StatsCounters;
+
+/**
+ * @brief Aggregates of journal entries for every grouping.
+ *
+ * The names of the groups of one grouping are interned into its own `GenreDictionary` and the counters of
+ * a group are stored at its ID. Years are grouped by the text of the year of the start date.
+ */
+typedef struct {
+    GenreDictionary groups[STATS_GROUPINGS];
+    StatsCounters *counters[STATS_GROUPINGS];
+    size_t capacity[STATS_GROUPINGS];
+    uint64_t invalid_lines;
+    bool failed;
+} JournalStats;
+
+/**
+ * @brief Header of the line offset index `JOURNAL_OFFSETS_FILE`, used to page through the journal.
+ *
+ * It is followed by one `uint64_t` checkpoint for every `stride` entries of the first `journal_size` bytes
+ * of the journal: checkpoint N is the offset of the line of entry `N * stride`. Entries are the lines with
+ * at least 4 fields, as `list` counts them. The index is extended by the writers after every append
+ * (`update_line_offsets`) and by `list` when the journal grew otherwise, `tail_hash` tells whether the
+ * covered part is unchanged (see `StatsHeader`).
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+    uint64_t entry_count;
+    uint32_t tail_hash;
+    uint32_t stride;
+} OffsetsHeader;
+
+/**
+ * @brief Header of the stats state file `JOURNAL_STATS_FILE`.
+ *
+ * The state file keeps the aggregates of the first `journal_size` bytes of the journal, so the stats
+ * command does not have to scan them again. It is followed, for every grouping in the order of
+ * `StatsGrouping`, by `group_count` groups, each a `StatsCounters` followed by a `uint32_t` name length
+ * and the name bytes.
+ *
+ * When the inode, size and modification time still match the journal, the aggregates are complete. When
+ * the journal only grew, `tail_hash` (`hash_slice` of the last `STATS_TAIL_CHECK` bytes the state covers)
+ * tells whether the covered part is unchanged, so only the appended lines need to be scanned.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+    uint64_t invalid_lines;
+    uint32_t group_count[STATS_GROUPINGS];
+    uint32_t tail_hash;
+} StatsHeader;
+
+/**
+ * @brief Header of the trigram search index `JOURNAL_SEARCH_FILE`.
+ *
+ * The index covers the book name, author and note of every entry line of the journal it was built from.
+ * Text is folded to lower case (ASCII only) and every trigram of a field is hashed into one of
+ * `SEARCH_BUCKETS` buckets (`trigram_bucket`). The header is followed by:
+ * - `line_count` `uint64_t` offsets of the indexed lines; positions in this array are the line numbers,
+ * - `SEARCH_BUCKETS + 1` `uint64_t` starts of the posting lists of the buckets,
+ * - `postings_size` bytes of posting lists, the ascending line numbers of each bucket stored as varint
+ *   encoded gaps.
+ *
+ * Buckets of different trigrams may collide, so postings give candidate lines that are verified against
+ * the text. Lines appended after the index was built are described by `JOURNAL_SEARCH_DELTA_FILE`.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+    uint64_t line_count;
+    uint64_t postings_size;
+} SearchIndexHeader;
+
+/**
+ * @brief Header of the delta of the search index, identifying the index it extends by its journal size and
+ *        modification time.
+ *
+ * Writers append one record per entry line they append to the journal: the sorted, distinct buckets of the
+ * line followed by a `SearchDeltaTrailer`. The trailers are at the end of the records, so a writer finds
+ * how far the delta reaches by reading only the last one.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+} SearchDeltaHeader;
+
+/**
+ * @brief Trailer of a delta record, see `SearchDeltaHeader`. The modification time is the one of the
+ *        journal after the append that wrote the record.
+ */
+typedef struct {
+    uint64_t line_offset;
+    uint32_t line_length;
+    uint32_t bucket_count;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+} SearchDeltaTrailer;
+
+/**
+ * @brief Search index and its delta, both describing the journal as it is now.
+ *
+ * `delta_records` holds the offsets of the trailers of the delta records in file order.
+ */
+typedef struct {
+    void *mapping;
+    size_t size;
+    const SearchIndexHeader *header;
+    const uint64_t *lines;
+    const uint64_t *bucket_starts;
+    const uint8_t *postings;
+    char *delta;
+    size_t *delta_records;
+    size_t delta_count;
+} SearchIndex;
+
+/**
+ * @brief Header of the author index `JOURNAL_AUTHOR_FILE`, a sorted table of the authors of the journal.
+ *
+ * The header is followed by:
+ * - `author_count + 1` `uint64_t` starts of the names in the name area,
+ * - `author_count + 1` `uint64_t` starts of the posting lists of the authors,
+ * - `entry_count` `uint64_t` line offsets, the posting lists: the entries of each author in journal order,
+ * - `invalid_count` `uint64_t` offsets of the lines without the required fields, which list reports,
+ * - `names_size` bytes of author names normalized by `normalize_author_name`, in ascending order.
+ *
+ * Lines appended after the index was built are described by `JOURNAL_AUTHOR_DELTA_FILE`.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+    uint64_t author_count;
+    uint64_t entry_count;
+    uint64_t invalid_count;
+    uint64_t names_size;
+} AuthorIndexHeader;
+
+/**
+ * @brief Header of the delta of the author index, identifying the index it extends by its journal size and
+ *        modification time. It is followed by one `AuthorDeltaRecord` per appended line.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_size;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+} AuthorDeltaHeader;
+
+/**
+ * @brief One line appended to the journal after the author index was built.
+ *
+ * `author_hash` is the `hash_slice` of the normalized author, or 0 for a line without the required fields.
+ * The modification time is the one of the journal after the append that wrote the record.
+ */
+typedef struct {
+    uint64_t line_offset;
+    uint32_t line_length;
+    uint32_t author_hash;
+    int64_t journal_mtime_sec;
+    int64_t journal_mtime_nsec;
+} AuthorDeltaRecord;
+
+/**
+ * @brief Author index and its delta, both describing the journal as it is now.
+ */
+typedef struct {
+    void *mapping;
+    size_t size;
+    const AuthorIndexHeader *header;
+    const uint64_t *name_starts;
+    const uint64_t *posting_starts;
+    const uint64_t *postings;
+    const uint64_t *invalid;
+    const char *names;
+    AuthorDeltaRecord *delta;
+    size_t delta_count;
+} AuthorIndex;
+
+/**
+ * @brief Header of the change log `JOURNAL_CHANGES_FILE`, naming the journal file the changes apply to.
+ *
+ * After a compaction the journal is a new file, so changes left behind by an interrupted compaction are
+ * recognized by the inode and ignored.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t journal_inode;
+} ChangesHeader;
+
+/**
+ * @brief Kinds of the records of the change log.
+ */
+typedef enum {
+    CHANGE_UPDATE = 1,
+    CHANGE_DELETE = 2
+} ChangeKind;
+
+/**
+ * @brief One record of the change log, followed by `length` bytes of the new journal line of an update.
+ *
+ * `line_hash` is the `hash_slice` of the journal line at `line_offset` when the change was made. A record
+ * whose line does not hash the same anymore belongs to a journal that was rewritten since and is ignored.
+ */
+typedef struct {
+    uint64_t line_offset;
+    uint32_t line_hash;
+    uint32_t kind;
+    uint64_t length;
+} ChangeRecord;
+
+/**
+ * @brief The latest change of one journal line, `line` is the new line of an update.
+ */
+typedef struct {
+    uint64_t offset;
+    size_t sequence;
+    bool deleted;
+    TextSlice line;
+} OverlayChange;
+
+/**
+ * @brief Changes of the journal read from the change log, applied by list over the lines it scans.
+ *
+ * `changes` holds one change per changed line in ascending order of the lines, `record_count` counts all
+ * valid records of the log including the ones superseded by later changes of the same line. `log_end` is
+ * the end of the last complete record of a log of this journal, 0 if the log belongs to another one.
+ */
+typedef struct {
+    char *data;
+    size_t size;
+    size_t log_end;
+    OverlayChange *changes;
+    size_t count;
+    size_t record_count;
+} JournalOverlay;
+
+/**
+ * @brief Field the list command sorts the entries by.
+ */
+typedef enum {
+    SORT_NONE,
+    SORT_SCORE,
+    SORT_START,
+    SORT_END,
+    SORT_NAME
+} SortField;
+
+/**
+ * @brief Output format of the entries listed by `list --format` and `export`.
+ *
+ * `LIST_FORMAT_TEXT` is the block layout of `print_entry`, the others print one record per line for other
+ * programs: a JSON object, tab separated values or the journal line itself.
+ */
+typedef enum {
+    LIST_FORMAT_TEXT,
+    LIST_FORMAT_JSONL,
+    LIST_FORMAT_TSV,
+    LIST_FORMAT_RAW
+} ListFormat;
+
+/**
+ * @brief Sort key of an entry collected for sorted listing, also the record header of a sorted run file.
+ *
+ * `value` is the score or the day number of the sorted date. `sequence` is the position of the entry among
+ * the matching ones, so entries with equal keys keep the order of the file. The entry data that follows the
+ * header holds `name_length` bytes of the book name (for `SORT_NAME`) and `text_length` bytes of the entry
+ * as printed by `print_entry`.
+ */
+typedef struct {
+    int64_t value;
+    uint64_t sequence;
+    uint32_t name_length;
+    uint32_t text_length;
+    uint32_t missing;
+    uint32_t reserved;
+} SortRecord;
+
+/**
+ * @brief An entry collected for sorted listing, its key and its data.
+ */
+typedef struct {
+    SortRecord record;
+    char *data;
+} SortedEntry;
+
+/**
+ * @brief Collects the matching entries of a list scan and prints them sorted.
+ *
+ * With a `limit` the sorter keeps only the best `limit` entries in a heap whose root is the entry that would
+ * be printed last, so memory stays bounded by the limit. Otherwise all entries are collected into `arena`;
+ * whenever they take more than `memory_budget` bytes they are sorted and spilled to a temporary run file,
+ * and the runs are merged at the end (external merge sort).
+ */
+typedef struct {
+    SortField field;
+    bool descending;
+    size_t limit;
+    size_t memory_budget;
+    uint64_t next_sequence;
+    SortedEntry *entries;
+    size_t count;
+    size_t capacity;
+    size_t memory_used;
+    Arena arena;
+    FILE **runs;
+    size_t run_count;
+    OutputBuffer scratch;
+    bool failed;
+} EntrySorter;
+
+/**
+ * @brief One run file being merged, with the entry read last from it.
+ */
+typedef struct {
+    FILE *file;
+    SortedEntry current;
+    size_t capacity;
+} SortRun;
+
+/**
+ * @brief Destination of the entries a list scan selects.
+ *
+ * Entries are printed to `out`, unless `sorter` is set: then they are collected by the sorter and printed
+ * after the scan. Invalid lines are always reported to `out` right away.
+ */
+typedef struct {
+    OutputBuffer *out;
+    EntrySorter *sorter;
+} ListSink;
+
+/**
+ * @brief Options of the list command that do not select entries.
+ *
+ * `limit` is the number of entries to print (0 for all), `sort_memory` the memory budget of a full sort.
+ * `follow` keeps listing the entries appended after the scan. `paged` lists only the page of `limit` entries
+ * after `offset` entries, starting from the position encoded in `cursor` if it is not NULL.
+ */
+typedef struct {
+    bool use_index;
+    int threads;
+    SortField sort_field;
+    bool descending;
+    size_t limit;
+    size_t sort_memory;
+    bool follow;
+    bool paged;
+    size_t offset;
+    const char *cursor;
+} ListOptions;
+
+typedef enum {
+    FILTER_GENRE,
+    FILTER_READING,
+    FILTER_COMPLETED,
+    FILTER_SCORE,
+    FILTER_START_RANGE,
+    FILTER_END_RANGE,
+    FILTER_AUTHOR,
+    FILTER_AUTHOR_PREFIX
+} FilterKind;
+
+/**
+ * @brief One predicate of a filter, such as `--genre fantasy` or `--not --reading`.
+ *
+ * The value of the option is parsed when the predicate is added (`add_filter_predicate`,
+ * `add_date_range_predicate`), so evaluating it for an entry involves no string parsing. Date ranges are
+ * inclusive ranges of day numbers. `author` is the searched author name or prefix with the surrounding
+ * whitespace trimmed, it is compared by `compare_author_names`. `cost` is a relative cost of the evaluation.
+ */
+typedef struct {
+    FilterKind kind;
+    bool negated;
+    unsigned int min_score;
+    const char *genre;
+    uint32_t genre_id;
+    TextSlice author;
+    int32_t min_day;
+    int32_t max_day;
+    unsigned int cost;
+} FilterPredicate;
+
+/**
+ * @brief Filter of the list command, compiled once from the command-line arguments.
+ *
+ * An entry matches if it satisfies all predicates. A filter without predicates matches every entry.
+ * `needs` tells which fields the predicates look at (`FILTER_NEEDS_*`), other fields of an entry can be
+ * parsed only after it has matched.
+ */
+typedef struct {
+    FilterPredicate predicates[FILTER_MAX_PREDICATES];
+    size_t count;
+    bool matches_nothing;
+    unsigned int needs;
+} JournalFilter;
+
+/**
+ * @brief Evaluation order of the predicates of a filter during one scan, adapted to their observed pass rates.
+ *
+ * Every scan (and every worker thread of a parallel scan) has its own stats, the filter itself stays read-only.
+ */
+typedef struct {
+    uint8_t order[FILTER_MAX_PREDICATES];
+    uint64_t evaluated[FILTER_MAX_PREDICATES];
+    uint64_t passed[FILTER_MAX_PREDICATES];
+} FilterStats;
+
+/**
+ * @brief Block of loaded entries waiting to be filtered and printed.
+ *
+ * If `partial` is set, the entries hold only the fields the filter needs and are completed from `fields`
+ * and `ids` when they are selected.
+ */
+typedef struct {
+    JournalEntry entries[LIST_BLOCK_SIZE];
+    TextSlice fields[LIST_BLOCK_SIZE][JOURNAL_FIELD_COUNT];
+    uint64_t ids[LIST_BLOCK_SIZE];
+    uint32_t id_checks[LIST_BLOCK_SIZE];
+    uint8_t field_counts[LIST_BLOCK_SIZE];
+    bool partial;
+    size_t count;
+} EntryBlock;
+
+GenreDictionary genre_dictionary;
+// Journal of the daemon while it runs a request, commands read it instead of the journal file
+ServedJournal *served_journal = NULL;
+// Changes of the journal applied by the list command that is running, empty otherwise
+JournalOverlay journal_overlay;
+// Format of the entries printed by the list command that is running
+ListFormat list_format = LIST_FORMAT_TEXT;
+// Set by SIGINT or SIGTERM to end the long running commands (`serve`, `list --follow`)
+volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @brief Counters reported at the end of the list command.
+ *
+ * The verify command uses them too, `listed` then counts the invalid lines.
+ */
+typedef struct {
+    size_t total;
+    size_t listed;
+} ListCounts;
+
+/**
+ * @brief Output of one chunk of a parallel scan, kept until the main thread writes it.
+ */
+typedef struct {
+    OutputBuffer output;
+    ListCounts counts;
+    bool done;
+    bool failed;
+} ChunkResult;
+
+/**
+ * @brief Processes a range of whole lines of a memory-mapped journal, one chunk of a parallel scan.
+ *
+ * @param data Start of the mapped journal, so lines can be reported by their offset.
+ * @param begin Offset of the first line of the range.
+ * @param end Offset just after the last line of the range.
+ * @param filter The filter of the scan, if it has one.
+ * @param counts Counters of the chunk.
+ * @param out Memory buffer receiving the output of the chunk.
+ */
+typedef void (*RangeScanner)(const char *data, size_t begin, size_t end, const JournalFilter *filter,
+                             ListCounts *counts, OutputBuffer *out);
+
+/**
+ * @brief Shared state of a parallel scan of a memory-mapped journal (`run_parallel_scan`).
+ *
+ * Chunks are handed out in file order from `next_chunk`. `written` counts chunks already written by the
+ * main thread. Both, and the `done` flags of the results, are guarded by `lock`.
+ */
+typedef struct {
+    const char *data;
+    size_t size;
+    RangeScanner scan_range;
+    const JournalFilter *filter;
+    size_t chunk_size;
+    size_t chunk_count;
+    size_t window;
+    ChunkResult *results;
+    size_t next_chunk;
+    size_t written;
+    pthread_mutex_t lock;
+    pthread_cond_t chunk_done;
+    pthread_cond_t window_moved;
+} ParallelScan;
+
+/**
+ * @brief Shape of a synthetic journal written by `bench generate`.
+ *
+ * `genres` and `authors` are the cardinalities of the fields, `reading_percent` the share of books without
+ * an end date and `score_weights` the relative frequency of no score and of the scores 1 to 5 of finished
+ * books. Notes are from 0 to twice `note_length` bytes long.
+ */
+typedef struct {
+    size_t lines;
+    size_t genres;
+    size_t authors;
+    unsigned int reading_percent;
+    unsigned int score_weights[6];
+    size_t note_length;
+    uint64_t seed;
+} GeneratorOptions;
+
+/**
+ * @brief Measurement of one stage of `bench suite`.
+ *
+ * `records` and `bytes` are the input of the stage (the output for `print_entry`), `matched` the entries
+ * a filter accepted and `peak_rss_kb` the peak resident size of the process when the stage ended.
+ */
+typedef struct {
+    const char *name;
+    size_t records;
+    size_t bytes;
+    size_t matched;
+    double seconds;
+    long peak_rss_kb;
+} BenchStage;
+
+/**
+ * @brief Phases of a command timed by `--profile`. Time outside of the other phases counts as `PROFILE_OTHER`.
+ */
+typedef enum {
+    PROFILE_OTHER,
+    PROFILE_READ,
+    PROFILE_TOKENIZE,
+    PROFILE_LOAD,
+    PROFILE_FILTER,
+    PROFILE_FORMAT,
+    PROFILE_WRITE,
+    PROFILE_PHASE_COUNT
+} ProfilePhase;
+
+/**
+ * @brief Wall and CPU time of the phases of a command and its counters, collected with `--profile`.
+ *
+ * Every thread has its own profile (`thread_profile`), the threads of a parallel scan add theirs to
+ * `profile_totals` when they end. `current` is the running phase, which started at `mark_wall` and
+ * `mark_cpu`.
+ */
+typedef struct {
+    double wall[PROFILE_PHASE_COUNT];
+    double cpu[PROFILE_PHASE_COUNT];
+    ProfilePhase current;
+    bool started;
+    double mark_wall;
+    double mark_cpu;
+    uint64_t bytes_read;
+    uint64_t rejected_lines;
+    uint64_t allocations;
+    uint64_t malloc_calls;
+} CommandProfile;
+
+_Thread_local CommandProfile thread_profile;
+CommandProfile profile_totals;
+pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void print_help() {
+    printf("Help for Reading Journal program\n");
+    printf("Usage:\n");
+    printf("  journal <command> [options]\n\n");
+    printf("Commands:\n");
+    printf("  new     Create a new journal entry\n");
+    printf("  list    List existing journal entries\n");
+    printf("  import  Append many entries from stdin or a file\n");
+    printf("  update  Change fields of an entry: update --id <id> [options of 'new']\n");
+    printf("  delete  Delete an entry: delete --id <id> (IDs are printed by list --ids)\n");
+    printf("  compact Write updates and deletes into the journal (%s)\n", JOURNAL_CHANGES_FILE);
+    printf("  export  Write books for other programs: export [--format jsonl|tsv|raw]\n");
+    printf("          [--file <path>] [options of 'list'], JSON lines by default\n");
+    printf("  index   Build the sidecar index used by list (%s)\n", JOURNAL_INDEX_FILE);
+    printf("  pack    Build the compressed store read by list (%s)\n", JOURNAL_STORE_FILE);
+    printf("  verify  Check every journal line, report invalid ones [--threads <int>]\n");
+    printf("  stats   Books, scores and reading time by group [--by genre|author|year]\n");
+    printf("  search  Find books by name, author or note: search <text> [--no-index]\n");
+    printf("  serve   Daemon answering list and new from memory (%s)\n", JOURNAL_SOCKET_FILE);
+    printf("  bench   Benchmarks: bench tokenize, bench generate or bench suite\n\n");
+    printf("Options for 'new':\n");
+    printf("  --name <string>     (Required) Book name\n");
+    printf("  --author <string>   (Required) Author's name\n");
+    printf("  --genre <string>    (Required) Book genre\n");
+    printf("  --start <ISO date>  (Required) Start date (YYYY-MM-DD)\n");
+    printf("  --end <ISO date>    Finish date (YYYY-MM-DD)\n");
+    printf("  --score <int>       Personal score (1-5)\n");
+    printf("  --note <string>     Additional note\n");
+    printf("  --sync              Sync the journal to disk after writing the entry\n");
+    printf("  --group-commit      Sync, sharing one sync with concurrent writers\n\n");
+    printf("Options for 'list':\n");
+    printf("  --genre <string>    List books by specific genre\n");
+    printf("  --reading           List books currently being read\n");
+    printf("  --completed         List completed books\n");
+    printf("  --score <int>       List books with score equal or higher\n");
+    printf("  --author <string>   List books by the author, ignoring case and extra spaces\n");
+    printf("  --author-prefix <string>         List books by authors starting with the text\n");
+    printf("  --started-after <ISO date>       List books started after the date\n");
+    printf("  --started-before <ISO date>      List books started before the date\n");
+    printf("  --finished-between <from> <to>   List books finished within the dates\n");
+    printf("  --not               Negate the filter option that follows\n");
+    printf("                      Filters can be combined, a book must match all of them\n");
+    printf("  --no-index          Parse the journal text even if the sidecar index exists\n");
+    printf("  --ids               Print record IDs of the books, used by update and delete\n");
+    printf("  --format <format>   Output format: text (default), jsonl, tsv or raw (journal\n");
+    printf("                      lines), one book per line, the summary goes to stderr\n");
+    printf("  --threads <int>     Parse the journal text with N threads (1-%d)\n", LIST_MAX_THREADS);
+    printf("  --sort <field>      Sort by score, start, end or name (missing values last)\n");
+    printf("  --desc              Sort in descending order\n");
+    printf("  --limit <int>       Print only the first N books\n");
+    printf("  --follow            Keep listing books appended to the journal until Ctrl+C\n");
+    printf("  --offset <int>      Page: skip N books, with --limit as the page size\n");
+    printf("  --cursor <token>    Page: continue where the previous page ended\n");
+    printf("                      Pages print no total, which would need the whole journal\n");
+    printf("  --sort-memory <MB>  Sort memory before spilling to temporary files (%d)\n\n",
+           SORT_MEMORY_BUDGET / (1024 * 1024));
+    printf("Options for 'import':\n");
+    printf("  --file <path>       Read entries from a file instead of stdin\n");
+    printf("  --format <format>   Input format: pipe (journal lines, default) or jsonl\n");
+    printf("  --fsync             Sync the journal to disk after the import\n\n");
+    printf("Options for 'bench':\n");
+    printf("  tokenize            Compare tokenizers [--lines <int>] [--note-length <int>]\n");
+    printf("  generate            Write a synthetic journal to a new file (--file <path>)\n");
+    printf("                      [--lines <int>] [--genres <int>] [--authors <int>]\n");
+    printf("                      [--reading <percent>] [--note-length <int>] [--seed <int>]\n");
+    printf("                      [--scores <w0,w1,w2,w3,w4,w5>] (no score, scores 1-5)\n");
+    printf("  suite               Time load, filters, print and append, print JSON\n");
+    printf("                      [--file <path>] [--genre <string>] [--score <int>]\n");
+    printf("                      [--appends <int>]\n\n");
+    printf("Global options:\n");
+    printf("  -h, --help          Show this help message\n");
+    printf("  --alloc-stats       Report allocation counters of the command to stderr\n");
+    printf("  --no-daemon         Run list and new in this process, without the serve daemon\n");
+    printf("  --profile           Print phase times and counters of list and new to stderr\n\n");
+    printf("Examples:\n");
+    printf(
+        "  ./journal new --name \"Hobbit\" --author \"J.R.R. Tolkien\" --genre fantasy --start \"2022-01-01\" --score 4\n");
+    printf("  ./journal list --genre fantasy\n");
+    printf("  ./journal list --completed --genre fantasy --score 4\n");
+    printf("  ./journal list --reading --not --genre fantasy\n");
+    printf("  ./journal list --started-after 2023-12-31 --started-before 2024-02-01\n");
+    printf("  ./journal list --sort score --desc --limit 20\n");
+}
+
+/**
+ * @brief Creates a slice covering the whole null-terminated string.
+ *
+ * @param string The string to wrap. May be NULL, in which case an absent slice is returned.
+ *
+ * @return A slice pointing to `string` with its length, or an absent slice for NULL.
+ */
+TextSlice slice_from_string(const char *string) {
+    TextSlice slice = {string, string != NULL ? strlen(string) : 0};
+    return slice;
+}
+
+/**
+ * @brief Checks whether the slice holds a value.
+ *
+ * @param slice The slice to check.
+ *
+ * @return True if the slice points to a value (which may still be empty), false if the field is absent.
+ */
+bool slice_is_present(TextSlice slice) {
+    return slice.data != NULL;
+}
+
+/**
+ * @brief Compares a slice with a null-terminated string for an exact match.
+ *
+ * @param slice The slice to compare. An absent slice never matches.
+ * @param string A null-terminated string to compare against. A NULL string never matches.
+ *
+ * @return True if both have the same length and the same bytes, otherwise false.
+ */
+bool slice_equals_string(TextSlice slice, const char *string) {
+    if (slice.data == NULL || string == NULL) return false;
+    return strlen(string) == slice.length && memcmp(slice.data, string, slice.length) == 0;
+}
+
+/**
+ * @brief Clears all fields of an entry. Text fields become absent, dates `DATE_NONE` and the genre is not interned.
+ */
+void reset_entry(JournalEntry *entry) {
+    memset(entry, 0, sizeof(JournalEntry));
+    entry->genre_id = GENRE_NONE;
+    entry->start_day = DATE_NONE;
+    entry->end_day = DATE_NONE;
+    entry->id = ENTRY_ID_NONE;
+}
+
+/**
+ * @brief Parses the score field of a journal record.
+ *
+ * The slice is not null-terminated, so `strtol` cannot be used directly. The parser mirrors its behaviour
+ * for the values a journal can hold: leading whitespace is skipped, an optional sign is accepted and the
+ * leading run of decimal digits is converted. Anything after the digits is ignored.
+ *
+ * @param slice The score field. An absent or empty slice yields 0 (no score).
+ *
+ * @return The parsed score, converted to `unsigned int` the same way `strtol` results were before.
+ */
+unsigned int parse_score(TextSlice slice) {
+    size_t i = 0;
+    while (i < slice.length && isspace((unsigned char) slice.data[i])) i++;
+    bool negative = false;
+    if (i < slice.length && (slice.data[i] == '-' || slice.data[i] == '+')) {
+        negative = slice.data[i] == '-';
+        i++;
+    }
+    long value = 0;
+    for (; i < slice.length && isdigit((unsigned char) slice.data[i]); i++) {
+        if (value < 100000000L) value = value * 10 + (slice.data[i] - '0');
+    }
+    return (unsigned int) (negative ? -value : value);
+}
+
+/**
+ * @brief Converts a civil date to the number of days since 1970-01-01.
+ *
+ * Uses the proleptic Gregorian calendar, so the result is valid for any year.
+ */
+int32_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+/**
+ * @brief Parses and validates an ISO 8601 date (YYYY-MM-DD).
+ *
+ * The digits are converted in place and the length of the month is taken from `days_in_month`, so the
+ * function has no shared mutable state and can be called from any thread.
+ *
+ * @param text The date, not necessarily null-terminated.
+ * @param length Length of the date in bytes, it must be 10.
+ * @param parts Receives the year, month and day.
+ *
+ * @return True if the text is a valid calendar date, otherwise false.
+ */
+bool parse_date(const char *text, size_t length, int parts[3]) {
+    if (text == NULL || length != 10 || text[4] != '-' || text[7] != '-') return false;
+    parts[0] = parts[1] = parts[2] = 0;
+    int part = 0;
+    for (size_t i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) {
+            part++;
+            continue;
+        }
+        unsigned int digit = (unsigned char) text[i] - (unsigned int) '0';
+        if (digit > 9) return false;
+        parts[part] = parts[part] * 10 + (int) digit;
+    }
+    int year = parts[0];
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return parts[1] >= 1 && parts[1] <= 12 && parts[2] >= 1 && parts[2] <= days_in_month[leap][parts[1] - 1];
+}
+
+/**
+ * @brief Packs an ISO 8601 date (YYYY-MM-DD) into a day number.
+ *
+ * @param date The date field of a journal line.
+ *
+ * @return Days since 1970-01-01, or `DATE_NONE` if the field is absent or not a valid date.
+ */
+int32_t date_to_day_number(TextSlice date) {
+    int parts[3];
+    if (!parse_date(date.data, date.length, parts)) return DATE_NONE;
+    return days_from_civil(parts[0], parts[1], parts[2]);
+}
+
+/**
+ * @brief Initializes an empty arena. No memory is allocated until the first `arena_alloc`.
+ */
+void arena_init(Arena *arena) {
+    memset(arena, 0, sizeof(Arena));
+}
+
+/**
+ * @brief Allocates `size` bytes from the arena.
+ *
+ * The returned memory is aligned for any type and is not initialized. Requests larger than
+ * `ARENA_BLOCK_SIZE` get a block of their own.
+ *
+ * @param arena The arena to allocate from.
+ * @param size Number of bytes to allocate.
+ *
+ * @return Pointer to the allocated memory, or NULL if a new block could not be allocated.
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+    const size_t alignment = _Alignof(max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        if (block == NULL) return NULL;
+        block->next = arena->head;
+        block->capacity = capacity;
+        block->used = 0;
+        arena->head = block;
+        arena->block_allocations++;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    arena->allocations++;
+    arena->bytes_used += size;
+    if (arena->bytes_used > arena->peak_bytes) arena->peak_bytes = arena->bytes_used;
+    return memory;
+}
+
+/**
+ * @brief Copies a null-terminated string into the arena, including its terminator.
+ *
+ * @return The copy, or NULL if `string` is NULL or the allocation failed.
+ */
+char *arena_strdup(Arena *arena, const char *string) {
+    if (string == NULL) return NULL;
+    size_t size = strlen(string) + 1;
+    char *copy = arena_alloc(arena, size);
+    if (copy != NULL) memcpy(copy, string, size);
+    return copy;
+}
+
+/**
+ * @brief Releases everything allocated from the arena but keeps one block for reuse.
+ *
+ * Resetting an arena between records lets a whole load run from a single block.
+ */
+void arena_reset(Arena *arena) {
+    if (arena->head == NULL) return;
+    ArenaBlock *block = arena->head->next;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+    arena->bytes_used = 0;
+}
+
+/**
+ * @brief Releases all memory owned by the arena. The arena can be used again afterwards.
+ */
+void arena_free(Arena *arena) {
+    arena_reset(arena);
+    free(arena->head);
+    arena->head = NULL;
+}
+
+/**
+ * @brief Prints the allocation counters of an arena to stderr when `--alloc-stats` was given.
+ *
+ * @param arena The arena to report.
+ * @param label Name of the command or load the arena served.
+ */
+void print_arena_stats(const Arena *arena, const char *label) {
+    if (!alloc_stats_enabled) return;
+    fprintf(stderr, "%s: %zu arena allocations, %zu malloc calls, peak %zu arena bytes\n", label,
+            arena->allocations, arena->block_allocations, arena->peak_bytes);
+}
+
+/**
+ * @brief Returns the time of a monotonic clock in seconds, for measuring durations.
+ */
+double monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Returns the peak resident set size of the process in kilobytes, or -1 if it is not known.
+ */
+long peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+/**
+ * @brief Returns the CPU time used by the calling thread in seconds.
+ */
+double thread_cpu_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Switches the calling thread to another phase of `--profile`.
+ *
+ * The time since the last switch is added to the phase that was running, so the phases of a thread never
+ * overlap: a write in the middle of formatting counts as writing only. Without `--profile` the function
+ * only checks the flag, so it can be called once per block of entries at no measurable cost.
+ *
+ * @return The phase that was running, to switch back to it after a nested phase.
+ */
+ProfilePhase profile_enter(ProfilePhase phase) {
+    if (!profile_enabled) return PROFILE_OTHER;
+    CommandProfile *profile = &thread_profile;
+    double wall = monotonic_seconds();
+    double cpu = thread_cpu_seconds();
+    if (profile->started) {
+        profile->wall[profile->current] += wall - profile->mark_wall;
+        profile->cpu[profile->current] += cpu - profile->mark_cpu;
+    }
+    ProfilePhase previous = profile->current;
+    profile->started = true;
+    profile->current = phase;
+    profile->mark_wall = wall;
+    profile->mark_cpu = cpu;
+    return previous;
+}
+
+/**
+ * @brief Adds the arena counters of a command to its profile.
+ */
+void profile_arena(const Arena *arena) {
+    thread_profile.allocations += arena->allocations;
+    thread_profile.malloc_calls += arena->block_allocations;
+}
+
+/**
+ * @brief Ends the running phase of the calling thread and adds its profile to `profile_totals`.
+ */
+void merge_thread_profile() {
+    profile_enter(PROFILE_OTHER);
+    CommandProfile *profile = &thread_profile;
+    pthread_mutex_lock(&profile_lock);
+    for (int i = 0; i < PROFILE_PHASE_COUNT; i++) {
+        profile_totals.wall[i] += profile->wall[i];
+        profile_totals.cpu[i] += profile->cpu[i];
+    }
+    profile_totals.bytes_read += profile->bytes_read;
+    profile_totals.rejected_lines += profile->rejected_lines;
+    profile_totals.allocations += profile->allocations;
+    profile_totals.malloc_calls += profile->malloc_calls;
+    pthread_mutex_unlock(&profile_lock);
+    memset(profile, 0, sizeof(CommandProfile));
+}
+
+/**
+ * @brief Prints the profile of a command to stderr when `--profile` was given.
+ *
+ * Phases of worker threads are included, so with `--threads` the phases can add up to more than the
+ * total, which is the wall time of the main thread. The total CPU time is the one of all threads.
+ *
+ * @param command Name of the profiled command.
+ */
+void print_profile(const char *command) {
+    static const char *const names[PROFILE_PHASE_COUNT] = {"other", "open/read", "tokenize", "load", "filter",
+                                                           "format", "write"};
+    if (!profile_enabled) return;
+    profile_enter(PROFILE_OTHER);
+    double wall = 0;
+    for (int i = 0; i < PROFILE_PHASE_COUNT; i++) wall += thread_profile.wall[i];
+    merge_thread_profile();
+    double cpu = 0;
+    for (int i = 0; i < PROFILE_PHASE_COUNT; i++) cpu += profile_totals.cpu[i];
+    fprintf(stderr, "Profile of %s:\n  %-10s %12s %12s\n", command, "phase", "wall ms", "cpu ms");
+    for (int i = 1; i <= PROFILE_PHASE_COUNT; i++) {
+        int phase = i % PROFILE_PHASE_COUNT;
+        fprintf(stderr, "  %-10s %12.3f %12.3f\n", names[phase], profile_totals.wall[phase] * 1e3,
+                profile_totals.cpu[phase] * 1e3);
+    }
+    fprintf(stderr, "  %-10s %12.3f %12.3f\n", "total", wall * 1e3, cpu * 1e3);
+    fprintf(stderr, "  bytes read %llu, lines rejected %llu, %llu arena allocations, %llu malloc calls\n",
+            (unsigned long long) profile_totals.bytes_read, (unsigned long long) profile_totals.rejected_lines,
+            (unsigned long long) profile_totals.allocations, (unsigned long long) profile_totals.malloc_calls);
+    fprintf(stderr, "  peak RSS %ld KB\n", peak_rss_kb());
+}
+
+/**
+ * @brief Hashes a slice with 32-bit FNV-1a.
+ */
+uint32_t hash_slice(TextSlice slice) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < slice.length; i++) {
+        hash ^= (unsigned char) slice.data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Finds the hash table slot holding `name`, or the empty slot where it would be inserted.
+ */
+size_t genre_dictionary_slot(const GenreDictionary *dictionary, TextSlice name, uint32_t hash) {
+    size_t mask = dictionary->slot_count - 1;
+    size_t slot = hash & mask;
+    while (dictionary->slots[slot] != 0) {
+        uint32_t id = dictionary->slots[slot] - 1;
+        TextSlice candidate = dictionary->names[id];
+        if (dictionary->hashes[id] == hash && candidate.length == name.length &&
+            memcmp(candidate.data, name.data, name.length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Doubles the hash table of the dictionary and re-inserts all IDs.
+ *
+ * @return True on success, false if memory could not be allocated.
+ */
+bool genre_dictionary_grow(GenreDictionary *dictionary) {
+    size_t slot_count = dictionary->slot_count == 0 ? 64 : dictionary->slot_count * 2;
+    uint32_t *slots = calloc(slot_count, sizeof(uint32_t));
+    if (slots == NULL) return false;
+    free(dictionary->slots);
+    dictionary->slots = slots;
+    dictionary->slot_count = slot_count;
+    for (size_t id = 0; id < dictionary->count; id++) {
+        size_t slot = genre_dictionary_slot(dictionary, dictionary->names[id], dictionary->hashes[id]);
+        dictionary->slots[slot] = (uint32_t) id + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Looks a genre up without adding it.
+ *
+ * @return The ID of the genre, or `GENRE_NONE` if it is not in the dictionary.
+ */
+uint32_t genre_dictionary_find(const GenreDictionary *dictionary, TextSlice name) {
+    if (dictionary->slot_count == 0 || name.data == NULL) return GENRE_NONE;
+    size_t slot = genre_dictionary_slot(dictionary, name, hash_slice(name));
+    return dictionary->slots[slot] != 0 ? dictionary->slots[slot] - 1 : GENRE_NONE;
+}
+
+/**
+ * @brief Returns the ID of the genre, adding a copy of it to the dictionary when it is new.
+ *
+ * The copy is null-terminated, so `genre_dictionary.names[id].data` can be used as a C string.
+ *
+ * @return The ID of the genre, or `GENRE_NONE` if it had to be added and memory ran out.
+ */
+uint32_t genre_dictionary_intern(GenreDictionary *dictionary, TextSlice name) {
+    if (name.data == NULL) return GENRE_NONE;
+    if ((dictionary->count + 1) * 2 > dictionary->slot_count && !genre_dictionary_grow(dictionary)) {
+        return GENRE_NONE;
+    }
+    uint32_t hash = hash_slice(name);
+    size_t slot = genre_dictionary_slot(dictionary, name, hash);
+    if (dictionary->slots[slot] != 0) return dictionary->slots[slot] - 1;
+
+    if (dictionary->count == dictionary->capacity) {
+        size_t capacity = dictionary->capacity == 0 ? 64 : dictionary->capacity * 2;
+        TextSlice *names = realloc(dictionary->names, capacity * sizeof(TextSlice));
+        if (names == NULL) return GENRE_NONE;
+        dictionary->names = names;
+        uint32_t *hashes = realloc(dictionary->hashes, capacity * sizeof(uint32_t));
+        if (hashes == NULL) return GENRE_NONE;
+        dictionary->hashes = hashes;
+        dictionary->capacity = capacity;
+    }
+    char *copy = arena_alloc(&dictionary->arena, name.length + 1);
+    if (copy == NULL) return GENRE_NONE;
+    memcpy(copy, name.data, name.length);
+    copy[name.length] = '\0';
+    uint32_t id = (uint32_t) dictionary->count++;
+    dictionary->names[id].data = copy;
+    dictionary->names[id].length = name.length;
+    dictionary->hashes[id] = hash;
+    dictionary->slots[slot] = id + 1;
+    return id;
+}
+
+/**
+ * @brief Releases all memory of the dictionary and leaves it empty.
+ */
+void genre_dictionary_free(GenreDictionary *dictionary) {
+    arena_free(&dictionary->arena);
+    free(dictionary->names);
+    free(dictionary->hashes);
+    free(dictionary->slots);
+    memset(dictionary, 0, sizeof(GenreDictionary));
+}
+
+/**
+ * @brief Interns the genre of a loaded entry into the program wide `genre_dictionary`.
+ *
+ * Afterwards the genre of the entry points to the shared copy in the dictionary instead of the line it
+ * was loaded from, and `genre_id` is set. If the genre cannot be interned the entry is left unchanged.
+ */
+void intern_entry_genre(JournalEntry *entry) {
+    uint32_t id = genre_dictionary_intern(&genre_dictionary, entry->genre);
+    if (id == GENRE_NONE) return;
+    entry->genre = genre_dictionary.names[id];
+    entry->genre_id = id;
+}
+
+/**
+ * @brief Sets the genre ID of an entry if its genre is already in `genre_dictionary`.
+ *
+ * Unlike `intern_entry_genre` it does not modify the dictionary, so worker threads can call it
+ * concurrently. An unknown genre keeps `GENRE_NONE`, and filters then compare the genre text instead.
+ */
+void lookup_entry_genre(JournalEntry *entry) {
+    uint32_t id = genre_dictionary_find(&genre_dictionary, entry->genre);
+    if (id == GENRE_NONE) return;
+    entry->genre = genre_dictionary.names[id];
+    entry->genre_id = id;
+}
+
+/**
+ * @brief Validates if the given string represents a valid date in the format YYYY-MM-DD.
+ *
+ * This function checks whether the input string conforms to the ISO 8601 date format (YYYY-MM-DD),
+ * verifies that the year, month, and day values are within valid ranges, and accounts for leap years
+ * when determining the number of days in February. It is reentrant, see `parse_date`.
+ *
+ * @param date A null-terminated C-string representing the date to be validated. The input should follow
+ *             the fixed-length format of "YYYY-MM-DD" (10 characters). The string must not be null.
+ *
+ * @return True if the input string is a valid date in the format YYYY-MM-DD, otherwise false.
+ *
+ * - If the input string is null or does not have a length of 10, the function returns false.
+ * - Each character of the input string is validated to ensure that it either represents a digit or the
+ *   expected '-' separator in the appropriate positions (4th and 7th indices).
+ * - The year, month, and day are extracted and validated to ensure they fall within permissible ranges:
+ *   - Month must be in the range [1, 12].
+ *   - Day must be greater than or equal to 1.
+ *   - Day must not exceed the maximum number of days in the respective month for the given year, as
+ *     listed by `days_in_month` for common and leap years.
+ *
+ */
+bool is_valid_date(const char *date) {
+    int parts[3];
+    return date != NULL && parse_date(date, strlen(date), parts);
+}
+
+/**
+ * @brief Retrieves a valid date string in the format YYYY-MM-DD.
+ *
+ * This function performs validation on the provided date string to ensure
+ * that it adheres to the ISO 8601 date format (YYYY-MM-DD). If the format
+ * or content of the date is invalid, an error message is displayed, and
+ * the function returns a null pointer. Otherwise, the original input date
+ * string is returned.
+ *
+ * @param date A null-terminated C-string representing the date. The string
+ *             must not be null and should follow the format YYYY-MM-DD.
+ *
+ * @return A pointer to the original date string if it is valid, otherwise
+ *         NULL.
+ *
+ * - If the input date is null, the function returns NULL without attempting validation.
+ * - The function relies on `is_valid_date` to verify the date's format and
+ *   validity. If the date is invalid, an error message is printed, and
+ *   the function returns NULL.
+ * - If the date is valid, the input pointer is returned unchanged.
+ */
+char *get_date(char *date) {
+    if (date == NULL) return NULL;
+    if (!is_valid_date(date)) {
+        printf("Invalid date format. Correct format is YYYY-MM-DD (ISO 8601)\n");
+        return NULL;
+    }
+    return date;
+}
+
+/**
+ * @brief Parses the value of a `--score` option, a whole number from 1 to 5.
+ *
+ * @return True if the value is valid, otherwise false (which is reported) and the score is not changed.
+ */
+bool get_score(const char *value, unsigned int *score) {
+    char *end = NULL;
+    long parsed = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || parsed < 1 || parsed > 5) {
+        printf("Invalid score %s, expected a whole number from 1 to 5\n", value);
+        return false;
+    }
+    *score = (unsigned int) parsed;
+    return true;
+}
+
+/**
+ * @brief Extracts the value associated with a specified command-line option.
+ *
+ * This function retrieves the argument string that follows a particular option index
+ * in the command-line arguments. If the option does not have a corresponding value,
+ * or if the value is misinterpreted as another option (prefixed with "--"), the function
+ * returns a null pointer. The returned value is copied into the given arena and is released
+ * together with it.
+ *
+ * @param arena The arena the value is copied into.
+ * @param argc The total number of arguments passed to the program, including the program name.
+ * @param argv An array of null-terminated strings containing the command-line arguments.
+ * @param option_index The index within `argv` of the target option whose value is to be extracted.
+ *
+ * @return A pointer to an arena allocated copy of the value of the specified option
+ * if the value exists and is valid. Returns NULL if:
+ * - The index `option_index + 1` is out of bounds.
+ * - The argument at `option_index + 1` appears to be an option (starts with "--").
+ */
+char *get_option_value(Arena *arena, int argc, char *argv[], int option_index) {
+    if (argc <= option_index + 1) return NULL;
+    if (argv[option_index + 1][0] == '-' && argv[option_index + 1][1] == '-') return NULL;
+    return arena_strdup(arena, argv[option_index + 1]);
+}
+
+/**
+ * @brief Prepares an output buffer.
+ *
+ * @param out The buffer to initialize.
+ * @param fd The file descriptor to flush the buffer to, or -1 for a buffer kept in memory.
+ */
+void output_init(OutputBuffer *out, int fd) {
+    out->fd = fd;
+    out->data = NULL;
+    out->used = 0;
+    out->capacity = 0;
+    out->failed = false;
+}
+
+/**
+ * @brief Writes a list of byte ranges to the file descriptor of a buffer, retrying partial writes.
+ *
+ * @return True on success. On a write error the buffer is marked as failed and the error is reported once.
+ */
+bool output_writev(OutputBuffer *out, struct iovec *parts, int count) {
+    ProfilePhase previous = profile_enter(PROFILE_WRITE);
+    while (count > 0 && !out->failed) {
+        ssize_t written = writev(out->fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write output");
+            out->failed = true;
+            break;
+        }
+        while (count > 0 && (size_t) written >= parts->iov_len) {
+            written -= (ssize_t) parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char *) parts->iov_base + written;
+            parts->iov_len -= written;
+        }
+    }
+    profile_enter(previous);
+    return !out->failed;
+}
+
+/**
+ * @brief Writes the buffered text to the file descriptor of the buffer. Does nothing for a memory buffer.
+ */
+void output_flush(OutputBuffer *out) {
+    if (out->fd < 0 || out->used == 0) return;
+    struct iovec part = {out->data, out->used};
+    output_writev(out, &part, 1);
+    out->used = 0;
+}
+
+/**
+ * @brief Flushes the buffer and releases its memory.
+ */
+void output_free(OutputBuffer *out) {
+    output_flush(out);
+    free(out->data);
+    out->data = NULL;
+    out->capacity = 0;
+}
+
+/**
+ * @brief Makes room for `length` more bytes in the buffer, by growing a memory buffer or flushing a file one.
+ *
+ * @return True if the bytes fit into the buffer now.
+ */
+bool output_reserve(OutputBuffer *out, size_t length) {
+    if (out->failed) return false;
+    if (out->capacity - out->used >= length) return true;
+    if (out->fd >= 0) {
+        output_flush(out);
+        if (out->capacity >= length) return !out->failed;
+    }
+    size_t capacity = out->capacity != 0 ? out->capacity : OUTPUT_BUFFER_SIZE;
+    while (capacity - out->used < length) capacity *= 2;
+    char *data = realloc(out->data, capacity);
+    if (data == NULL) {
+        perror("Failed to allocate memory for output");
+        out->failed = true;
+        return false;
+    }
+    out->data = data;
+    out->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Appends bytes to the buffer.
+ *
+ * A block larger than the whole buffer of a file descriptor is written together with the buffered text by
+ * one `writev` instead of being copied.
+ */
+void output_bytes(OutputBuffer *out, const char *data, size_t length) {
+    if (out->fd >= 0 && length >= OUTPUT_BUFFER_SIZE) {
+        struct iovec parts[2] = {{out->data, out->used}, {(char *) data, length}};
+        output_writev(out, parts, 2);
+        out->used = 0;
+        return;
+    }
+    if (!output_reserve(out, length)) return;
+    memcpy(out->data + out->used, data, length);
+    out->used += length;
+}
+
+/**
+ * @brief Appends a null-terminated string to the buffer.
+ */
+void output_string(OutputBuffer *out, const char *string) {
+    output_bytes(out, string, strlen(string));
+}
+
+/**
+ * @brief Appends a text slice to the buffer.
+ */
+void output_slice(OutputBuffer *out, TextSlice slice) {
+    output_bytes(out, slice.data, slice.length);
+}
+
+/**
+ * @brief Appends an integer in decimal, the same as `printf("%d")` would.
+ */
+void output_int(OutputBuffer *out, int value) {
+    char digits[16];
+    size_t start = sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+    do {
+        digits[--start] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) digits[--start] = '-';
+    output_bytes(out, digits + start, sizeof(digits) - start);
+}
+
+/**
+ * @brief Appends the record ID of an entry, `<offset in hex>.<check in hex>` as read by `parse_record_id`.
+ */
+void output_record_id(OutputBuffer *out, const JournalEntry *entry) {
+    char id[32];
+    int length = snprintf(id, sizeof(id), "%llx.%08x", (unsigned long long) entry->id, (unsigned int) entry->id_check);
+    output_bytes(out, id, (size_t) length);
+}
+
+/**
+ * @brief Prints a journal entry in the human readable block format.
+ *
+ * The fields are copied into the buffer as they are, the output is the same as printing them with
+ * `printf("%.*s")`.
+ *
+ * @param out The buffer to print to, bound to stdout or the memory buffer of a list worker.
+ * @param entry The entry to print. NULL is ignored.
+ */
+void print_entry(OutputBuffer *out, const JournalEntry *entry) {
+    if (entry == NULL) return;
+    output_string(out, "-- ");
+    output_slice(out, entry->book_name);
+    output_string(out, " --\n");
+    if (list_show_ids && entry->id != ENTRY_ID_NONE) {
+        output_string(out, "id:               ");
+        output_record_id(out, entry);
+        output_string(out, "\n");
+    }
+    output_string(out, "author:           ");
+    output_slice(out, entry->author);
+    output_string(out, "\ngenre:            ");
+    output_slice(out, entry->genre);
+    output_string(out, "\nstarted reading:  ");
+    output_slice(out, entry->start_date);
+    if (slice_is_present(entry->end_date)) {
+        output_string(out, "\nfinished reading: ");
+        output_slice(out, entry->end_date);
+    }
+    if (entry->score != 0) {
+        output_string(out, "\npersonal score:   ");
+        output_int(out, (int) entry->score);
+    }
+    if (slice_is_present(entry->note)) {
+        output_string(out, "\nnote:             ");
+        output_slice(out, entry->note);
+    }
+    output_string(out, "\n-------\n");
+}
+
+/**
+ * @brief Checks a date given as a text slice, see `is_valid_date`.
+ */
+bool is_valid_date_slice(TextSlice date) {
+    int parts[3];
+    return parse_date(date.data, date.length, parts);
+}
+
+/**
+ * @brief Checks if a required text field is present and not empty.
+ */
+bool slice_is_filled(TextSlice slice) {
+    return slice_is_present(slice) && slice.length > 0;
+}
+
+/**
+ * @brief Checks a complete entry before it is written to the journal.
+ *
+ * Shared by `new` and `import`, so entries from both go through the same rules: the required fields must be
+ * filled in, dates must be valid, the score must be from 1 to 5 (0 means no score) and no text field may
+ * contain the '|' separator or a newline, which would break the journal line.
+ *
+ * @return NULL for a valid entry, otherwise a description of the first problem found.
+ */
+const char *entry_validation_error(const JournalEntry *entry) {
+    if (!slice_is_filled(entry->book_name)) return "book name is required";
+    if (!slice_is_filled(entry->author)) return "author is required";
+    if (!slice_is_filled(entry->genre)) return "genre is required";
+    if (!slice_is_filled(entry->start_date)) return "start date is required";
+    if (!is_valid_date_slice(entry->start_date)) return "start date is not a valid YYYY-MM-DD date";
+    if (slice_is_present(entry->end_date) && !is_valid_date_slice(entry->end_date)) {
+        return "end date is not a valid YYYY-MM-DD date";
+    }
+    if (entry->score > 5) return "score must be from 1 to 5";
+    const TextSlice text_fields[] = {entry->book_name, entry->author, entry->genre, entry->note};
+    for (size_t i = 0; i < sizeof(text_fields) / sizeof(text_fields[0]); i++) {
+        TextSlice field = text_fields[i];
+        if (!slice_is_present(field)) continue;
+        if (memchr(field.data, '|', field.length) != NULL || memchr(field.data, '\n', field.length) != NULL) {
+            return "fields must not contain '|' or a newline";
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Appends an entry to a buffer as one journal line, in the format read by `parse_entry`.
+ */
+void output_journal_line(OutputBuffer *out, const JournalEntry *entry) {
+    output_slice(out, entry->book_name);
+    output_bytes(out, "|", 1);
+    output_slice(out, entry->author);
+    output_bytes(out, "|", 1);
+    output_slice(out, entry->genre);
+    output_bytes(out, "|", 1);
+    output_slice(out, entry->start_date);
+    output_bytes(out, "|", 1);
+    if (slice_is_present(entry->end_date)) output_slice(out, entry->end_date);
+    output_bytes(out, "|", 1);
+    if (entry->score != 0) output_int(out, (int) entry->score);
+    output_bytes(out, "|", 1);
+    if (slice_is_present(entry->note)) output_slice(out, entry->note);
+    output_bytes(out, "\n", 1);
+}
+
+/**
+ * @brief Appends a text field as a JSON string, or `null` for a missing field.
+ *
+ * Room for the longest escaped form is reserved first, so the bytes are copied straight into the buffer.
+ * Quotes, backslashes and control characters are escaped, other bytes are copied as they are, so UTF-8
+ * text stays UTF-8.
+ */
+void output_json_slice(OutputBuffer *out, TextSlice slice) {
+    if (!slice_is_present(slice)) {
+        output_bytes(out, "null", 4);
+        return;
+    }
+    if (!output_reserve(out, slice.length * 6 + 2)) return;
+    static const char hex[] = "0123456789abcdef";
+    char *cursor = out->data + out->used;
+    *cursor++ = '"';
+    for (size_t i = 0; i < slice.length; i++) {
+        unsigned char c = (unsigned char) slice.data[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            *cursor++ = (char) c;
+        } else if (c == '"' || c == '\\' || c == '\n' || c == '\t' || c == '\r') {
+            *cursor++ = '\\';
+            *cursor++ = c == '\n' ? 'n' : c == '\t' ? 't' : c == '\r' ? 'r' : (char) c;
+        } else {
+            memcpy(cursor, "\\u00", 4);
+            cursor[4] = hex[c >> 4];
+            cursor[5] = hex[c & 15];
+            cursor += 6;
+        }
+    }
+    *cursor++ = '"';
+    out->used = (size_t) (cursor - out->data);
+}
+
+/**
+ * @brief Appends an entry as one JSON object on its own line, with the keys read by `import --format jsonl`.
+ *
+ * Missing optional fields are `null`. With `list_show_ids` the record ID comes first.
+ */
+void output_json_entry(OutputBuffer *out, const JournalEntry *entry) {
+    output_string(out, "{");
+    if (list_show_ids && entry->id != ENTRY_ID_NONE) {
+        output_string(out, "\"id\":\"");
+        output_record_id(out, entry);
+        output_string(out, "\",");
+    }
+    output_string(out, "\"name\":");
+    output_json_slice(out, entry->book_name);
+    output_string(out, ",\"author\":");
+    output_json_slice(out, entry->author);
+    output_string(out, ",\"genre\":");
+    output_json_slice(out, entry->genre);
+    output_string(out, ",\"start\":");
+    output_json_slice(out, entry->start_date);
+    output_string(out, ",\"end\":");
+    output_json_slice(out, entry->end_date);
+    output_string(out, ",\"score\":");
+    if (entry->score != 0) {
+        output_int(out, (int) entry->score);
+    } else {
+        output_string(out, "null");
+    }
+    output_string(out, ",\"note\":");
+    output_json_slice(out, entry->note);
+    output_string(out, "}\n");
+}
+
+/**
+ * @brief Appends a text field as a tab separated value, a missing field is empty.
+ *
+ * Backslashes, tabs and line breaks are escaped as `\\`, `\t`, `\n` and `\r`, so every record stays on
+ * one line and keeps its columns.
+ */
+void output_tsv_slice(OutputBuffer *out, TextSlice slice) {
+    if (!slice_is_present(slice) || !output_reserve(out, slice.length * 2)) return;
+    char *cursor = out->data + out->used;
+    for (size_t i = 0; i < slice.length; i++) {
+        char c = slice.data[i];
+        if (c != '\\' && c != '\t' && c != '\n' && c != '\r') {
+            *cursor++ = c;
+        } else {
+            *cursor++ = '\\';
+            *cursor++ = c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : '\\';
+        }
+    }
+    out->used = (size_t) (cursor - out->data);
+}
+
+/**
+ * @brief Appends an entry as one line of tab separated values, in the columns of `output_list_header`.
+ */
+void output_tsv_entry(OutputBuffer *out, const JournalEntry *entry) {
+    if (list_show_ids && entry->id != ENTRY_ID_NONE) {
+        output_record_id(out, entry);
+        output_bytes(out, "\t", 1);
+    }
+    output_tsv_slice(out, entry->book_name);
+    output_bytes(out, "\t", 1);
+    output_tsv_slice(out, entry->author);
+    output_bytes(out, "\t", 1);
+    output_tsv_slice(out, entry->genre);
+    output_bytes(out, "\t", 1);
+    output_tsv_slice(out, entry->start_date);
+    output_bytes(out, "\t", 1);
+    output_tsv_slice(out, entry->end_date);
+    output_bytes(out, "\t", 1);
+    if (entry->score != 0) output_int(out, (int) entry->score);
+    output_bytes(out, "\t", 1);
+    output_tsv_slice(out, entry->note);
+    output_bytes(out, "\n", 1);
+}
+
+/**
+ * @brief Appends a listed entry in the format of `list_format`.
+ *
+ * The fields are written straight from the slices of the entry, which point into the journal text.
+ * `LIST_FORMAT_RAW` writes the journal line of the entry (`output_journal_line`), with the changes of the
+ * overlay applied.
+ */
+void format_entry(OutputBuffer *out, const JournalEntry *entry) {
+    switch (list_format) {
+        case LIST_FORMAT_TEXT: print_entry(out, entry);
+            break;
+        case LIST_FORMAT_JSONL: output_json_entry(out, entry);
+            break;
+        case LIST_FORMAT_TSV: output_tsv_entry(out, entry);
+            break;
+        case LIST_FORMAT_RAW: output_journal_line(out, entry);
+            break;
+    }
+}
+
+/**
+ * @brief Appends what precedes the listed entries: the title of the text format or the column names of TSV.
+ */
+void output_list_header(OutputBuffer *out) {
+    if (list_format == LIST_FORMAT_TEXT) {
+        output_string(out, "Reading journal:\n");
+    } else if (list_format == LIST_FORMAT_TSV) {
+        if (list_show_ids) output_string(out, "id\t");
+        output_string(out, "name\tauthor\tgenre\tstart\tend\tscore\tnote\n");
+    }
+}
+
+/**
+ * @brief Releases the aggregates and leaves them empty.
+ */
+void free_journal_stats(JournalStats *stats) {
+    for (int grouping = 0; grouping < STATS_GROUPINGS; grouping++) {
+        genre_dictionary_free(&stats->groups[grouping]);
+        free(stats->counters[grouping]);
+    }
+    memset(stats, 0, sizeof(JournalStats));
+}
+
+/**
+ * @brief Adds the counters of `from` to `into`.
+ */
+void add_stats_counters(StatsCounters *into, const StatsCounters *from) {
+    into->entries += from->entries;
+    into->completed += from->completed;
+    into->scored += from->scored;
+    into->score_sum += from->score_sum;
+    into->timed += from->timed;
+    into->duration_sum += from->duration_sum;
+}
+
+/**
+ * @brief Returns the counters of a group, adding the group when it is new.
+ *
+ * @return The counters, or NULL if memory ran out (`failed` is set then).
+ */
+StatsCounters *stats_group(JournalStats *stats, StatsGrouping grouping, TextSlice name) {
+    uint32_t id = genre_dictionary_intern(&stats->groups[grouping], name);
+    if (id != GENRE_NONE && id >= stats->capacity[grouping]) {
+        size_t capacity = stats->capacity[grouping] == 0 ? 64 : stats->capacity[grouping] * 2;
+        StatsCounters *resized = realloc(stats->counters[grouping], capacity * sizeof(StatsCounters));
+        if (resized == NULL) {
+            id = GENRE_NONE;
+        } else {
+            memset(resized + stats->capacity[grouping], 0,
+                   (capacity - stats->capacity[grouping]) * sizeof(StatsCounters));
+            stats->counters[grouping] = resized;
+            stats->capacity[grouping] = capacity;
+        }
+    }
+    if (id == GENRE_NONE) {
+        stats->failed = true;
+        return NULL;
+    }
+    return &stats->counters[grouping][id];
+}
+
+/**
+ * @brief Adds one entry to the aggregates of its genre, author and start year.
+ *
+ * Entries whose start date is not a valid date are counted under the year "-".
+ */
+void add_stats_entry(JournalStats *stats, const JournalEntry *entry) {
+    StatsCounters counters = {1, 0, 0, 0, 0, 0};
+    int32_t start_day = date_to_day_number(entry->start_date);
+    if (slice_is_present(entry->end_date)) {
+        counters.completed = 1;
+        int32_t end_day = date_to_day_number(entry->end_date);
+        if (start_day != DATE_NONE && end_day != DATE_NONE && end_day >= start_day) {
+            counters.timed = 1;
+            counters.duration_sum = end_day - start_day;
+        }
+    }
+    if (entry->score >= 1 && entry->score <= 5) {
+        counters.scored = 1;
+        counters.score_sum = entry->score;
+    }
+    TextSlice year = start_day != DATE_NONE ? (TextSlice) {entry->start_date.data, 4} : slice_from_string("-");
+    const TextSlice names[STATS_GROUPINGS] = {entry->genre, entry->author, year};
+    for (int grouping = 0; grouping < STATS_GROUPINGS; grouping++) {
+        StatsCounters *group = stats_group(stats, (StatsGrouping) grouping, names[grouping]);
+        if (group != NULL) add_stats_counters(group, &counters);
+    }
+}
+
+/**
+ * @brief Hashes the last `STATS_TAIL_CHECK` bytes of the first `size` bytes of the journal, see `StatsHeader`.
+ *
+ * @param fd The journal descriptor, used when `data` is NULL.
+ * @param data The mapped journal, or NULL to read the bytes from `fd`.
+ * @param size Size of the part of the journal covered by the state file.
+ * @param hash Receives the hash.
+ *
+ * @return False if the bytes could not be read.
+ */
+bool journal_tail_hash(int fd, const char *data, size_t size, uint32_t *hash) {
+    char buffer[STATS_TAIL_CHECK];
+    size_t length = size < STATS_TAIL_CHECK ? size : STATS_TAIL_CHECK;
+    if (data == NULL) {
+        if (pread(fd, buffer, length, (off_t) (size - length)) != (ssize_t) length) return false;
+        data = buffer;
+    } else {
+        data += size - length;
+    }
+    *hash = hash_slice((TextSlice) {data, length});
+    return true;
+}
+
+/**
+ * @brief Checks whether a state file header describes the journal as it is now.
+ */
+bool stats_match_journal(const StatsHeader *header, const struct stat *journal_stat) {
+    return header->journal_inode == (uint64_t) journal_stat->st_ino &&
+           header->journal_size == (uint64_t) journal_stat->st_size &&
+           header->journal_mtime_sec == (int64_t) journal_stat->st_mtim.tv_sec &&
+           header->journal_mtime_nsec == (int64_t) journal_stat->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Loads the state file written by `write_stats_file`.
+ *
+ * @param stats Receives the aggregates. Must be empty, it is left empty when the file cannot be used.
+ * @param header Receives the header of the file.
+ *
+ * @return True if the file exists and is well formed.
+ */
+bool read_stats_file(JournalStats *stats, StatsHeader *header) {
+    int fd = open(JOURNAL_STATS_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    char *data = NULL;
+    bool ok = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(StatsHeader) &&
+              (data = malloc(st.st_size)) != NULL && read(fd, data, st.st_size) == st.st_size;
+    close(fd);
+    size_t size = ok ? (size_t) st.st_size : 0;
+    if (ok) {
+        memcpy(header, data, sizeof(StatsHeader));
+        ok = header->magic == JOURNAL_STATS_MAGIC && header->version == JOURNAL_STATS_VERSION;
+    }
+    size_t offset = sizeof(StatsHeader);
+    for (int grouping = 0; ok && grouping < STATS_GROUPINGS; grouping++) {
+        for (uint32_t i = 0; ok && i < header->group_count[grouping]; i++) {
+            StatsCounters counters;
+            uint32_t length;
+            ok = size - offset >= sizeof(StatsCounters) + sizeof(uint32_t);
+            if (!ok) break;
+            memcpy(&counters, data + offset, sizeof(StatsCounters));
+            memcpy(&length, data + offset + sizeof(StatsCounters), sizeof(uint32_t));
+            offset += sizeof(StatsCounters) + sizeof(uint32_t);
+            ok = size - offset >= length;
+            if (!ok) break;
+            StatsCounters *group = stats_group(stats, (StatsGrouping) grouping, (TextSlice) {data + offset, length});
+            if (group != NULL) add_stats_counters(group, &counters);
+            offset += length;
+        }
+    }
+    free(data);
+    stats->invalid_lines = ok ? header->invalid_lines : 0;
+    if (!ok || stats->failed) {
+        free_journal_stats(stats);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces the state file with the aggregates of the first `size` bytes of the journal.
+ *
+ * The caller holds the journal lock, which serializes the writers of the state file. The file is written
+ * under a temporary name and renamed, so readers never see a partial file.
+ *
+ * @param stats The aggregates of the covered part of the journal.
+ * @param journal_stat The journal at the time the aggregates were completed.
+ * @param tail_hash Hash of the end of the covered part, see `journal_tail_hash`.
+ *
+ * @return True if the file was written, false on an I/O error (which is reported).
+ */
+bool write_stats_file(const JournalStats *stats, const struct stat *journal_stat, uint32_t tail_hash) {
+    const char *temp_path = JOURNAL_STATS_FILE ".tmp";
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        perror("Failed to create journal stats");
+        return false;
+    }
+    StatsHeader header;
+    memset(&header, 0, sizeof(StatsHeader));
+    header.magic = JOURNAL_STATS_MAGIC;
+    header.version = JOURNAL_STATS_VERSION;
+    header.journal_inode = journal_stat->st_ino;
+    header.journal_size = journal_stat->st_size;
+    header.journal_mtime_sec = journal_stat->st_mtim.tv_sec;
+    header.journal_mtime_nsec = journal_stat->st_mtim.tv_nsec;
+    header.invalid_lines = stats->invalid_lines;
+    header.tail_hash = tail_hash;
+    for (int grouping = 0; grouping < STATS_GROUPINGS; grouping++) {
+        header.group_count[grouping] = (uint32_t) stats->groups[grouping].count;
+    }
+    bool ok = fwrite(&header, sizeof(StatsHeader), 1, file) == 1;
+    for (int grouping = 0; ok && grouping < STATS_GROUPINGS; grouping++) {
+        for (size_t id = 0; ok && id < stats->groups[grouping].count; id++) {
+            TextSlice name = stats->groups[grouping].names[id];
+            uint32_t length = (uint32_t) name.length;
+            ok = fwrite(&stats->counters[grouping][id], sizeof(StatsCounters), 1, file) == 1 &&
+                 fwrite(&length, sizeof(uint32_t), 1, file) == 1 && fwrite(name.data, 1, length, file) == length;
+        }
+    }
+    ok = fclose(file) == 0 && ok;
+    if (ok && rename(temp_path, JOURNAL_STATS_FILE) == 0) return true;
+    perror("Failed to write journal stats");
+    unlink(temp_path);
+    return false;
+}
+
+/**
+ * @brief Splits a journal line into its '|' separated fields without copying it.
+ *
+ * @param line Start of the line. The line must not contain the trailing newline.
+ * @param length Length of the line in bytes.
+ * @param fields Receives up to `JOURNAL_FIELD_COUNT` slices pointing into `line`.
+ *
+ * @return The number of fields found, at most `JOURNAL_FIELD_COUNT`. Text after the last field is ignored.
+ */
+int split_fields(const char *line, size_t length, TextSlice fields[JOURNAL_FIELD_COUNT]) {
+    const char *cursor = line;
+    const char *end = line + length;
+    int count = 0;
+    while (count < JOURNAL_FIELD_COUNT) {
+        const char *delimiter = memchr(cursor, '|', end - cursor);
+        const char *token_end = delimiter != NULL ? delimiter : end;
+        fields[count].data = cursor;
+        fields[count].length = token_end - cursor;
+        count++;
+        if (delimiter == NULL) break;
+        cursor = delimiter + 1;
+    }
+    return count;
+}
+
+/**
+ * @brief Folds an ASCII letter to lower case, other bytes are kept. Search is case-insensitive this way.
+ */
+unsigned char fold_ascii(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? (unsigned char) (c + ('a' - 'A')) : c;
+}
+
+/**
+ * @brief Hashes a trigram of folded bytes into one of the `SEARCH_BUCKETS` buckets of the search index.
+ */
+uint32_t trigram_bucket(unsigned char a, unsigned char b, unsigned char c) {
+    uint32_t trigram = (uint32_t) a << 16 | (uint32_t) b << 8 | c;
+    return (trigram * 2654435761u) >> (32 - SEARCH_BUCKET_BITS);
+}
+
+/**
+ * @brief Appends the buckets of all trigrams of a text, with duplicates, to `buckets`.
+ *
+ * @param buckets Room for at least `text.length` more buckets.
+ * @param count Number of buckets already in the array.
+ *
+ * @return The new number of buckets.
+ */
+size_t collect_trigram_buckets(TextSlice text, uint32_t *buckets, size_t count) {
+    if (!slice_is_present(text) || text.length < 3) return count;
+    const unsigned char *bytes = (const unsigned char *) text.data;
+    unsigned char a = fold_ascii(bytes[0]);
+    unsigned char b = fold_ascii(bytes[1]);
+    for (size_t i = 2; i < text.length; i++) {
+        unsigned char c = fold_ascii(bytes[i]);
+        buckets[count++] = trigram_bucket(a, b, c);
+        a = b;
+        b = c;
+    }
+    return count;
+}
+
+/**
+ * @brief Orders buckets for `qsort`.
+ */
+int compare_buckets(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t *) a;
+    uint32_t right = *(const uint32_t *) b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief Sorts buckets and removes duplicates.
+ *
+ * @return The number of distinct buckets.
+ */
+size_t sort_unique_buckets(uint32_t *buckets, size_t count) {
+    if (count == 0) return 0;
+    qsort(buckets, count, sizeof(uint32_t), compare_buckets);
+    size_t unique = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (buckets[i] != buckets[unique - 1]) buckets[unique++] = buckets[i];
+    }
+    return unique;
+}
+
+/**
+ * @brief Collects the buckets of the searchable fields (book name, author and note) of a split line.
+ *
+ * @param buckets Room for at least `length` buckets, the length of the line.
+ *
+ * @return The number of buckets, with duplicates.
+ */
+size_t line_trigram_buckets(const TextSlice *fields, int count, uint32_t *buckets) {
+    size_t found = collect_trigram_buckets(fields[0], buckets, 0);
+    found = collect_trigram_buckets(fields[1], buckets, found);
+    return count > 6 ? collect_trigram_buckets(fields[6], buckets, found) : found;
+}
+
+/**
+ * @brief Appends delta records for the entry lines of text just appended to the journal.
+ *
+ * @param out Memory buffer receiving the records.
+ * @param data The appended text, whole lines each ending with a newline.
+ * @param length Length of the text in bytes.
+ * @param offset Offset of the text in the journal.
+ * @param after The journal after the append, its modification time goes into the trailers.
+ */
+void output_search_delta(OutputBuffer *out, const char *data, size_t length, uint64_t offset,
+                         const struct stat *after) {
+    uint32_t *buckets = malloc((length + 1) * sizeof(uint32_t));
+    if (buckets == NULL) {
+        out->failed = true;
+        return;
+    }
+    size_t position = 0;
+    while (position < length) {
+        const char *newline = memchr(data + position, '\n', length - position);
+        size_t line_end = newline != NULL ? (size_t) (newline - data) : length;
+        TextSlice fields[JOURNAL_FIELD_COUNT];
+        int count = split_fields(data + position, line_end - position, fields);
+        if (count >= 4) {
+            size_t found = sort_unique_buckets(buckets, line_trigram_buckets(fields, count, buckets));
+            SearchDeltaTrailer trailer = {offset + position, (uint32_t) (line_end - position), (uint32_t) found,
+                                          after->st_mtim.tv_sec, after->st_mtim.tv_nsec};
+            if (found > 0) output_bytes(out, (const char *) buckets, found * sizeof(uint32_t));
+            output_bytes(out, (const char *) &trailer, sizeof(SearchDeltaTrailer));
+        }
+        position = line_end + 1;
+    }
+    free(buckets);
+}
+
+/**
+ * @brief Adds the lines just appended to the journal to the delta of the search index.
+ *
+ * Called by the writers while they still hold the journal lock. The delta is extended only when the index
+ * and its delta covered the whole journal before the append, which is checked from the index header and
+ * the last trailer of the delta. Otherwise nothing is done and the search command rebuilds the index. The
+ * records of one append are written with a single `write` to the delta opened with `O_APPEND`.
+ *
+ * @param fd The locked journal descriptor.
+ * @param before The journal before the append.
+ */
+void update_search_index(int fd, const struct stat *before) {
+    int index_fd = open(JOURNAL_SEARCH_FILE, O_RDONLY);
+    if (index_fd < 0) return;
+    SearchIndexHeader header;
+    bool ok = pread(index_fd, &header, sizeof(header), 0) == sizeof(header) &&
+              header.magic == JOURNAL_SEARCH_MAGIC && header.version == JOURNAL_SEARCH_VERSION &&
+              header.journal_inode == (uint64_t) before->st_ino;
+    close(index_fd);
+    int delta_fd = ok ? open(JOURNAL_SEARCH_DELTA_FILE, O_RDWR | O_APPEND) : -1;
+    if (delta_fd < 0) return;
+    SearchDeltaHeader delta_header;
+    SearchDeltaTrailer last = {header.journal_size, 0, 0, header.journal_mtime_sec, header.journal_mtime_nsec};
+    struct stat delta_stat;
+    ok = pread(delta_fd, &delta_header, sizeof(delta_header), 0) == sizeof(delta_header) &&
+         delta_header.magic == JOURNAL_SEARCH_DELTA_MAGIC && delta_header.version == JOURNAL_SEARCH_VERSION &&
+         delta_header.journal_size == header.journal_size &&
+         delta_header.journal_mtime_sec == header.journal_mtime_sec &&
+         delta_header.journal_mtime_nsec == header.journal_mtime_nsec && fstat(delta_fd, &delta_stat) == 0;
+    uint64_t covered = header.journal_size;
+    if (ok && (size_t) delta_stat.st_size > sizeof(SearchDeltaHeader)) {
+        ok = pread(delta_fd, &last, sizeof(last), delta_stat.st_size - sizeof(last)) == sizeof(last);
+        covered = last.line_offset + last.line_length + 1;
+    }
+    struct stat after;
+    ok = ok && covered == (uint64_t) before->st_size && last.journal_mtime_sec == before->st_mtim.tv_sec &&
+         last.journal_mtime_nsec == before->st_mtim.tv_nsec && fstat(fd, &after) == 0 &&
+         after.st_size > before->st_size;
+    char *appended = ok ? malloc(after.st_size - before->st_size) : NULL;
+    if (appended != NULL) {
+        size_t length = after.st_size - before->st_size;
+        if (pread(fd, appended, length, before->st_size) == (ssize_t) length) {
+            OutputBuffer records;
+            output_init(&records, -1);
+            output_search_delta(&records, appended, length, before->st_size, &after);
+            struct iovec part = {records.data, records.used};
+            if (!records.failed && records.used > 0 && writev(delta_fd, &part, 1) != (ssize_t) records.used) {
+                perror("Failed to update the search index");
+            }
+            output_free(&records);
+        }
+        free(appended);
+    }
+    close(delta_fd);
+}
+
+/**
+ * @brief Checks if a journal line holds an entry, i.e. has at least the 4 required fields.
+ */
+bool is_entry_line(const char *line, size_t length) {
+    const char *end = line + length;
+    for (int separators = 0; separators < 3; separators++) {
+        line = memchr(line, '|', end - line);
+        if (line == NULL) return false;
+        line++;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends to the line offset index the checkpoints of the entries in whole lines of journal text.
+ *
+ * @param offsets_fd The index, locked by the caller.
+ * @param header Its header, updated to cover the text. It is written after the checkpoints.
+ * @param data The text, it starts at `header->journal_size` and ends with a newline.
+ * @param length Length of the text.
+ * @param journal_stat The journal after the text was appended.
+ * @param tail_hash `journal_tail_hash` of the journal up to the end of the text.
+ *
+ * @return True if the index was written.
+ */
+bool extend_line_offsets(int offsets_fd, OffsetsHeader *header, const char *data, size_t length,
+                         const struct stat *journal_stat, uint32_t tail_hash) {
+    OutputBuffer checkpoints;
+    output_init(&checkpoints, -1);
+    size_t checkpoint_count = (header->entry_count + header->stride - 1) / header->stride;
+    for (size_t position = 0; position < length;) {
+        const char *newline = memchr(data + position, '\n', length - position);
+        size_t line_end = newline != NULL ? (size_t) (newline - data) : length;
+        if (is_entry_line(data + position, line_end - position)) {
+            if (header->entry_count % header->stride == 0) {
+                uint64_t offset = header->journal_size + position;
+                output_bytes(&checkpoints, (const char *) &offset, sizeof(uint64_t));
+            }
+            header->entry_count++;
+        }
+        position = line_end + 1;
+    }
+    header->journal_size += length;
+    header->journal_mtime_sec = journal_stat->st_mtim.tv_sec;
+    header->journal_mtime_nsec = journal_stat->st_mtim.tv_nsec;
+    header->tail_hash = tail_hash;
+    off_t end = (off_t) (sizeof(OffsetsHeader) + checkpoint_count * sizeof(uint64_t));
+    bool ok = !checkpoints.failed &&
+              (checkpoints.used == 0 ||
+               pwrite(offsets_fd, checkpoints.data, checkpoints.used, end) == (ssize_t) checkpoints.used) &&
+              pwrite(offsets_fd, header, sizeof(OffsetsHeader), 0) == sizeof(OffsetsHeader);
+    output_free(&checkpoints);
+    return ok;
+}
+
+/**
+ * @brief Adds the lines just appended to the journal to the line offset index, if it exists.
+ *
+ * Called by the writers while they still hold the journal lock. The index is extended only when it covered
+ * the whole journal before the append (same inode, size and modification time), otherwise `list` brings it
+ * up to date when it pages.
+ *
+ * @param fd The locked journal descriptor.
+ * @param before The journal before the append.
+ */
+void update_line_offsets(int fd, const struct stat *before) {
+    int offsets_fd = open(JOURNAL_OFFSETS_FILE, O_RDWR | O_CLOEXEC);
+    if (offsets_fd < 0) return;
+    int locked;
+    while ((locked = flock(offsets_fd, LOCK_EX)) != 0 && errno == EINTR) {}
+    OffsetsHeader header;
+    struct stat after;
+    uint32_t tail_hash;
+    bool ok = locked == 0 && pread(offsets_fd, &header, sizeof(header), 0) == sizeof(header) &&
+              header.magic == JOURNAL_OFFSETS_MAGIC && header.version == JOURNAL_OFFSETS_VERSION &&
+              header.stride > 0 && header.journal_inode == (uint64_t) before->st_ino &&
+              header.journal_size == (uint64_t) before->st_size &&
+              header.journal_mtime_sec == before->st_mtim.tv_sec &&
+              header.journal_mtime_nsec == before->st_mtim.tv_nsec && fstat(fd, &after) == 0 &&
+              after.st_size > before->st_size && journal_tail_hash(fd, NULL, after.st_size, &tail_hash);
+    size_t length = ok ? (size_t) (after.st_size - before->st_size) : 0;
+    char *appended = ok ? malloc(length) : NULL;
+    if (appended != NULL && pread(fd, appended, length, before->st_size) == (ssize_t) length &&
+        !extend_line_offsets(offsets_fd, &header, appended, length, &after, tail_hash)) {
+        perror("Failed to update the line offset index");
+    }
+    free(appended);
+    close(offsets_fd);
+}
+
+/**
+ * @brief Trims the spaces and tabs around an author name.
+ */
+TextSlice trim_author_name(TextSlice name) {
+    if (!slice_is_present(name)) return name;
+    while (name.length > 0 && (name.data[0] == ' ' || name.data[0] == '\t')) {
+        name.data++;
+        name.length--;
+    }
+    while (name.length > 0 && (name.data[name.length - 1] == ' ' || name.data[name.length - 1] == '\t')) {
+        name.length--;
+    }
+    return name;
+}
+
+/**
+ * @brief Returns the next character of a trimmed author name in its normalized form.
+ *
+ * Letters are folded to lower case and every run of spaces and tabs becomes a single space, so
+ * "J.R.R.  Tolkien" and "j.r.r. tolkien" are the same author.
+ *
+ * @return The character, or -1 at the end of the name.
+ */
+int next_author_char(const char **cursor, const char *end) {
+    if (*cursor == end) return -1;
+    unsigned char c = (unsigned char) *(*cursor)++;
+    if (c != ' ' && c != '\t') return fold_ascii(c);
+    while (*cursor < end && (**cursor == ' ' || **cursor == '\t')) (*cursor)++;
+    return ' ';
+}
+
+/**
+ * @brief Compares two author names in their normalized form, a name that is a prefix of the other sorts first.
+ *
+ * @param prefix True to compare only the length of `query`, so every name starting with it compares equal.
+ *
+ * @return A negative number, zero or a positive number if `name` sorts before, equal to or after `query`.
+ */
+int compare_author_names(TextSlice name, TextSlice query, bool prefix) {
+    name = trim_author_name(name);
+    query = trim_author_name(query);
+    const char *name_cursor = name.data;
+    const char *query_cursor = query.data;
+    for (;;) {
+        int query_char = next_author_char(&query_cursor, query.data + query.length);
+        if (query_char < 0 && prefix) return 0;
+        int name_char = next_author_char(&name_cursor, name.data + name.length);
+        if (name_char != query_char || name_char < 0) return name_char - query_char;
+    }
+}
+
+/**
+ * @brief Writes the normalized form of an author name (see `next_author_char`) into `buffer`.
+ *
+ * @param buffer Room for at least `name.length` bytes.
+ *
+ * @return The length of the normalized name.
+ */
+size_t normalize_author_name(TextSlice name, char *buffer) {
+    name = trim_author_name(name);
+    const char *cursor = name.data;
+    size_t length = 0;
+    for (int c; (c = next_author_char(&cursor, name.data + name.length)) >= 0;) buffer[length++] = (char) c;
+    return length;
+}
+
+/**
+ * @brief Hashes the normalized form of an author name like `hash_slice` does.
+ */
+uint32_t author_name_hash(TextSlice name) {
+    name = trim_author_name(name);
+    const char *cursor = name.data;
+    uint32_t hash = 2166136261u;
+    for (int c; (c = next_author_char(&cursor, name.data + name.length)) >= 0;) {
+        hash ^= (unsigned char) c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Adds the lines just appended to the journal to the delta of the author index.
+ *
+ * Called by the writers while they still hold the journal lock, like `update_search_index`. The delta is
+ * extended only when the index and its delta covered the whole journal before the append, otherwise list
+ * rebuilds the index the next time it looks up an author.
+ *
+ * @param fd The locked journal descriptor.
+ * @param before The journal before the append.
+ */
+void update_author_index(int fd, const struct stat *before) {
+    int index_fd = open(JOURNAL_AUTHOR_FILE, O_RDONLY);
+    if (index_fd < 0) return;
+    AuthorIndexHeader header;
+    bool ok = pread(index_fd, &header, sizeof(header), 0) == sizeof(header) &&
+              header.magic == JOURNAL_AUTHOR_MAGIC && header.version == JOURNAL_AUTHOR_VERSION &&
+              header.journal_inode == (uint64_t) before->st_ino;
+    close(index_fd);
+    int delta_fd = ok ? open(JOURNAL_AUTHOR_DELTA_FILE, O_RDWR | O_APPEND) : -1;
+    if (delta_fd < 0) return;
+    AuthorDeltaHeader delta_header;
+    AuthorDeltaRecord last = {header.journal_size, 0, 0, header.journal_mtime_sec, header.journal_mtime_nsec};
+    struct stat delta_stat;
+    ok = pread(delta_fd, &delta_header, sizeof(delta_header), 0) == sizeof(delta_header) &&
+         delta_header.magic == JOURNAL_AUTHOR_DELTA_MAGIC && delta_header.version == JOURNAL_AUTHOR_VERSION &&
+         delta_header.journal_size == header.journal_size &&
+         delta_header.journal_mtime_sec == header.journal_mtime_sec &&
+         delta_header.journal_mtime_nsec == header.journal_mtime_nsec && fstat(delta_fd, &delta_stat) == 0;
+    uint64_t covered = header.journal_size;
+    if (ok && (size_t) delta_stat.st_size > sizeof(AuthorDeltaHeader)) {
+        ok = pread(delta_fd, &last, sizeof(last), delta_stat.st_size - sizeof(last)) == sizeof(last);
+        covered = last.line_offset + last.line_length + 1;
+    }
+    struct stat after;
+    ok = ok && covered == (uint64_t) before->st_size && last.journal_mtime_sec == before->st_mtim.tv_sec &&
+         last.journal_mtime_nsec == before->st_mtim.tv_nsec && fstat(fd, &after) == 0 &&
+         after.st_size > before->st_size;
+    size_t length = ok ? (size_t) (after.st_size - before->st_size) : 0;
+    char *appended = ok ? malloc(length) : NULL;
+    if (appended != NULL && pread(fd, appended, length, before->st_size) == (ssize_t) length) {
+        OutputBuffer records;
+        output_init(&records, -1);
+        char last_byte = '\n';
+        if (before->st_size > 0 && pread(fd, &last_byte, 1, before->st_size - 1) != 1) last_byte = '\n';
+        // A newline written to terminate the last line of the journal is not a line of its own
+        for (size_t position = last_byte != '\n' && appended[0] == '\n' ? 1 : 0; position < length;) {
+            const char *newline = memchr(appended + position, '\n', length - position);
+            size_t line_end = newline != NULL ? (size_t) (newline - appended) : length;
+            TextSlice fields[JOURNAL_FIELD_COUNT];
+            int count = split_fields(appended + position, line_end - position, fields);
+            AuthorDeltaRecord record = {before->st_size + position, (uint32_t) (line_end - position),
+                                        count >= 4 ? author_name_hash(fields[1]) : 0, after.st_mtim.tv_sec,
+                                        after.st_mtim.tv_nsec};
+            output_bytes(&records, (const char *) &record, sizeof(AuthorDeltaRecord));
+            position = line_end + 1;
+        }
+        struct iovec part = {records.data, records.used};
+        if (!records.failed && records.used > 0 && writev(delta_fd, &part, 1) != (ssize_t) records.used) {
+            perror("Failed to update the author index");
+        }
+        output_free(&records);
+    }
+    free(appended);
+    close(delta_fd);
+}
+
+/**
+ * @brief Brings the files derived from the journal up to date after an append, while the journal is locked.
+ *
+ * The stats state file is not among them: rewriting its groups on every append would hold the lock for as
+ * long as it takes to write all authors, so `stats` adds the appended lines when it runs.
+ *
+ * @param fd The locked journal descriptor.
+ * @param before The journal before the append.
+ */
+void journal_appended(int fd, const struct stat *before) {
+    update_search_index(fd, before);
+    update_author_index(fd, before);
+    update_line_offsets(fd, before);
+}
+
+/**
+ * @brief Opens the journal for appending and takes the exclusive writer lock (`flock`).
+ *
+ * All writers (`new`, `import`) hold the lock while they append, so records of concurrent processes never
+ * interleave. The lock belongs to the open file, so after locking the function checks that the path
+ * still names the same file, in case the journal was replaced while it waited, and retries if not.
+ *
+ * @return The locked descriptor, opened with `O_APPEND`, or -1 on error (which is reported). The lock is
+ *         released by closing the descriptor.
+ */
+int open_locked_journal() {
+    for (;;) {
+        int fd = open(JOURNAL_FILE, O_RDWR | O_APPEND | O_CREAT, 0644);
+        if (fd < 0) {
+            perror("Failed to open file for writing\n");
+            return -1;
+        }
+        int locked;
+        while ((locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+        if (locked != 0) {
+            perror("Failed to lock the journal");
+            close(fd);
+            return -1;
+        }
+        struct stat opened;
+        struct stat current;
+        if (fstat(fd, &opened) == 0 && stat(JOURNAL_FILE, &current) == 0 && opened.st_ino == current.st_ino &&
+            opened.st_dev == current.st_dev) {
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+/**
+ * @brief Makes the journal durable at least up to `end` and shares the `fdatasync` with concurrent writers.
+ *
+ * The state file `JOURNAL_SYNC_FILE` records how much of the journal (identified by its inode) is already
+ * synced. Writers take its lock one after another: the first one syncs everything appended so far, and
+ * writers whose records were covered by that sync return without syncing again. Under many concurrent
+ * writers a single sync thus commits a whole group of records.
+ *
+ * @param fd The journal descriptor, already unlocked so other writers can append meanwhile.
+ * @param end Offset just after the record of this writer.
+ *
+ * @return True if the record is durable.
+ */
+bool group_commit_journal(int fd, off_t end) {
+    int state = open(JOURNAL_SYNC_FILE, O_RDWR | O_CREAT, 0644);
+    if (state < 0) return fdatasync(fd) == 0;
+    int locked;
+    while ((locked = flock(state, LOCK_EX)) != 0 && errno == EINTR) {}
+    struct stat journal_stat;
+    bool ok = locked == 0 && fstat(fd, &journal_stat) == 0;
+    uint64_t synced[2] = {0, 0};
+    if (ok && (pread(state, synced, sizeof(synced), 0) != sizeof(synced) || synced[0] != journal_stat.st_ino ||
+               synced[1] < (uint64_t) end)) {
+        ok = fdatasync(fd) == 0;
+        synced[0] = journal_stat.st_ino;
+        synced[1] = journal_stat.st_size;
+        if (ok && pwrite(state, synced, sizeof(synced), 0) != sizeof(synced)) ok = false;
+    }
+    close(state);
+    return ok;
+}
+
+/**
+ * @brief Appends complete journal lines to the journal with a single write.
+ *
+ * The journal is opened with `O_APPEND` and locked by `open_locked_journal`. If its last line is not
+ * terminated, the missing newline is written by the same `writev` call as the data.
+ *
+ * @param data The lines to append, each ending with a newline.
+ * @param length Length of the data in bytes.
+ * @param sync `SYNC_NONE` to leave the data to the page cache, `SYNC_EACH` to `fdatasync` before the lock is
+ *             released, `SYNC_GROUP` to share the sync with concurrent writers (`group_commit_journal`).
+ *
+ * The derived files are updated by `journal_appended` before the lock is released.
+ *
+ * @return True on success. Errors are reported.
+ */
+bool append_journal(const char *data, size_t length, SyncMode sync) {
+    ProfilePhase previous = profile_enter(PROFILE_READ);
+    int fd = open_locked_journal();
+    if (fd < 0) {
+        profile_enter(previous);
+        return false;
+    }
+    struct stat journal_stat;
+    bool known = fstat(fd, &journal_stat) == 0;
+    char last = '\n';
+    if (known && journal_stat.st_size > 0) {
+        if (pread(fd, &last, 1, journal_stat.st_size - 1) != 1) last = '\n';
+    }
+    struct iovec parts[2] = {{"\n", last != '\n'}, {(char *) data, length}};
+    OutputBuffer out;
+    output_init(&out, fd);
+    bool ok = output_writev(&out, parts, 2);
+    off_t end = lseek(fd, 0, SEEK_CUR);
+    profile_enter(PROFILE_OTHER);
+    if (ok && known) journal_appended(fd, &journal_stat);
+    profile_enter(PROFILE_WRITE);
+    if (ok && sync == SYNC_EACH && fdatasync(fd) != 0) {
+        perror("Failed to sync the journal");
+        ok = false;
+    }
+    flock(fd, LOCK_UN);
+    if (ok && sync == SYNC_GROUP && !group_commit_journal(fd, end)) {
+        perror("Failed to sync the journal");
+        ok = false;
+    }
+    close(fd);
+    profile_enter(previous);
+    return ok;
+}
+
+/**
+ * @brief Appends a journal entry to the journal file.
+ *
+ * The entry is serialized as one line (`output_journal_line`) with fields separated by the '|' character:
+ * book name, author, genre, start date, end date (optional), score (optional) and note (optional). An
+ * optional field that is not provided is represented as an empty value between delimiters. The whole line
+ * is appended by a single locked write (`append_journal`), so concurrent writers cannot tear it. The search
+ * index and the other files derived from the journal are updated with the entry under the same lock.
+ *
+ * @param entry A pointer to a JournalEntry structure containing information about the journal entry
+ *              to be written. If the pointer is null, the function does nothing.
+ * @param sync How the appended line is made durable, see `append_journal`.
+ *
+ * @return True on success.
+ */
+bool write_entry(const JournalEntry *entry, SyncMode sync) {
+    if (entry == NULL) return false;
+    OutputBuffer line;
+    output_init(&line, -1);
+    ProfilePhase previous = profile_enter(PROFILE_FORMAT);
+    output_journal_line(&line, entry);
+    profile_enter(previous);
+    bool ok = !line.failed && append_journal(line.data, line.used, sync);
+    output_free(&line);
+    return ok;
+}
+
+/**
+ * @brief Handles the creation of a new journal entry based on command-line arguments.
+ *
+ * This function parses command-line arguments starting from the third argument (index 2) to extract
+ * details necessary for creating a new journal entry, such as the book name, author, genre, start date,
+ * end date, score, and an optional note. The entry and the option values are allocated from an arena
+ * that lives for the duration of the command.
+ *
+ * The following options are supported:
+ * - `--name`: Specifies the book name. This option is required.
+ * - `--author`: Specifies the author's name. This option is required.
+ * - `--genre`: Specifies the book's genre. This option is required.
+ * - `--start`: Specifies the start date in a valid date format. This option is required.
+ * - `--end`: (Optional) Specifies the end date in a valid date format.
+ * - `--score`: (Optional) Specifies a numeric score for the entry.
+ * - `--note`: (Optional) Specifies an additional note or description.
+ * - `--sync`: (Optional) Syncs the journal to the disk before the command ends.
+ * - `--group-commit`: (Optional) Like `--sync`, but shares the sync with concurrently running writers.
+ *
+ * If any required arguments are missing, or the entry breaks a rule of `entry_validation_error` (such as a
+ * score outside 1-5), an error message is displayed, and the function ends without creating an entry.
+ *
+ * @param argc The total number of command-line arguments provided to the program.
+ * @param argv An array of null-terminated strings representing the command-line arguments.
+ *
+ * - If `argc` is less than 6, the function immediately displays an error message and prints usage
+ *   instructions using `print_help`.
+ * - For each argument matching one of the supported options, the associated value is extracted using
+ *   helper functions like `get_option_value`. For dates, `get_date` is used to process the input.
+ * - If memory allocation for the journal entry fails, an error is logged using `perror`, and the function
+ *   terminates.
+ * - After parsing, the function validates the presence of all required options. Missing required options
+ *   result in relevant error messages.
+ * - If all required options are valid, the new entry is added by invoking `print_entry` to display it and
+ *   `write_entry` to persist it.
+ * - The option values and the journal entry are released at once by freeing the arena.
+ */
+void new_cmd(int argc, char *argv[]) {
+    if (argc < 6) {
+        printf("Not enough arguments for new command\n");
+        print_help();
+        return;
+    }
+    Arena arena;
+    arena_init(&arena);
+    JournalEntry *entry = arena_alloc(&arena, sizeof(JournalEntry));
+    if (entry == NULL) {
+        perror("Failed to allocate memory for journal entry");
+        return;
+    }
+    reset_entry(entry);
+    SyncMode sync = SYNC_NONE;
+    bool score_valid = true;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0) {
+            entry->book_name = slice_from_string(get_option_value(&arena, argc, argv, i));
+        } else if (strcmp(argv[i], "--author") == 0) {
+            entry->author = slice_from_string(get_option_value(&arena, argc, argv, i));
+        } else if (strcmp(argv[i], "--genre") == 0) {
+            entry->genre = slice_from_string(get_option_value(&arena, argc, argv, i));
+        } else if (strcmp(argv[i], "--start") == 0) {
+            entry->start_date = slice_from_string(get_date(get_option_value(&arena, argc, argv, i)));
+        } else if (strcmp(argv[i], "--end") == 0) {
+            entry->end_date = slice_from_string(get_date(get_option_value(&arena, argc, argv, i)));
+        } else if (strcmp(argv[i], "--score") == 0) {
+            char *score_value = get_option_value(&arena, argc, argv, i);
+            if (score_value != NULL && !get_score(score_value, &entry->score)) score_valid = false;
+        } else if (strcmp(argv[i], "--note") == 0) {
+            entry->note = slice_from_string(get_option_value(&arena, argc, argv, i));
+        } else if (strcmp(argv[i], "--sync") == 0) {
+            sync = SYNC_EACH;
+        } else if (strcmp(argv[i], "--group-commit") == 0) {
+            sync = SYNC_GROUP;
+        }
+    }
+
+    bool valid = score_valid;
+    if (!slice_is_present(entry->book_name)) {
+        printf("Error: Book name is required, with option --name\n");
+        valid = false;
+    }
+    if (!slice_is_present(entry->author)) {
+        printf("Error: Author is required, with option --author\n");
+        valid = false;
+    }
+    if (!slice_is_present(entry->genre)) {
+        printf("Error: Genre is required, with option --genre\n");
+        valid = false;
+    }
+    if (!slice_is_present(entry->start_date)) {
+        printf("Error: Start date is required, with option --start\n");
+        valid = false;
+    }
+    if (valid) {
+        const char *error = entry_validation_error(entry);
+        if (error != NULL) {
+            printf("Error: %s\n", error);
+            valid = false;
+        }
+    }
+
+    if (valid) {
+        printf("New entry added:\n");
+        fflush(stdout);
+        OutputBuffer out;
+        output_init(&out, STDOUT_FILENO);
+        ProfilePhase previous = profile_enter(PROFILE_FORMAT);
+        print_entry(&out, entry);
+        profile_enter(previous);
+        output_free(&out);
+        write_entry(entry, sync);
+    }
+    print_arena_stats(&arena, "new");
+    profile_arena(&arena);
+    arena_free(&arena);
+}
+
+/**
+ * @brief Stores one token of a journal line into the matching field of the entry.
+ *
+ * The fields of a journal line are expected in the order book_name, author, genre, start_date,
+ * end_date, score, note. Empty optional fields (end date, score and note) are left absent, tokens past
+ * the note are ignored.
+ *
+ * @param entry The entry being populated. Must not be NULL.
+ * @param field Zero-based position of the token within the line.
+ * @param token The token itself, as a view into the line.
+ */
+void set_entry_field(JournalEntry *entry, int field, TextSlice token) {
+    switch (field) {
+        case 0: entry->book_name = token;
+            break;
+        case 1: entry->author = token;
+            break;
+        case 2: entry->genre = token;
+            break;
+        case 3: entry->start_date = token;
+            break;
+        case 4:
+            if (token.length == 0) break;
+            entry->end_date = token;
+            break;
+        case 5:
+            if (token.length == 0) break;
+            entry->score = parse_score(token);
+            break;
+        case 6:
+            if (token.length == 0) break;
+            entry->note = token;
+            break;
+        default: break;
+    }
+}
+
+/**
+ * @brief Checks that all required fields (book_name, author, genre, start_date) were present on the line.
+ */
+bool has_required_fields(const JournalEntry *entry) {
+    return slice_is_present(entry->book_name) && slice_is_present(entry->author) &&
+           slice_is_present(entry->genre) && slice_is_present(entry->start_date);
+}
+
+/**
+ * @brief Reports a journal line that could not be loaded.
+ *
+ * @param out The buffer the listing goes to, so the report keeps its place in the output. With a machine
+ *            format of `list_format` the report goes to stderr instead.
+ * @param line The line as it appears in the journal, without the trailing newline.
+ * @param length Length of the line in bytes.
+ */
+void report_invalid_line(OutputBuffer *out, const char *line, size_t length) {
+    thread_profile.rejected_lines++;
+    // Records of the machine formats are read by other programs, the report goes to stderr in one write
+    OutputBuffer errors;
+    output_init(&errors, STDERR_FILENO);
+    OutputBuffer *report = list_format == LIST_FORMAT_TEXT ? out : &errors;
+    output_string(report, "Failed to load journal entry from line: ");
+    output_bytes(report, line, length);
+    output_string(report, "\n");
+    output_free(&errors);
+}
+
+/**
+ * @brief Fills an entry from the fields of a split line.
+ *
+ * @param entry The entry to populate. All fields are reset first.
+ * @param fields The fields of the line, in the order of the journal format.
+ * @param count The number of fields.
+ *
+ * @return True if the line contains all required fields, otherwise false.
+ */
+bool entry_from_fields(JournalEntry *entry, const TextSlice *fields, int count) {
+    reset_entry(entry);
+    for (int field = 0; field < count; field++) {
+        set_entry_field(entry, field, fields[field]);
+    }
+    return has_required_fields(entry);
+}
+
+/**
+ * @brief Packs the dates of an entry into day numbers, if the filter compares them.
+ *
+ * Done only for such filters, as it would slow down parsing entries that are just printed.
+ *
+ * @param entry The entry, with its date fields already set.
+ * @param needs The fields the filter needs, see `JournalFilter`.
+ */
+void pack_entry_days(JournalEntry *entry, unsigned int needs) {
+    if ((needs & FILTER_NEEDS_START_DAY) != 0) entry->start_day = date_to_day_number(entry->start_date);
+    if ((needs & FILTER_NEEDS_END_DAY) != 0) entry->end_day = date_to_day_number(entry->end_date);
+}
+
+/**
+ * @brief Fills only the fields of an entry which a filter looks at.
+ *
+ * Used to filter entries before they are parsed completely, an entry that matches is then completed with
+ * `entry_from_fields`. The line must have all required fields.
+ *
+ * @param entry The entry to populate. All fields are reset first.
+ * @param fields The fields of the line.
+ * @param count The number of fields.
+ * @param needs The fields the filter needs, see `JournalFilter`.
+ */
+void entry_from_filter_fields(JournalEntry *entry, const TextSlice *fields, int count, unsigned int needs) {
+    reset_entry(entry);
+    if ((needs & FILTER_NEEDS_AUTHOR) != 0) entry->author = fields[1];
+    if ((needs & FILTER_NEEDS_GENRE) != 0) entry->genre = fields[2];
+    if ((needs & FILTER_NEEDS_START_DAY) != 0) entry->start_date = fields[3];
+    if ((needs & FILTER_NEEDS_END_DATE) != 0 && count > 4) set_entry_field(entry, 4, fields[4]);
+    if ((needs & FILTER_NEEDS_SCORE) != 0 && count > 5) set_entry_field(entry, 5, fields[5]);
+    pack_entry_days(entry, needs);
+}
+
+/**
+ * @brief Parses a delimited line of text into a JournalEntry view without copying it.
+ *
+ * This is the zero-copy counterpart of `load_entry`. The line is not modified and does not have to be
+ * null-terminated, which allows parsing straight from a memory-mapped journal. All text fields of the
+ * entry become slices pointing into `line`, so the entry is only valid as long as the line is.
+ *
+ * @param line Start of the line. The line must not contain the trailing newline.
+ * @param length Length of the line in bytes.
+ * @param entry The entry to populate. All fields are reset before parsing.
+ *
+ * @return True if the line contains all required fields, otherwise false.
+ */
+bool parse_entry(const char *line, size_t length, JournalEntry *entry) {
+    TextSlice fields[JOURNAL_FIELD_COUNT];
+    int count = split_fields(line, length, fields);
+    return entry_from_fields(entry, fields, count);
+}
+
+/**
+ * @brief Finds the delimiters of a buffer one byte at a time. Used when no vector extension is available.
+ */
+size_t scan_delimiters_scalar(const char *data, size_t length, uint32_t *positions) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; i++) {
+        // Always store the offset, it is kept only if the byte is a delimiter
+        positions[count] = (uint32_t) i;
+        count += data[i] == '|' || data[i] == '\n';
+    }
+    return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Appends the offsets of the bits set in `mask`, a comparison mask of the bytes starting at `base`.
+ */
+size_t append_mask_positions(uint32_t mask, size_t base, uint32_t *positions, size_t count) {
+    while (mask != 0) {
+        positions[count++] = (uint32_t) (base + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+/**
+ * @brief Finds the delimiters of a buffer 16 bytes at a time with SSE2.
+ */
+__attribute__((target("sse2")))
+size_t scan_delimiters_sse2(const char *data, size_t length, uint32_t *positions) {
+    const __m128i pipe = _mm_set1_epi8('|');
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, pipe), _mm_cmpeq_epi8(bytes, newline));
+        count = append_mask_positions((uint32_t) _mm_movemask_epi8(matches), i, positions, count);
+    }
+    for (; i < length; i++) {
+        if (data[i] == '|' || data[i] == '\n') positions[count++] = (uint32_t) i;
+    }
+    return count;
+}
+
+/**
+ * @brief Finds the delimiters of a buffer 32 bytes at a time with AVX2.
+ */
+__attribute__((target("avx2")))
+size_t scan_delimiters_avx2(const char *data, size_t length, uint32_t *positions) {
+    const __m256i pipe = _mm256_set1_epi8('|');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, pipe), _mm256_cmpeq_epi8(bytes, newline));
+        count = append_mask_positions((uint32_t) _mm256_movemask_epi8(matches), i, positions, count);
+    }
+    for (; i < length; i++) {
+        if (data[i] == '|' || data[i] == '\n') positions[count++] = (uint32_t) i;
+    }
+    return count;
+}
+#endif
+
+/**
+ * @brief Picks the fastest delimiter scanner the CPU supports.
+ *
+ * @return `scan_delimiters_avx2` or `scan_delimiters_sse2` on x86 CPUs that support them, otherwise
+ *         `scan_delimiters_scalar`.
+ */
+DelimiterScanner select_delimiter_scanner() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scan_delimiters_avx2;
+    if (__builtin_cpu_supports("sse2")) return scan_delimiters_sse2;
+#endif
+    return scan_delimiters_scalar;
+}
+
+/**
+ * @brief Prepares a tokenizer for a range of whole lines.
+ *
+ * @param tokenizer The tokenizer to initialize.
+ * @param begin Start of the first line.
+ * @param end End of the range. The last line may end without a newline.
+ * @param scan The delimiter scanner to use, usually from `select_delimiter_scanner`.
+ */
+void init_line_tokenizer(LineTokenizer *tokenizer, const char *begin, const char *end, DelimiterScanner scan) {
+    tokenizer->scan = scan;
+    tokenizer->window = begin;
+    tokenizer->end = end;
+    tokenizer->window_length = 0;
+    tokenizer->line_start = 0;
+    tokenizer->count = 0;
+    tokenizer->next = 0;
+}
+
+/**
+ * @brief Returns the next line of a tokenizer split into its fields, the same way as `split_fields` would.
+ *
+ * A line longer than a whole scanner window is split with `split_fields` instead.
+ *
+ * @return True if a line was returned, false at the end of the range.
+ */
+bool next_tokenized_line(LineTokenizer *tokenizer, TokenizedLine *line) {
+    for (;;) {
+        const char *window = tokenizer->window;
+        size_t field_start = tokenizer->line_start;
+        int count = 0;
+        while (tokenizer->next < tokenizer->count) {
+            size_t position = tokenizer->positions[tokenizer->next++];
+            if (count < JOURNAL_FIELD_COUNT) {
+                line->fields[count].data = window + field_start;
+                line->fields[count].length = position - field_start;
+                count++;
+            }
+            field_start = position + 1;
+            if (window[position] == '\n') {
+                line->data = window + tokenizer->line_start;
+                line->length = position - tokenizer->line_start;
+                line->field_count = count;
+                tokenizer->line_start = position + 1;
+                return true;
+            }
+        }
+        bool last_window = window + tokenizer->window_length == tokenizer->end;
+        if (last_window) {
+            if (tokenizer->line_start == tokenizer->window_length) return false;
+            // The last line does not end with a newline
+            if (count < JOURNAL_FIELD_COUNT) {
+                line->fields[count].data = window + field_start;
+                line->fields[count].length = tokenizer->window_length - field_start;
+                count++;
+            }
+            line->data = window + tokenizer->line_start;
+            line->length = tokenizer->window_length - tokenizer->line_start;
+            line->field_count = count;
+            tokenizer->line_start = tokenizer->window_length;
+            return true;
+        }
+        if (tokenizer->line_start == 0 && tokenizer->window_length > 0) {
+            // Not even one line fits into the window
+            const char *newline = memchr(window, '\n', tokenizer->end - window);
+            const char *line_end = newline != NULL ? newline : tokenizer->end;
+            line->data = window;
+            line->length = line_end - window;
+            line->field_count = split_fields(line->data, line->length, line->fields);
+            tokenizer->window = newline != NULL ? newline + 1 : tokenizer->end;
+            tokenizer->window_length = 0;
+            tokenizer->count = 0;
+            tokenizer->next = 0;
+            return true;
+        }
+        tokenizer->window = window + tokenizer->line_start;
+        size_t remaining = tokenizer->end - tokenizer->window;
+        tokenizer->window_length = remaining < SCAN_WINDOW_SIZE ? remaining : SCAN_WINDOW_SIZE;
+        tokenizer->line_start = 0;
+        tokenizer->count = tokenizer->scan(tokenizer->window, tokenizer->window_length, tokenizer->positions);
+        tokenizer->next = 0;
+    }
+}
+
+/**
+ * @brief Parses a delimited line of text and constructs a JournalEntry instance.
+ *
+ * This function reads a line of text that contains fields separated by the '|' delimiter
+ * and attempts to populate a dynamically allocated JournalEntry structure. The fields
+ * in the input line are expected to follow the order:
+ * book_name, author, genre, start_date, end_date, score, note. If any of the required
+ * fields (book_name, author, genre, start_date) are missing or invalid, the function fails
+ * and returns a NULL.
+ *
+ * This is the stream (fallback) loader used when the journal cannot be memory-mapped. The line is split
+ * by `parse_entry` and the fields of the returned entry are slices into it, so the line must outlive the
+ * entry.
+ *
+ * @param arena The arena the entry is allocated from.
+ * @param line The line of data, without the trailing newline. The line should use the '|' character to
+ *             separate fields.
+ * @param length Length of the line in bytes.
+ * @param out The buffer an invalid line is reported to.
+ *
+ * @return A pointer to an arena allocated JournalEntry instance on success, or NULL
+ *         if allocation fails or the line does not contain the required fields. The entry
+ *         is released by resetting or freeing the arena.
+ *
+ * - Each field is assigned by `set_entry_field` based on its position in the line.
+ * - If the line is rejected, it is reported with `report_invalid_line` and NULL is returned.
+ */
+JournalEntry *load_entry(Arena *arena, const char *line, size_t length, OutputBuffer *out) {
+    JournalEntry *entry = arena_alloc(arena, sizeof(JournalEntry));
+    if (entry == NULL) {
+        perror("Failed to allocate memory for journal entry");
+        return NULL;
+    }
+    if (!parse_entry(line, length, entry)) {
+        report_invalid_line(out, line, length);
+        return NULL;
+    }
+    return entry;
+}
+
+/**
+ * @brief Parses a pipe-delimited import line, in the same format as the journal itself.
+ *
+ * Unlike `parse_entry`, which tolerates damaged journal lines, an import line must have at least the four
+ * required fields, at most seven fields and an empty score or a score from 1 to 5.
+ *
+ * @return NULL on success, otherwise a description of the problem.
+ */
+const char *parse_import_line(const char *line, size_t length, JournalEntry *entry) {
+    TextSlice fields[JOURNAL_FIELD_COUNT];
+    int count = split_fields(line, length, fields);
+    if (count < 4) return "expected at least 4 fields separated by '|'";
+    TextSlice last = fields[count - 1];
+    if (count == JOURNAL_FIELD_COUNT && last.data + last.length != line + length) return "too many fields";
+    if (count > 5 && fields[5].length > 0 &&
+        (fields[5].length != 1 || fields[5].data[0] < '1' || fields[5].data[0] > '5')) {
+        return "score must be from 1 to 5";
+    }
+    entry_from_fields(entry, fields, count);
+    return NULL;
+}
+
+/**
+ * @brief Skips JSON whitespace.
+ */
+const char *json_skip_space(const char *cursor, const char *end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')) cursor++;
+    return cursor;
+}
+
+/**
+ * @brief Reads the four hex digits of a `\u` escape.
+ *
+ * @return The code unit, or -1 if the digits are invalid.
+ */
+long json_parse_hex4(const char *cursor, const char *end) {
+    if (end - cursor < 4) return -1;
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = cursor[i];
+        int digit = isdigit((unsigned char) c) ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                                                         : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        if (digit < 0) return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+/**
+ * @brief Appends a code point encoded as UTF-8.
+ *
+ * @return The position after the encoded bytes.
+ */
+char *utf8_encode(char *out, unsigned long code_point) {
+    if (code_point < 0x80) {
+        *out++ = (char) code_point;
+    } else if (code_point < 0x800) {
+        *out++ = (char) (0xc0 | (code_point >> 6));
+        *out++ = (char) (0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+        *out++ = (char) (0xe0 | (code_point >> 12));
+        *out++ = (char) (0x80 | ((code_point >> 6) & 0x3f));
+        *out++ = (char) (0x80 | (code_point & 0x3f));
+    } else {
+        *out++ = (char) (0xf0 | (code_point >> 18));
+        *out++ = (char) (0x80 | ((code_point >> 12) & 0x3f));
+        *out++ = (char) (0x80 | ((code_point >> 6) & 0x3f));
+        *out++ = (char) (0x80 | (code_point & 0x3f));
+    }
+    return out;
+}
+
+/**
+ * @brief Parses a JSON string starting at its opening quote.
+ *
+ * A string without escapes is returned as a slice of the input. A string with escapes is decoded into the
+ * arena, the decoded text is never longer than the escaped one.
+ *
+ * @return The position after the closing quote, or NULL if the string is malformed.
+ */
+const char *json_parse_string(Arena *arena, const char *cursor, const char *end, TextSlice *value) {
+    const char *start = ++cursor;
+    bool escaped = false;
+    while (cursor < end && *cursor != '"') {
+        if ((unsigned char) *cursor < 0x20) return NULL;
+        if (*cursor == '\\') {
+            escaped = true;
+            cursor++;
+        }
+        cursor++;
+    }
+    if (cursor >= end) return NULL;
+    const char *close = cursor;
+    if (!escaped) {
+        value->data = start;
+        value->length = close - start;
+        return close + 1;
+    }
+    char *decoded = arena_alloc(arena, close - start);
+    if (decoded == NULL) return NULL;
+    char *out = decoded;
+    for (const char *c = start; c < close; c++) {
+        if (*c != '\\') {
+            *out++ = *c;
+            continue;
+        }
+        c++;
+        switch (*c) {
+            case '"': *out++ = '"';
+                break;
+            case '\\': *out++ = '\\';
+                break;
+            case '/': *out++ = '/';
+                break;
+            case 'b': *out++ = '\b';
+                break;
+            case 'f': *out++ = '\f';
+                break;
+            case 'n': *out++ = '\n';
+                break;
+            case 'r': *out++ = '\r';
+                break;
+            case 't': *out++ = '\t';
+                break;
+            case 'u': {
+                long unit = json_parse_hex4(c + 1, close);
+                if (unit < 0 || (unit >= 0xdc00 && unit <= 0xdfff)) return NULL;
+                c += 4;
+                unsigned long code_point = (unsigned long) unit;
+                if (unit >= 0xd800 && unit <= 0xdbff) {
+                    // A high surrogate must be followed by an escaped low surrogate
+                    if (close - c < 7 || c[1] != '\\' || c[2] != 'u') return NULL;
+                    long low = json_parse_hex4(c + 3, close);
+                    if (low < 0xdc00 || low > 0xdfff) return NULL;
+                    code_point = 0x10000 + (((unsigned long) unit - 0xd800) << 10) + ((unsigned long) low - 0xdc00);
+                    c += 6;
+                }
+                out = utf8_encode(out, code_point);
+                break;
+            }
+            default: return NULL;
+        }
+    }
+    value->data = decoded;
+    value->length = out - decoded;
+    return close + 1;
+}
+
+/**
+ * @brief Skips a JSON number or one of the literals `true`, `false` and `null`.
+ *
+ * @return The position after the value, or NULL if there is no such value.
+ */
+const char *json_skip_scalar(const char *cursor, const char *end) {
+    const char *literals[] = {"true", "false", "null"};
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        size_t length = strlen(literals[i]);
+        if ((size_t) (end - cursor) >= length && memcmp(cursor, literals[i], length) == 0) return cursor + length;
+    }
+    const char *start = cursor;
+    while (cursor < end && (isdigit((unsigned char) *cursor) || strchr("+-.eE", *cursor) != NULL)) cursor++;
+    return cursor > start ? cursor : NULL;
+}
+
+/**
+ * @brief Returns the text field of an entry named by a JSON key, or NULL for other keys.
+ */
+TextSlice *json_entry_field(JournalEntry *entry, TextSlice key) {
+    if (slice_equals_string(key, "name") || slice_equals_string(key, "book_name")) return &entry->book_name;
+    if (slice_equals_string(key, "author")) return &entry->author;
+    if (slice_equals_string(key, "genre")) return &entry->genre;
+    if (slice_equals_string(key, "start") || slice_equals_string(key, "start_date")) return &entry->start_date;
+    if (slice_equals_string(key, "end") || slice_equals_string(key, "end_date")) return &entry->end_date;
+    if (slice_equals_string(key, "note")) return &entry->note;
+    return NULL;
+}
+
+/**
+ * @brief Parses the value of the JSON "score" key, which is an integer from 1 to 5 or `null`.
+ *
+ * @return The position after the value, or NULL if the value is not a valid score.
+ */
+const char *json_parse_score(const char *cursor, const char *end, JournalEntry *entry) {
+    if ((size_t) (end - cursor) >= 4 && memcmp(cursor, "null", 4) == 0) return cursor + 4;
+    if (cursor >= end || *cursor < '1' || *cursor > '5') return NULL;
+    if (cursor + 1 < end && (isdigit((unsigned char) cursor[1]) || strchr(".eE", cursor[1]) != NULL)) return NULL;
+    entry->score = (unsigned int) (*cursor - '0');
+    return cursor + 1;
+}
+
+/**
+ * @brief Parses one JSON lines import record, a flat object such as
+ *        `{"name": "Hobbit", "author": "J.R.R. Tolkien", "genre": "fantasy", "start": "2022-01-01", "score": 4}`.
+ *
+ * Text fields are strings (`null` or an empty string leaves an optional field out), the score is an integer.
+ * Unknown keys with scalar values are ignored, nested objects and arrays are rejected.
+ *
+ * @param arena The arena for strings that contain escapes. Other strings point into `line`.
+ *
+ * @return NULL on success, otherwise a description of the problem.
+ */
+const char *parse_json_entry(Arena *arena, const char *line, size_t length, JournalEntry *entry) {
+    const char *end = line + length;
+    const char *cursor = json_skip_space(line, end);
+    reset_entry(entry);
+    if (cursor >= end || *cursor != '{') return "expected a JSON object";
+    cursor = json_skip_space(cursor + 1, end);
+    bool first = true;
+    while (cursor < end && *cursor != '}') {
+        if (!first) {
+            if (*cursor != ',') return "malformed JSON object";
+            cursor = json_skip_space(cursor + 1, end);
+        }
+        first = false;
+        TextSlice key;
+        if (cursor >= end || *cursor != '"' || (cursor = json_parse_string(arena, cursor, end, &key)) == NULL) {
+            return "malformed JSON key";
+        }
+        cursor = json_skip_space(cursor, end);
+        if (cursor >= end || *cursor != ':') return "malformed JSON object";
+        cursor = json_skip_space(cursor + 1, end);
+        TextSlice *field = json_entry_field(entry, key);
+        if (slice_equals_string(key, "score")) {
+            cursor = json_parse_score(cursor, end, entry);
+            if (cursor == NULL) return "score must be an integer from 1 to 5";
+        } else if (cursor < end && *cursor == '"') {
+            TextSlice value;
+            cursor = json_parse_string(arena, cursor, end, &value);
+            if (cursor == NULL) return "malformed JSON string";
+            if (field != NULL) *field = value;
+        } else if (cursor < end && (*cursor == '{' || *cursor == '[')) {
+            return "nested JSON values are not supported";
+        } else {
+            const char *value_start = cursor;
+            cursor = json_skip_scalar(cursor, end);
+            if (cursor == NULL) return "malformed JSON value";
+            if (field != NULL && !(cursor - value_start == 4 && memcmp(value_start, "null", 4) == 0)) {
+                return "text fields must be JSON strings";
+            }
+        }
+        cursor = json_skip_space(cursor, end);
+    }
+    if (cursor >= end) return "malformed JSON object";
+    if (json_skip_space(cursor + 1, end) != end) return "unexpected text after the JSON object";
+    if (slice_is_present(entry->end_date) && entry->end_date.length == 0) entry->end_date = slice_from_string(NULL);
+    if (slice_is_present(entry->note) && entry->note.length == 0) entry->note = slice_from_string(NULL);
+    return NULL;
+}
+
+/**
+ * @brief Appends a newline to the journal if its last line is not terminated, so appended lines start on
+ *        their own line.
+ */
+void terminate_journal_line(OutputBuffer *journal, off_t size) {
+    char last;
+    if (size > 0 && pread(journal->fd, &last, 1, size - 1) == 1 && last != '\n') output_bytes(journal, "\n", 1);
+}
+
+/**
+ * @brief Handles the "import" command, which appends many entries to the journal in one run.
+ *
+ * Entries are read line by line from standard input or from a file, either in the pipe-delimited journal
+ * format or as JSON lines (`parse_json_entry`). Each entry is checked by `entry_validation_error`, the same
+ * rules `new` applies. Rejected lines are reported with their line number and do not stop the import.
+ *
+ * Accepted entries are first written to a temporary file, so the journal is not locked while the input is
+ * read, however slowly it arrives. Only then is the journal locked by `open_locked_journal` and the
+ * temporary file appended in one large write, so other writers wait only for that copy. The space for it is
+ * reserved before anything is written (`fallocate` without changing the size, where the file system
+ * supports it), so running out of space rejects the import before it touches the journal. If the append
+ * fails anyway, the journal is truncated back to its size before the import and no partial batch stays
+ * behind. The imported lines are added to the search index and the other derived files
+ * (`journal_appended`) before the lock is released.
+ *
+ * Options:
+ * - `--file <path>`: read entries from the file instead of standard input (`-` is standard input).
+ * - `--format pipe|jsonl`: the input format, `pipe` by default.
+ * - `--fsync`: flush the journal to the disk with `fsync` once all entries are written.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ */
+void import_cmd(int argc, char *argv[]) {
+    const char *path = NULL;
+    bool jsonl = false;
+    bool sync = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "jsonl") == 0) {
+                jsonl = true;
+            } else if (strcmp(argv[i], "pipe") != 0) {
+                printf("Unknown import format: %s\n", argv[i]);
+                return;
+            }
+        } else if (strcmp(argv[i], "--fsync") == 0) {
+            sync = true;
+        } else {
+            printf("Unknown import option: %s\n", argv[i]);
+            print_help();
+            return;
+        }
+    }
+    FILE *input = stdin;
+    if (path != NULL && strcmp(path, "-") != 0) {
+        input = fopen(path, "r");
+        if (input == NULL) {
+            perror("Failed to open import file");
+            return;
+        }
+    }
+    FILE *spool = tmpfile();
+    if (spool == NULL) {
+        perror("Failed to create a temporary file for the import");
+        if (input != stdin) fclose(input);
+        return;
+    }
+    OutputBuffer lines;
+    output_init(&lines, fileno(spool));
+
+    Arena arena;
+    arena_init(&arena);
+    size_t line_number = 0;
+    size_t imported = 0;
+    size_t rejected = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t read;
+    while ((read = getline(&line, &capacity, input)) != -1) {
+        line_number++;
+        size_t length = (size_t) read;
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) length--;
+        if (length == 0) continue;
+        JournalEntry entry;
+        const char *error = jsonl ? parse_json_entry(&arena, line, length, &entry)
+                                  : parse_import_line(line, length, &entry);
+        if (error == NULL) error = entry_validation_error(&entry);
+        if (error != NULL) {
+            printf("Line %zu rejected: %s\n", line_number, error);
+            rejected++;
+        } else {
+            output_journal_line(&lines, &entry);
+            imported++;
+        }
+        arena_reset(&arena);
+    }
+    free(line);
+    if (input != stdin) fclose(input);
+    output_flush(&lines);
+    size_t spooled = (size_t) lseek(lines.fd, 0, SEEK_CUR);
+    char *text = lines.failed || imported == 0 ? NULL : mmap(NULL, spooled, PROT_READ, MAP_PRIVATE, lines.fd, 0);
+    if (lines.failed || text == MAP_FAILED) {
+        if (text == MAP_FAILED) perror("Failed to read the temporary file of the import");
+        printf("Import failed, the journal was not changed\n");
+        text = NULL;
+        imported = 0;
+    }
+
+    int fd = text != NULL ? open_locked_journal() : -1;
+    struct stat journal_stat;
+    if (fd >= 0 && fstat(fd, &journal_stat) != 0) {
+        perror("Failed to open file for writing\n");
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0) {
+        int reserved = fallocate(fd, FALLOC_FL_KEEP_SIZE, journal_stat.st_size, (off_t) spooled + 1);
+        OutputBuffer journal;
+        output_init(&journal, fd);
+        if (reserved != 0 && errno == ENOSPC) {
+            perror("Failed to reserve space for the import");
+            journal.failed = true;
+        } else {
+            terminate_journal_line(&journal, journal_stat.st_size);
+            output_bytes(&journal, text, spooled);
+            output_flush(&journal);
+        }
+        if (journal.failed) {
+            if (ftruncate(fd, journal_stat.st_size) == 0) {
+                printf("Import failed, the journal was restored to its previous state\n");
+            } else {
+                perror("Import failed and the journal could not be restored");
+            }
+            imported = 0;
+        } else {
+            journal_appended(fd, &journal_stat);
+            if (sync && fsync(fd) != 0) perror("Failed to sync the journal");
+        }
+        output_free(&journal);
+        close(fd);
+    } else if (text != NULL) {
+        imported = 0;
+    }
+    if (text != NULL) munmap(text, spooled);
+    printf("Imported %zu entries, rejected %zu lines\n", imported, rejected);
+    print_arena_stats(&arena, "import");
+    arena_free(&arena);
+    output_free(&lines);
+    fclose(spool);
+}
+
+/**
+ * @brief Filters a journal entry based on its genre.
+ *
+ * This function is used to check if a given journal entry belongs to the genre of the predicate.
+ * The genre of the predicate has been resolved to an ID of `genre_dictionary` when it was compiled.
+ *
+ * @param entry A pointer to the JournalEntry structure to be checked.
+ *              This parameter must not be null.
+ * @param predicate The compiled predicate holding the genre name and its ID.
+ *
+ * @return True if the journal entry's genre matches the genre of the predicate, otherwise false.
+ *
+ * - Entries with an interned genre are matched by ID, which is a single integer compare.
+ * - Other entries are compared using `slice_equals_string`, which checks for an exact match between the two strings.
+ */
+bool filter_by_genre(const JournalEntry *entry, const FilterPredicate *predicate) {
+    if (entry->genre_id != GENRE_NONE) return entry->genre_id == predicate->genre_id;
+    return slice_equals_string(entry->genre, predicate->genre);
+}
+
+/**
+ * @brief Filters a journal entry based on a minimum score threshold.
+ *
+ * This function checks whether the `score` of the provided journal entry meets or
+ * exceeds the minimum threshold of the predicate. The threshold is parsed once when the
+ * predicate is compiled, not for every entry.
+ *
+ * @param entry A pointer to the `JournalEntry` structure to be evaluated. The pointer
+ *              must not be null.
+ * @param predicate The compiled predicate holding the minimum score.
+ *
+ * @return True if the journal entry's score is greater than or equal to the minimum
+ *         score, otherwise returns false.
+ */
+bool filter_by_score(const JournalEntry *entry, const FilterPredicate *predicate) {
+    return entry->score >= predicate->min_score;
+}
+
+/**
+ * @brief Filters a journal entry by its author, compared in the normalized form of `compare_author_names`.
+ *
+ * @return True if the author of the entry equals the author of the predicate, or starts with it for
+ *         `FILTER_AUTHOR_PREFIX`.
+ */
+bool filter_by_author(const JournalEntry *entry, const FilterPredicate *predicate) {
+    return slice_is_present(entry->author) &&
+           compare_author_names(entry->author, predicate->author, predicate->kind == FILTER_AUTHOR_PREFIX) == 0;
+}
+
+/**
+ * @brief Filters journal entries that are currently being read.
+ *
+ * This function is used to determine whether a journal entry represents a book
+ * that is still being read. An entry is considered to be "currently being read"
+ * if it has not been marked with an end date.
+ *
+ * @param entry A pointer to the JournalEntry to be evaluated. The pointer must
+ *              not be null.
+ *
+ * @return True if the end date of the entry is absent, indicating that the book is
+ *         still being read. Otherwise, false.
+ */
+bool filter_if_reading(const JournalEntry *entry) {
+    return !slice_is_present(entry->end_date);
+}
+
+/**
+ * @brief Filters journal entries to include only completed books.
+ *
+ * This function checks if a journal entry is marked as completed, which is determined
+ * by the presence of the `end_date` field.
+ *
+ * @param entry A pointer to a `JournalEntry` structure representing the entry to be evaluated.
+ *              The entry should not be null, and its `end_date` field is checked for completion status.
+ *
+ * @return True if the `JournalEntry` has an `end_date` field, otherwise false.
+ */
+bool filter_if_completed(const JournalEntry *entry) {
+    return slice_is_present(entry->end_date);
+}
+
+/**
+ * @brief Checks whether a date of an entry lies in the inclusive day range of the predicate.
+ *
+ * A missing or malformed date is `DATE_NONE`, which is below every range the list command creates, so such
+ * entries never match the range.
+ */
+bool filter_by_day_range(int32_t day, const FilterPredicate *predicate) {
+    return day >= predicate->min_day && day <= predicate->max_day;
+}
+
+/**
+ * @brief Evaluates one predicate, including its negation, for a single entry.
+ */
+bool predicate_matches(const FilterPredicate *predicate, const JournalEntry *entry) {
+    bool matches = false;
+    switch (predicate->kind) {
+        case FILTER_GENRE: matches = filter_by_genre(entry, predicate);
+            break;
+        case FILTER_READING: matches = filter_if_reading(entry);
+            break;
+        case FILTER_COMPLETED: matches = filter_if_completed(entry);
+            break;
+        case FILTER_SCORE: matches = filter_by_score(entry, predicate);
+            break;
+        case FILTER_START_RANGE: matches = filter_by_day_range(entry->start_day, predicate);
+            break;
+        case FILTER_END_RANGE: matches = filter_by_day_range(entry->end_day, predicate);
+            break;
+        case FILTER_AUTHOR:
+        case FILTER_AUTHOR_PREFIX: matches = filter_by_author(entry, predicate);
+            break;
+    }
+    return matches != predicate->negated;
+}
+
+/**
+ * @brief Evaluates a compiled filter for a single entry.
+ *
+ * Used where entries arrive one by one. Predicates are checked in the order of `compile_filter` and the
+ * evaluation stops at the first one that rejects the entry. Blocks of entries should go through
+ * `select_entries`.
+ */
+bool filter_matches(const JournalFilter *filter, const JournalEntry *entry) {
+    if (filter->matches_nothing) return false;
+    for (size_t i = 0; i < filter->count; i++) {
+        if (!predicate_matches(&filter->predicates[i], entry)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Keeps only the selected entries that satisfy one predicate.
+ *
+ * Each kind of predicate runs its own tight loop, which compacts the selection without branching on the
+ * result.
+ *
+ * @return The number of entries left in the selection.
+ */
+size_t refine_selection(const FilterPredicate *predicate, const JournalEntry *entries, uint16_t *selection,
+                        size_t selected) {
+    bool negated = predicate->negated;
+    size_t kept = 0;
+    switch (predicate->kind) {
+        case FILTER_GENRE:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_by_genre(&entries[selection[i]], predicate) != negated;
+            }
+            break;
+        case FILTER_READING:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_if_reading(&entries[selection[i]]) != negated;
+            }
+            break;
+        case FILTER_COMPLETED:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_if_completed(&entries[selection[i]]) != negated;
+            }
+            break;
+        case FILTER_SCORE:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_by_score(&entries[selection[i]], predicate) != negated;
+            }
+            break;
+        case FILTER_START_RANGE:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_by_day_range(entries[selection[i]].start_day, predicate) != negated;
+            }
+            break;
+        case FILTER_END_RANGE:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_by_day_range(entries[selection[i]].end_day, predicate) != negated;
+            }
+            break;
+        case FILTER_AUTHOR:
+        case FILTER_AUTHOR_PREFIX:
+            for (size_t i = 0; i < selected; i++) {
+                selection[kept] = selection[i];
+                kept += filter_by_author(&entries[selection[i]], predicate) != negated;
+            }
+            break;
+    }
+    return kept;
+}
+
+/**
+ * @brief Prepares the evaluation order of a scan, starting with the static order of `compile_filter`.
+ */
+void init_filter_stats(FilterStats *stats, const JournalFilter *filter) {
+    memset(stats, 0, sizeof(FilterStats));
+    for (size_t i = 0; i < filter->count; i++) stats->order[i] = (uint8_t) i;
+}
+
+/**
+ * @brief Expected cost of a predicate per rejected entry, from its static cost and the pass rate seen so far.
+ *
+ * Checking predicates in ascending order of `cost / (1 - pass rate)` minimizes the work for independent
+ * predicates, so cheap and selective predicates come first. The pass rate is smoothed so that a predicate
+ * which has not been evaluated yet keeps its static position.
+ */
+double predicate_rank(const JournalFilter *filter, const FilterStats *stats, size_t predicate) {
+    double pass_rate = ((double) stats->passed[predicate] + 1) / ((double) stats->evaluated[predicate] + 2);
+    return filter->predicates[predicate].cost / (1.0 - pass_rate + 1e-9);
+}
+
+/**
+ * @brief Evaluates a compiled filter for a block of entries.
+ *
+ * The selection starts with all entries and each predicate narrows it down with `refine_selection`, so a
+ * predicate is only evaluated for the entries that passed all previous ones. When `stats` is given, the
+ * pass rates of the predicates are recorded and the order is adapted after every block, so the most
+ * selective predicates move forward during a scan.
+ *
+ * @param filter The compiled filter.
+ * @param stats Evaluation order and pass rates of the current scan, or NULL to use the static order.
+ * @param entries The block of entries.
+ * @param count Number of entries in the block, at most `LIST_BLOCK_SIZE`.
+ * @param selection Receives the positions of the matching entries, in ascending order.
+ *
+ * @return The number of matching entries.
+ */
+size_t select_entries(const JournalFilter *filter, FilterStats *stats, const JournalEntry *entries, size_t count,
+                      uint16_t *selection) {
+    if (filter->matches_nothing) return 0;
+    for (size_t i = 0; i < count; i++) selection[i] = (uint16_t) i;
+    size_t selected = count;
+    for (size_t i = 0; i < filter->count && selected > 0; i++) {
+        size_t predicate = stats != NULL ? stats->order[i] : i;
+        size_t before = selected;
+        selected = refine_selection(&filter->predicates[predicate], entries, selection, selected);
+        if (stats != NULL) {
+            stats->evaluated[predicate] += before;
+            stats->passed[predicate] += selected;
+        }
+    }
+    if (stats != NULL) {
+        // Insertion sort, there are only a few predicates
+        for (size_t i = 1; i < filter->count; i++) {
+            uint8_t current = stats->order[i];
+            double rank = predicate_rank(filter, stats, current);
+            size_t j = i;
+            for (; j > 0 && predicate_rank(filter, stats, stats->order[j - 1]) > rank; j--) {
+                stats->order[j] = stats->order[j - 1];
+            }
+            stats->order[j] = current;
+        }
+    }
+    return selected;
+}
+
+/**
+ * @brief Prepares an empty filter, which matches all entries.
+ */
+void init_filter(JournalFilter *filter) {
+    memset(filter, 0, sizeof(JournalFilter));
+}
+
+/**
+ * @brief Takes the next free predicate of a filter and clears it. The filter must not be full.
+ */
+FilterPredicate *new_filter_predicate(JournalFilter *filter, FilterKind kind, bool negated) {
+    FilterPredicate *predicate = &filter->predicates[filter->count++];
+    memset(predicate, 0, sizeof(FilterPredicate));
+    predicate->kind = kind;
+    predicate->negated = negated;
+    predicate->genre_id = GENRE_NONE;
+    return predicate;
+}
+
+/**
+ * @brief Adds a predicate of the list command to the filter.
+ *
+ * The value is parsed here once: the score threshold is converted to a number, the genre is
+ * interned into `genre_dictionary` to get its ID and spaces around an author are trimmed.
+ *
+ * @param filter The filter to extend.
+ * @param kind The kind of the predicate selected by the option.
+ * @param value Value of the option, NULL if the option has none or it is missing. An option which
+ *              requires a value but has none makes the filter match no entry.
+ * @param negated True if the predicate was preceded by `--not`.
+ *
+ * @return False if the filter already has `FILTER_MAX_PREDICATES` predicates.
+ */
+bool add_filter_predicate(JournalFilter *filter, FilterKind kind, const char *value, bool negated) {
+    if (filter->count == FILTER_MAX_PREDICATES) return false;
+    if ((kind == FILTER_GENRE || kind == FILTER_SCORE || kind == FILTER_AUTHOR || kind == FILTER_AUTHOR_PREFIX) &&
+        value == NULL) {
+        filter->matches_nothing = true;
+        return true;
+    }
+    FilterPredicate *predicate = new_filter_predicate(filter, kind, negated);
+    switch (kind) {
+        case FILTER_GENRE:
+            predicate->genre = value;
+            predicate->genre_id = genre_dictionary_intern(&genre_dictionary, slice_from_string(value));
+            predicate->cost = 3;
+            filter->needs |= FILTER_NEEDS_GENRE;
+            break;
+        case FILTER_SCORE:
+            predicate->min_score = strtol(value, NULL, 10);
+            predicate->cost = 2;
+            filter->needs |= FILTER_NEEDS_SCORE;
+            break;
+        case FILTER_READING:
+        case FILTER_COMPLETED:
+            predicate->cost = 1;
+            filter->needs |= FILTER_NEEDS_END_DATE;
+            break;
+        case FILTER_AUTHOR:
+        case FILTER_AUTHOR_PREFIX:
+            predicate->author = trim_author_name(slice_from_string(value));
+            predicate->cost = 4;
+            filter->needs |= FILTER_NEEDS_AUTHOR;
+            break;
+        case FILTER_START_RANGE:
+        case FILTER_END_RANGE:
+            // Date ranges are added by add_date_range_predicate
+            break;
+    }
+    return true;
+}
+
+/**
+ * @brief Adds a predicate on the start or end date of an entry to the filter.
+ *
+ * @param filter The filter to extend.
+ * @param kind `FILTER_START_RANGE` or `FILTER_END_RANGE`.
+ * @param min_day First day of the range, as a day number.
+ * @param max_day Last day of the range. A range which ends before it starts matches no entry.
+ * @param negated True if the predicate was preceded by `--not`.
+ *
+ * @return False if the filter already has `FILTER_MAX_PREDICATES` predicates.
+ */
+bool add_date_range_predicate(JournalFilter *filter, FilterKind kind, int32_t min_day, int32_t max_day,
+                              bool negated) {
+    if (filter->count == FILTER_MAX_PREDICATES) return false;
+    FilterPredicate *predicate = new_filter_predicate(filter, kind, negated);
+    predicate->min_day = min_day;
+    predicate->max_day = max_day;
+    predicate->cost = 2;
+    filter->needs |= kind == FILTER_START_RANGE ? FILTER_NEEDS_START_DAY
+                                                : FILTER_NEEDS_END_DATE | FILTER_NEEDS_END_DAY;
+    return true;
+}
+
+/**
+ * @brief Finishes a filter by ordering its predicates from the cheapest to the most expensive one.
+ *
+ * Checking the presence of the end date is cheaper than a score or date range compare, which is cheaper
+ * than a genre check. Predicates of the same cost keep the order of the command line.
+ */
+void compile_filter(JournalFilter *filter) {
+    for (size_t i = 1; i < filter->count; i++) {
+        FilterPredicate current = filter->predicates[i];
+        size_t j = i;
+        for (; j > 0 && filter->predicates[j - 1].cost > current.cost; j--) {
+            filter->predicates[j] = filter->predicates[j - 1];
+        }
+        filter->predicates[j] = current;
+    }
+}
+
+/**
+ * @brief Returns the author predicate the filter requires, so the entries can be taken from the author index.
+ *
+ * @return The first author predicate that is not negated, or NULL if there is none.
+ */
+const FilterPredicate *filter_required_author(const JournalFilter *filter) {
+    for (size_t i = 0; i < filter->count; i++) {
+        const FilterPredicate *predicate = &filter->predicates[i];
+        if ((predicate->kind == FILTER_AUTHOR || predicate->kind == FILTER_AUTHOR_PREFIX) && !predicate->negated) {
+            return predicate;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the genre the filter requires, so the entries can be taken from its posting list.
+ *
+ * @return The genre ID of the first genre predicate that is not negated, or `GENRE_NONE` if there is none.
+ */
+uint32_t filter_required_genre(const JournalFilter *filter) {
+    for (size_t i = 0; i < filter->count; i++) {
+        const FilterPredicate *predicate = &filter->predicates[i];
+        if (predicate->kind == FILTER_GENRE && !predicate->negated) return predicate->genre_id;
+    }
+    return GENRE_NONE;
+}
+
+/**
+ * @brief Returns the range of start dates the filter requires, so the entries can be taken from the start
+ *        date order of the index.
+ *
+ * @param filter The compiled filter.
+ * @param min_day Receives the first day of the intersection of all start date ranges that are not negated.
+ * @param max_day Receives the last day of the intersection.
+ *
+ * @return True if the filter has such a range.
+ */
+bool filter_required_start_range(const JournalFilter *filter, int32_t *min_day, int32_t *max_day) {
+    bool found = false;
+    *min_day = INT32_MIN;
+    *max_day = INT32_MAX;
+    for (size_t i = 0; i < filter->count; i++) {
+        const FilterPredicate *predicate = &filter->predicates[i];
+        if (predicate->kind != FILTER_START_RANGE || predicate->negated) continue;
+        if (predicate->min_day > *min_day) *min_day = predicate->min_day;
+        if (predicate->max_day < *max_day) *max_day = predicate->max_day;
+        found = true;
+    }
+    return found;
+}
+
+/**
+ * @brief Maps the journal file into memory for zero-copy reading.
+ *
+ * @param fd Descriptor of the journal file opened for reading.
+ * @param journal The mapping to populate. On success it must be released with `unmap_journal`.
+ *
+ * @return True if the journal was mapped (or is an empty regular file), false if the file cannot be mapped
+ *         (e.g. it is not a regular file), in which case the caller should fall back to stream reading.
+ */
+bool map_journal(int fd, MappedJournal *journal) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    journal->file_stat = st;
+    journal->data = NULL;
+    journal->size = (size_t) st.st_size;
+    if (journal->size == 0) return true;
+    void *mapping = mmap(NULL, journal->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) return false;
+    madvise(mapping, journal->size, MADV_SEQUENTIAL);
+    journal->data = mapping;
+    return true;
+}
+
+/**
+ * @brief Releases a mapping created by `map_journal`.
+ */
+void unmap_journal(MappedJournal *journal) {
+    if (journal->data != NULL) munmap((void *) journal->data, journal->size);
+    journal->data = NULL;
+    journal->size = 0;
+}
+
+/**
+ * @brief Prepares a sorter for the entries of one list scan.
+ *
+ * @param sorter The sorter to initialize.
+ * @param field The field to sort by, `SORT_NONE` keeps the order of the file.
+ * @param descending True to print the greatest values first.
+ * @param limit Number of entries to print, 0 for all of them.
+ * @param memory_budget Bytes of entries kept in memory before they are spilled to a run file.
+ */
+void init_entry_sorter(EntrySorter *sorter, SortField field, bool descending, size_t limit, size_t memory_budget) {
+    memset(sorter, 0, sizeof(EntrySorter));
+    sorter->field = field;
+    sorter->descending = descending;
+    sorter->limit = limit;
+    sorter->memory_budget = memory_budget;
+    arena_init(&sorter->arena);
+    output_init(&sorter->scratch, -1);
+}
+
+/**
+ * @brief Releases everything held by a sorter, including unmerged run files.
+ */
+void free_entry_sorter(EntrySorter *sorter) {
+    if (sorter->limit > 0) {
+        for (size_t i = 0; i < sorter->count; i++) free(sorter->entries[i].data);
+    }
+    for (size_t i = 0; i < sorter->run_count; i++) fclose(sorter->runs[i]);
+    free(sorter->entries);
+    free(sorter->runs);
+    arena_free(&sorter->arena);
+    output_free(&sorter->scratch);
+}
+
+/**
+ * @brief Computes the sort key of an entry. Entries without the sorted value (no score, a missing or
+ *        malformed date) are marked as missing.
+ */
+void sort_record_from_entry(const EntrySorter *sorter, const JournalEntry *entry, SortRecord *record) {
+    memset(record, 0, sizeof(SortRecord));
+    record->sequence = sorter->next_sequence;
+    switch (sorter->field) {
+        case SORT_SCORE:
+            record->value = entry->score;
+            record->missing = entry->score == 0;
+            break;
+        case SORT_START:
+        case SORT_END: {
+            int32_t day = date_to_day_number(sorter->field == SORT_START ? entry->start_date : entry->end_date);
+            record->value = day;
+            record->missing = day == DATE_NONE;
+            break;
+        }
+        case SORT_NAME:
+            record->name_length = (uint32_t) entry->book_name.length;
+            break;
+        case SORT_NONE: break;
+    }
+}
+
+/**
+ * @brief Tells whether entry `a` is printed before entry `b`.
+ *
+ * Entries are ordered by the sort key, ascending or descending, and then by their position in the file.
+ * Entries without the sorted value come last in both directions. Book names compare byte by byte.
+ */
+bool sorted_entry_before(const EntrySorter *sorter, const SortRecord *a, const char *a_name, const SortRecord *b,
+                         const char *b_name) {
+    if (a->missing != b->missing) return b->missing;
+    int order = 0;
+    if (sorter->field == SORT_NAME) {
+        size_t length = a->name_length < b->name_length ? a->name_length : b->name_length;
+        order = memcmp(a_name, b_name, length);
+        if (order == 0) order = (a->name_length > b->name_length) - (a->name_length < b->name_length);
+    } else {
+        order = (a->value > b->value) - (a->value < b->value);
+    }
+    if (order != 0) return sorter->descending ? order > 0 : order < 0;
+    return a->sequence < b->sequence;
+}
+
+/**
+ * @brief `qsort_r` comparator of collected entries, the context is the sorter.
+ */
+int compare_sorted_entries(const void *a, const void *b, void *context) {
+    const SortedEntry *first = a;
+    const SortedEntry *second = b;
+    return sorted_entry_before(context, &first->record, first->data, &second->record, second->data) ? -1 : 1;
+}
+
+/**
+ * @brief Restores the heap of a top-k sorter downwards from position `i`. The root is the entry printed
+ *        last.
+ */
+void sorter_heap_down(EntrySorter *sorter, size_t i) {
+    SortedEntry *heap = sorter->entries;
+    for (;;) {
+        size_t last = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < sorter->count; child++) {
+            if (sorted_entry_before(sorter, &heap[last].record, heap[last].data, &heap[child].record,
+                                    heap[child].data)) {
+                last = child;
+            }
+        }
+        if (last == i) return;
+        SortedEntry swap = heap[i];
+        heap[i] = heap[last];
+        heap[last] = swap;
+        i = last;
+    }
+}
+
+/**
+ * @brief Restores the heap of a top-k sorter upwards from position `i`.
+ */
+void sorter_heap_up(EntrySorter *sorter, size_t i) {
+    SortedEntry *heap = sorter->entries;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!sorted_entry_before(sorter, &heap[parent].record, heap[parent].data, &heap[i].record, heap[i].data)) {
+            return;
+        }
+        SortedEntry swap = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = swap;
+        i = parent;
+    }
+}
+
+/**
+ * @brief Writes one collected entry to a run file.
+ */
+bool write_sort_record(FILE *file, const SortedEntry *entry) {
+    size_t length = (size_t) entry->record.name_length + entry->record.text_length;
+    return fwrite(&entry->record, sizeof(SortRecord), 1, file) == 1 && fwrite(entry->data, 1, length, file) == length;
+}
+
+/**
+ * @brief Reads the next entry of a run file into `run->current`.
+ *
+ * @return False at the end of the run or on a read error.
+ */
+bool read_sort_record(SortRun *run) {
+    if (fread(&run->current.record, sizeof(SortRecord), 1, run->file) != 1) return false;
+    size_t length = (size_t) run->current.record.name_length + run->current.record.text_length;
+    if (length > run->capacity) {
+        char *grown = realloc(run->current.data, length);
+        if (grown == NULL) return false;
+        run->current.data = grown;
+        run->capacity = length;
+    }
+    return fread(run->current.data, 1, length, run->file) == length;
+}
+
+/**
+ * @brief Restores a heap of runs downwards from position `i`. The run with the first current entry is at
+ *        the root.
+ */
+void sort_run_heap_down(const EntrySorter *sorter, const SortRun *runs, size_t *heap, size_t heap_size, size_t i) {
+    for (;;) {
+        size_t first = i;
+        for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap_size; child++) {
+            const SortedEntry *a = &runs[heap[child]].current;
+            const SortedEntry *b = &runs[heap[first]].current;
+            if (sorted_entry_before(sorter, &a->record, a->data, &b->record, b->data)) first = child;
+        }
+        if (first == i) return;
+        size_t swap = heap[i];
+        heap[i] = heap[first];
+        heap[first] = swap;
+        i = first;
+    }
+}
+
+/**
+ * @brief Merges sorted run files into one sorted stream.
+ *
+ * The runs are read side by side and a heap of the runs, ordered by their current entries, picks the next
+ * entry. The merged entries are written either as a new run to `destination` or as text to `out`.
+ *
+ * @return True on success, false on an I/O error.
+ */
+bool merge_sort_runs(const EntrySorter *sorter, FILE **files, size_t count, FILE *destination, OutputBuffer *out) {
+    SortRun *runs = calloc(count, sizeof(SortRun));
+    size_t *heap = malloc(count * sizeof(size_t));
+    size_t heap_size = 0;
+    bool ok = runs != NULL && heap != NULL;
+    for (size_t i = 0; ok && i < count; i++) {
+        runs[i].file = files[i];
+        ok = fseek(files[i], 0, SEEK_SET) == 0;
+        if (ok && read_sort_record(&runs[i])) heap[heap_size++] = i;
+    }
+    for (size_t i = heap_size / 2; ok && i-- > 0;) sort_run_heap_down(sorter, runs, heap, heap_size, i);
+    while (ok && heap_size > 0) {
+        SortRun *run = &runs[heap[0]];
+        if (destination != NULL) {
+            ok = write_sort_record(destination, &run->current);
+        } else {
+            output_bytes(out, run->current.data + run->current.record.name_length, run->current.record.text_length);
+        }
+        if (!read_sort_record(run)) heap[0] = heap[--heap_size];
+        sort_run_heap_down(sorter, runs, heap, heap_size, 0);
+    }
+    for (size_t i = 0; ok && i < count; i++) ok = !ferror(files[i]);
+    for (size_t i = 0; runs != NULL && i < count; i++) free(runs[i].current.data);
+    free(runs);
+    free(heap);
+    return ok;
+}
+
+/**
+ * @brief Sorts the collected entries into a new run file and releases their memory.
+ *
+ * At most `SORT_MAX_RUNS` runs are kept. When there are that many, they are first merged into a single run,
+ * so the number of open files stays bounded however large the journal is.
+ *
+ * @return True on success, false on an I/O error.
+ */
+bool spill_sorted_run(EntrySorter *sorter) {
+    if (sorter->runs == NULL) {
+        sorter->runs = malloc(SORT_MAX_RUNS * sizeof(FILE *));
+        if (sorter->runs == NULL) return false;
+    }
+    if (sorter->run_count == SORT_MAX_RUNS) {
+        FILE *merged = tmpfile();
+        if (merged == NULL || !merge_sort_runs(sorter, sorter->runs, sorter->run_count, merged, NULL)) {
+            if (merged != NULL) fclose(merged);
+            return false;
+        }
+        for (size_t i = 0; i < sorter->run_count; i++) fclose(sorter->runs[i]);
+        sorter->runs[0] = merged;
+        sorter->run_count = 1;
+    }
+    qsort_r(sorter->entries, sorter->count, sizeof(SortedEntry), compare_sorted_entries, sorter);
+    FILE *run = tmpfile();
+    bool ok = run != NULL;
+    for (size_t i = 0; ok && i < sorter->count; i++) ok = write_sort_record(run, &sorter->entries[i]);
+    if (!ok) {
+        if (run != NULL) fclose(run);
+        return false;
+    }
+    sorter->runs[sorter->run_count++] = run;
+    sorter->count = 0;
+    sorter->memory_used = 0;
+    arena_reset(&sorter->arena);
+    return true;
+}
+
+/**
+ * @brief Collects one matching entry.
+ *
+ * The key is computed first, so with a limit an entry that would not make it into the heap is dropped
+ * without being formatted or copied.
+ */
+void add_sorted_entry(EntrySorter *sorter, const JournalEntry *entry) {
+    if (sorter->failed) return;
+    SortRecord record;
+    sort_record_from_entry(sorter, entry, &record);
+    sorter->next_sequence++;
+    const char *name = entry->book_name.data;
+    bool full = sorter->limit > 0 && sorter->count == sorter->limit;
+    if (full && !sorted_entry_before(sorter, &record, name, &sorter->entries[0].record, sorter->entries[0].data)) {
+        return;
+    }
+    sorter->scratch.used = 0;
+    format_entry(&sorter->scratch, entry);
+    record.text_length = (uint32_t) sorter->scratch.used;
+    size_t length = (size_t) record.name_length + record.text_length;
+    char *data = sorter->limit > 0 ? malloc(length) : arena_alloc(&sorter->arena, length);
+    if (!full && sorter->count == sorter->capacity) {
+        size_t capacity = sorter->capacity == 0 ? 1024 : sorter->capacity * 2;
+        if (sorter->limit > 0 && capacity > sorter->limit) capacity = sorter->limit;
+        SortedEntry *grown = realloc(sorter->entries, capacity * sizeof(SortedEntry));
+        if (grown != NULL) {
+            sorter->entries = grown;
+            sorter->capacity = capacity;
+        }
+    }
+    if (data == NULL || sorter->scratch.failed || (!full && sorter->count == sorter->capacity)) {
+        if (sorter->limit > 0) free(data);
+        sorter->failed = true;
+        return;
+    }
+    memcpy(data, name, record.name_length);
+    memcpy(data + record.name_length, sorter->scratch.data, record.text_length);
+    SortedEntry sorted = {record, data};
+    if (full) {
+        free(sorter->entries[0].data);
+        sorter->entries[0] = sorted;
+        sorter_heap_down(sorter, 0);
+    } else if (sorter->limit > 0) {
+        sorter->entries[sorter->count++] = sorted;
+        sorter_heap_up(sorter, sorter->count - 1);
+    } else {
+        sorter->entries[sorter->count++] = sorted;
+        sorter->memory_used += sizeof(SortedEntry) + length;
+        if (sorter->memory_used > sorter->memory_budget && !spill_sorted_run(sorter)) sorter->failed = true;
+    }
+}
+
+/**
+ * @brief Prints the collected entries in sorted order.
+ *
+ * @return The number of printed entries, or `SIZE_MAX` if sorting failed (which is reported).
+ */
+size_t finish_entry_sorter(EntrySorter *sorter, OutputBuffer *out) {
+    if (!sorter->failed && sorter->run_count > 0) {
+        if (sorter->count > 0 && !spill_sorted_run(sorter)) sorter->failed = true;
+        if (!sorter->failed && !merge_sort_runs(sorter, sorter->runs, sorter->run_count, NULL, out)) {
+            sorter->failed = true;
+        }
+        if (!sorter->failed) return sorter->next_sequence;
+    }
+    if (sorter->failed) {
+        perror("Failed to sort the listed entries");
+        return SIZE_MAX;
+    }
+    qsort_r(sorter->entries, sorter->count, sizeof(SortedEntry), compare_sorted_entries, sorter);
+    for (size_t i = 0; i < sorter->count; i++) {
+        const SortedEntry *sorted = &sorter->entries[i];
+        output_bytes(out, sorted->data + sorted->record.name_length, sorted->record.text_length);
+    }
+    return sorter->count;
+}
+
+/**
+ * @brief Hands an entry selected by a list scan to the sink, which prints it or passes it to the sorter.
+ */
+void emit_entry(ListSink *sink, const JournalEntry *entry) {
+    if (sink->sorter != NULL) {
+        add_sorted_entry(sink->sorter, entry);
+    } else {
+        format_entry(sink->out, entry);
+    }
+}
+
+/**
+ * @brief Releases the changes loaded by `load_journal_overlay` and leaves the overlay empty.
+ */
+void free_journal_overlay(JournalOverlay *overlay) {
+    free(overlay->data);
+    free(overlay->changes);
+    memset(overlay, 0, sizeof(JournalOverlay));
+}
+
+/**
+ * @brief Orders overlay changes by their line and then by the order of the change log, for `qsort`.
+ */
+int compare_overlay_changes(const void *a, const void *b) {
+    const OverlayChange *first = a;
+    const OverlayChange *second = b;
+    if (first->offset != second->offset) return first->offset < second->offset ? -1 : 1;
+    return (first->sequence > second->sequence) - (first->sequence < second->sequence);
+}
+
+/**
+ * @brief Checks that a change log record points to the start of a journal line which still has the text
+ *        the change was made for.
+ */
+bool change_matches_journal(const ChangeRecord *record, const char *data, size_t size) {
+    if (record->line_offset >= size || (record->line_offset > 0 && data[record->line_offset - 1] != '\n')) {
+        return false;
+    }
+    const char *line = data + record->line_offset;
+    const char *newline = memchr(line, '\n', size - record->line_offset);
+    TextSlice text = {line, (size_t) ((newline != NULL ? newline : data + size) - line)};
+    return hash_slice(text) == record->line_hash;
+}
+
+/**
+ * @brief Reads the change log of the journal and keeps the latest change of every line.
+ *
+ * Records of another journal file (see `ChangesHeader`) and records which do not match the journal text
+ * (`change_matches_journal`) are skipped, as is a record cut short by a crash at the end of the log.
+ *
+ * @param data The journal text the changes apply to.
+ * @param size Size of the journal text.
+ * @param journal_stat The journal file, identified by its inode.
+ * @param overlay Receives the changes. It is empty if the journal has no change log.
+ *
+ * @return False if the log exists but cannot be read (which is reported).
+ */
+bool load_journal_overlay(const char *data, size_t size, const struct stat *journal_stat, JournalOverlay *overlay) {
+    memset(overlay, 0, sizeof(JournalOverlay));
+    int fd = open(JOURNAL_CHANGES_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (overlay->data = malloc(st.st_size > 0 ? st.st_size : 1)) != NULL &&
+              read(fd, overlay->data, st.st_size) == st.st_size;
+    close(fd);
+    if (!ok) {
+        perror("Failed to read the change log");
+        free_journal_overlay(overlay);
+        return false;
+    }
+    overlay->size = st.st_size;
+    ChangesHeader header;
+    if (overlay->size < sizeof(ChangesHeader)) return true;
+    memcpy(&header, overlay->data, sizeof(ChangesHeader));
+    if (header.magic != JOURNAL_CHANGES_MAGIC || header.version != JOURNAL_CHANGES_VERSION ||
+        header.journal_inode != (uint64_t) journal_stat->st_ino) {
+        return true;
+    }
+    size_t capacity = 0;
+    size_t position = sizeof(ChangesHeader);
+    while (overlay->size - position >= sizeof(ChangeRecord)) {
+        ChangeRecord record;
+        memcpy(&record, overlay->data + position, sizeof(ChangeRecord));
+        if (record.length > overlay->size - position - sizeof(ChangeRecord)) break;
+        TextSlice line = {overlay->data + position + sizeof(ChangeRecord), (size_t) record.length};
+        position += sizeof(ChangeRecord) + record.length;
+        if ((record.kind != CHANGE_UPDATE && record.kind != CHANGE_DELETE) ||
+            !change_matches_journal(&record, data, size)) {
+            continue;
+        }
+        if (overlay->count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            OverlayChange *resized = realloc(overlay->changes, capacity * sizeof(OverlayChange));
+            if (resized == NULL) {
+                perror("Failed to read the change log");
+                free_journal_overlay(overlay);
+                return false;
+            }
+            overlay->changes = resized;
+        }
+        OverlayChange change = {record.line_offset, overlay->count, record.kind == CHANGE_DELETE, line};
+        overlay->changes[overlay->count++] = change;
+    }
+    overlay->log_end = position;
+    overlay->record_count = overlay->count;
+    if (overlay->count == 0) return true;
+    // Only the latest change of a line counts
+    qsort(overlay->changes, overlay->count, sizeof(OverlayChange), compare_overlay_changes);
+    size_t kept = 0;
+    for (size_t i = 0; i < overlay->count; i++) {
+        if (kept > 0 && overlay->changes[kept - 1].offset == overlay->changes[i].offset) kept--;
+        overlay->changes[kept++] = overlay->changes[i];
+    }
+    overlay->count = kept;
+    return true;
+}
+
+/**
+ * @brief Finds the first change of the overlay at or after a journal offset.
+ */
+const OverlayChange *find_overlay_change(const JournalOverlay *overlay, uint64_t offset) {
+    size_t low = 0;
+    size_t high = overlay->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (overlay->changes[middle].offset < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return overlay->changes + low;
+}
+
+/**
+ * @brief Applies the change of a line from `journal_overlay`, if it has one, to a tokenized line.
+ *
+ * Lines are passed in journal order and `*change` follows them through the ordered changes, so a scan
+ * without changes costs one compare per line.
+ *
+ * @param line The line. An updated line is replaced by its new text and fields.
+ * @param offset Offset of the line in the journal.
+ * @param change The next change of the scan, at or after the line, moved past the line.
+ *
+ * @return False if the line was deleted and must be skipped.
+ */
+bool apply_overlay_change(TokenizedLine *line, uint64_t offset, const OverlayChange **change) {
+    const OverlayChange *end = journal_overlay.changes + journal_overlay.count;
+    while (*change < end && (*change)->offset < offset) (*change)++;
+    if (*change == end || (*change)->offset != offset) return true;
+    const OverlayChange *current = (*change)++;
+    if (current->deleted) return false;
+    line->data = current->line.data;
+    line->length = current->line.length;
+    line->field_count = split_fields(current->line.data, current->line.length, line->fields);
+    return true;
+}
+
+/**
+ * @brief Applies the filter to a single loaded entry, emits it when it matches and updates the counters.
+ */
+void list_entry(const JournalEntry *entry, const JournalFilter *filter, ListCounts *counts, ListSink *sink) {
+    counts->total++;
+    if (filter_matches(filter, entry)) {
+        ProfilePhase previous = profile_enter(PROFILE_FORMAT);
+        emit_entry(sink, entry);
+        profile_enter(previous);
+        counts->listed++;
+    }
+}
+
+/**
+ * @brief Filters a block of loaded entries, emits the matching ones to `sink` and empties the block.
+ */
+void flush_entry_block(EntryBlock *block, const JournalFilter *filter, FilterStats *stats, ListCounts *counts,
+                       ListSink *sink) {
+    uint16_t selection[LIST_BLOCK_SIZE];
+    ProfilePhase previous = profile_enter(PROFILE_FILTER);
+    size_t selected = select_entries(filter, stats, block->entries, block->count, selection);
+    profile_enter(PROFILE_FORMAT);
+    for (size_t i = 0; i < selected; i++) {
+        JournalEntry *entry = &block->entries[selection[i]];
+        if (block->partial) {
+            entry_from_fields(entry, block->fields[selection[i]], block->field_counts[selection[i]]);
+            entry->id = block->ids[selection[i]];
+            entry->id_check = block->id_checks[selection[i]];
+        }
+        emit_entry(sink, entry);
+    }
+    profile_enter(previous);
+    counts->total += block->count;
+    counts->listed += selected;
+    block->count = 0;
+}
+
+/**
+ * @brief Lists the entries of a range of whole lines of a memory-mapped journal.
+ *
+ * Lines are split by a `LineTokenizer`, which finds the delimiters of many lines at once with the
+ * fastest scanner the CPU supports, and are parsed straight from the mapping, so no line buffer, copy or
+ * per-field allocation is needed. Entries are collected into a block and each full block is filtered at
+ * once. Only the fields the filter looks at are parsed before filtering (`entry_from_filter_fields`), the
+ * rest only for the entries that match. An invalid line flushes the block before it is reported, so the output keeps the order
+ * of the file. Lines changed by `update` or `delete` are taken from `journal_overlay` instead.
+ *
+ * @param begin Start of the first line of the range.
+ * @param end End of the range, just after a newline or at the end of the journal.
+ * @param offset Offset of the range in the journal, which gives the record IDs of the entries.
+ * @param filter The compiled filter.
+ * @param counts Counters to update.
+ * @param sink Where the matching entries go, invalid lines are reported to its output.
+ * @param intern_genres True to intern genres of the entries into `genre_dictionary`. Worker threads pass
+ *                      false and only look genres up, as the dictionary must not change while shared.
+ */
+void list_mapped_range(const char *begin, const char *end, uint64_t offset, const JournalFilter *filter,
+                       ListCounts *counts, ListSink *sink, bool intern_genres) {
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    EntryBlock *block = malloc(sizeof(EntryBlock));
+    if (tokenizer == NULL || block == NULL) {
+        perror("Failed to allocate memory for journal tokenizer");
+        free(tokenizer);
+        free(block);
+        return;
+    }
+    init_line_tokenizer(tokenizer, begin, end, select_delimiter_scanner());
+    FilterStats stats;
+    init_filter_stats(&stats, filter);
+    TokenizedLine line;
+    block->count = 0;
+    block->partial = true;
+    const OverlayChange *change = find_overlay_change(&journal_overlay, offset);
+    thread_profile.bytes_read += end - begin;
+    ProfilePhase previous = profile_enter(PROFILE_TOKENIZE);
+    bool more = true;
+    while (more) {
+        // Split a block of lines first and fill the entries after, so the phases can be profiled per block
+        profile_enter(PROFILE_TOKENIZE);
+        bool invalid = false;
+        while (block->count < LIST_BLOCK_SIZE && (more = next_tokenized_line(tokenizer, &line))) {
+            uint64_t id = offset + (uint64_t) (line.data - begin);
+            uint32_t id_check = list_show_ids ? hash_slice((TextSlice) {line.data, line.length}) : 0;
+            if (!apply_overlay_change(&line, id, &change)) continue;
+            if (line.field_count < 4) {
+                // The line lacks some of the required fields
+                invalid = true;
+                break;
+            }
+            memcpy(block->fields[block->count], line.fields, sizeof(TextSlice) * line.field_count);
+            block->ids[block->count] = id;
+            block->id_checks[block->count] = id_check;
+            block->field_counts[block->count++] = (uint8_t) line.field_count;
+        }
+        profile_enter(PROFILE_LOAD);
+        for (size_t i = 0; i < block->count; i++) {
+            JournalEntry *entry = &block->entries[i];
+            entry_from_filter_fields(entry, block->fields[i], block->field_counts[i], filter->needs);
+            entry->id = block->ids[i];
+            entry->id_check = block->id_checks[i];
+            if (filter->needs & FILTER_NEEDS_GENRE) {
+                if (intern_genres) {
+                    intern_entry_genre(entry);
+                } else {
+                    lookup_entry_genre(entry);
+                }
+            }
+        }
+        flush_entry_block(block, filter, &stats, counts, sink);
+        if (invalid) report_invalid_line(sink->out, line.data, line.length);
+    }
+    profile_enter(previous);
+    free(block);
+    free(tokenizer);
+}
+
+/**
+ * @brief Start of the chunk of a parallel scan, moved forward to the start of a line.
+ *
+ * Chunk `chunk` nominally starts at `chunk * chunk_size`. The line which contains the byte just before
+ * that position belongs to the previous chunk, so the chunk starts after its newline.
+ */
+size_t parallel_chunk_start(const ParallelScan *scan, size_t chunk) {
+    if (chunk == 0) return 0;
+    size_t nominal = chunk * scan->chunk_size;
+    if (nominal >= scan->size) return scan->size;
+    const char *newline = memchr(scan->data + nominal - 1, '\n', scan->size - nominal + 1);
+    return newline != NULL ? (size_t) (newline - scan->data) + 1 : scan->size;
+}
+
+/**
+ * @brief Worker thread of a parallel scan.
+ *
+ * Takes chunks in file order, processes each one by `scan_range` into a memory buffer and hands the output
+ * over to the main thread. Workers never run further ahead of the writer than `window` chunks, which bounds the memory
+ * held by finished but unwritten chunks.
+ */
+void *parallel_scan_worker(void *argument) {
+    ParallelScan *scan = argument;
+    for (;;) {
+        pthread_mutex_lock(&scan->lock);
+        while (scan->next_chunk < scan->chunk_count && scan->next_chunk >= scan->written + scan->window) {
+            pthread_cond_wait(&scan->window_moved, &scan->lock);
+        }
+        if (scan->next_chunk >= scan->chunk_count) {
+            pthread_mutex_unlock(&scan->lock);
+            merge_thread_profile();
+            return NULL;
+        }
+        size_t chunk = scan->next_chunk++;
+        pthread_mutex_unlock(&scan->lock);
+
+        ChunkResult *result = &scan->results[chunk];
+        ListCounts counts = {0, 0};
+        output_init(&result->output, -1);
+        size_t begin = parallel_chunk_start(scan, chunk);
+        size_t end = parallel_chunk_start(scan, chunk + 1);
+        scan->scan_range(scan->data, begin, end, scan->filter, &counts, &result->output);
+
+        pthread_mutex_lock(&scan->lock);
+        result->counts = counts;
+        result->failed = result->output.failed;
+        result->done = true;
+        pthread_cond_broadcast(&scan->chunk_done);
+        pthread_mutex_unlock(&scan->lock);
+    }
+}
+
+/**
+ * @brief Scans a memory-mapped journal with several threads.
+ *
+ * The journal is split into newline-aligned chunks of `LIST_CHUNK_SIZE` bytes, which worker threads
+ * process in parallel with `scan_range`. The main thread writes the output of the chunks in file order
+ * and sums their counters, so the result is the same as from a single scan of the whole journal.
+ *
+ * @return True on success, false if the parallel scan failed (which is reported).
+ */
+bool run_parallel_scan(const MappedJournal *journal, RangeScanner scan_range, const JournalFilter *filter,
+                       ListCounts *counts, int threads, OutputBuffer *out) {
+    ParallelScan scan;
+    memset(&scan, 0, sizeof(ParallelScan));
+    scan.data = journal->data;
+    scan.size = journal->size;
+    scan.scan_range = scan_range;
+    scan.filter = filter;
+    scan.chunk_size = LIST_CHUNK_SIZE;
+    scan.chunk_count = (journal->size + LIST_CHUNK_SIZE - 1) / LIST_CHUNK_SIZE;
+    scan.window = (size_t) threads * 4;
+    scan.results = calloc(scan.chunk_count, sizeof(ChunkResult));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    if (scan.results == NULL || workers == NULL) {
+        perror("Failed to allocate memory for parallel scan");
+        free(scan.results);
+        free(workers);
+        return false;
+    }
+    pthread_mutex_init(&scan.lock, NULL);
+    pthread_cond_init(&scan.chunk_done, NULL);
+    pthread_cond_init(&scan.window_moved, NULL);
+
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, parallel_scan_worker, &scan) != 0) break;
+    }
+    bool ok = started > 0;
+    if (!ok) fprintf(stderr, "Failed to start worker threads\n");
+    for (size_t chunk = 0; ok && chunk < scan.chunk_count; chunk++) {
+        ChunkResult *result = &scan.results[chunk];
+        pthread_mutex_lock(&scan.lock);
+        while (!result->done) pthread_cond_wait(&scan.chunk_done, &scan.lock);
+        pthread_mutex_unlock(&scan.lock);
+        if (result->failed) {
+            ok = false;
+        } else {
+            output_bytes(out, result->output.data, result->output.used);
+            counts->total += result->counts.total;
+            counts->listed += result->counts.listed;
+        }
+        output_free(&result->output);
+        pthread_mutex_lock(&scan.lock);
+        scan.written++;
+        pthread_cond_broadcast(&scan.window_moved);
+        pthread_mutex_unlock(&scan.lock);
+    }
+    if (!ok) {
+        // Let the workers run out of chunks
+        pthread_mutex_lock(&scan.lock);
+        scan.next_chunk = scan.chunk_count;
+        pthread_cond_broadcast(&scan.window_moved);
+        pthread_mutex_unlock(&scan.lock);
+    }
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    for (size_t chunk = 0; chunk < scan.chunk_count; chunk++) output_free(&scan.results[chunk].output);
+    pthread_cond_destroy(&scan.window_moved);
+    pthread_cond_destroy(&scan.chunk_done);
+    pthread_mutex_destroy(&scan.lock);
+    free(scan.results);
+    free(workers);
+    return ok;
+}
+
+/**
+ * @brief Lists one chunk of a parallel scan, see `RangeScanner`.
+ */
+void list_mapped_chunk(const char *data, size_t begin, size_t end, const JournalFilter *filter, ListCounts *counts,
+                       OutputBuffer *out) {
+    ListSink sink = {out, NULL};
+    list_mapped_range(data + begin, data + end, begin, filter, counts, &sink, false);
+}
+
+/**
+ * @brief Lists entries of a memory-mapped journal.
+ *
+ * With one thread the journal is scanned as a single range. With more threads it is split into chunks
+ * which worker threads parse and filter in parallel (`run_parallel_scan`), the output and the counters are
+ * the same as with a single thread. Entries for a sorter are collected by a single thread.
+ *
+ * @return True on success, false if the parallel scan failed (which is reported).
+ */
+bool list_mapped_entries(const MappedJournal *journal, const JournalFilter *filter, ListCounts *counts,
+                         int threads, ListSink *sink) {
+    if (threads <= 1 || journal->size <= LIST_CHUNK_SIZE || sink->sorter != NULL) {
+        list_mapped_range(journal->data, journal->data + journal->size, 0, filter, counts, sink, true);
+        return true;
+    }
+    return run_parallel_scan(journal, list_mapped_chunk, filter, counts, threads, sink->out);
+}
+
+/**
+ * @brief Lists entries of a journal read line by line with `getline`.
+ *
+ * Fallback for journals that cannot be memory-mapped. Entries are allocated from the arena, which is
+ * reset after every record so the whole load runs from a single arena block.
+ */
+void list_stream_entries(FILE *file, Arena *arena, const JournalFilter *filter, ListCounts *counts,
+                         ListSink *sink) {
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read;
+    uint64_t offset = 0;
+    ProfilePhase previous = profile_enter(PROFILE_READ);
+    while ((read = getline(&line, &len, file)) != -1) {
+        thread_profile.bytes_read += read;
+        size_t length = read > 0 && line[read - 1] == '\n' ? (size_t) read - 1 : (size_t) read;
+        profile_enter(PROFILE_LOAD);
+        JournalEntry *entry = load_entry(arena, line, length, sink->out);
+        if (entry != NULL) {
+            entry->id = offset;
+            if (list_show_ids) entry->id_check = hash_slice((TextSlice) {line, length});
+            intern_entry_genre(entry);
+            pack_entry_days(entry, filter->needs);
+            profile_enter(PROFILE_FILTER);
+            list_entry(entry, filter, counts, sink);
+        }
+        arena_reset(arena);
+        offset += read;
+        profile_enter(PROFILE_READ);
+    }
+    profile_enter(previous);
+    free(line);
+}
+
+/**
+ * @brief Checks whether the index header describes the journal as it is now.
+ */
+bool index_matches_journal(const IndexHeader *header, const MappedJournal *journal) {
+    return header->magic == JOURNAL_INDEX_MAGIC && header->version == JOURNAL_INDEX_VERSION &&
+           header->journal_size == journal->size &&
+           header->journal_mtime_sec == (int64_t) journal->file_stat.st_mtim.tv_sec &&
+           header->journal_mtime_nsec == (int64_t) journal->file_stat.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Describes one journal line as a fixed-width index record.
+ *
+ * Genres are interned into `genres`, whose IDs become the genre IDs of the index. Genres past the range
+ * of the record field get `INDEX_GENRE_OVERFLOW`.
+ */
+void fill_index_record(IndexRecord *record, const char *data, size_t line_offset, size_t length,
+                       GenreDictionary *genres) {
+    const char *line = data + line_offset;
+    TextSlice fields[JOURNAL_FIELD_COUNT];
+    int count = split_fields(line, length, fields);
+    memset(record, 0, sizeof(IndexRecord));
+    record->line_offset = line_offset;
+    record->line_length = (uint32_t) length;
+    record->field_count = (uint8_t) count;
+    for (int field = 0; field < count; field++) {
+        record->field_offset[field] = (uint32_t) (fields[field].data - line);
+    }
+    record->genre_id = INDEX_GENRE_OVERFLOW;
+    if (count < 4) {
+        record->flags = INDEX_RECORD_INVALID;
+        record->start_day = DATE_NONE;
+        record->end_day = DATE_NONE;
+        return;
+    }
+    record->start_day = date_to_day_number(fields[3]);
+    record->end_day = count > 4 ? date_to_day_number(fields[4]) : DATE_NONE;
+    record->score = count > 5 && fields[5].length > 0 ? parse_score(fields[5]) : 0;
+    if (genres->count < INDEX_GENRE_OVERFLOW || genre_dictionary_find(genres, fields[2]) != GENRE_NONE) {
+        uint32_t id = genre_dictionary_intern(genres, fields[2]);
+        if (id < INDEX_GENRE_OVERFLOW) record->genre_id = (uint16_t) id;
+    }
+}
+
+/**
+ * @brief Writes the genre table and the per-genre posting lists of a new index.
+ *
+ * @param file The index file, positioned after the records.
+ * @param header The header being built. Section offsets are stored into it.
+ * @param genres The genres of the index, their IDs are the table positions.
+ * @param buckets Posting list of every record: its genre ID, `genres->count` for invalid lines or
+ *                `UINT32_MAX` for genres that did not fit into the table.
+ *
+ * @return True if everything was written.
+ */
+bool write_index_postings(FILE *file, IndexHeader *header, const GenreDictionary *genres, const uint32_t *buckets) {
+    long position = ftell(file);
+    if (position < 0) return false;
+    header->genre_table_offset = (uint64_t) position;
+    header->genre_count = (uint32_t) genres->count;
+    bool ok = true;
+    for (size_t id = 0; ok && id < genres->count; id++) {
+        uint32_t length = (uint32_t) genres->names[id].length;
+        ok = fwrite(&length, sizeof(uint32_t), 1, file) == 1 &&
+             fwrite(genres->names[id].data, 1, length, file) == length;
+        position += sizeof(uint32_t) + length;
+    }
+    static const char padding[8] = {0};
+    size_t padding_length = (8 - position % 8) % 8;
+    ok = ok && fwrite(padding, 1, padding_length, file) == padding_length;
+    header->postings_offset = (uint64_t) position + padding_length;
+
+    // Counting sort of record numbers by bucket, the lists stay in file order
+    size_t list_count = genres->count + 1;
+    uint64_t *starts = calloc(list_count + 1, sizeof(uint64_t));
+    uint32_t *postings = malloc((header->record_count > 0 ? header->record_count : 1) * sizeof(uint32_t));
+    if (starts == NULL || postings == NULL) {
+        free(starts);
+        free(postings);
+        return false;
+    }
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        if (buckets[i] != UINT32_MAX) starts[buckets[i] + 1]++;
+    }
+    for (size_t list = 0; list < list_count; list++) starts[list + 1] += starts[list];
+    uint64_t *next = malloc(list_count * sizeof(uint64_t));
+    if (next == NULL) {
+        free(starts);
+        free(postings);
+        return false;
+    }
+    memcpy(next, starts, list_count * sizeof(uint64_t));
+    for (uint64_t i = 0; i < header->record_count; i++) {
+        if (buckets[i] != UINT32_MAX) postings[next[buckets[i]]++] = (uint32_t) i;
+    }
+    ok = ok && fwrite(starts, sizeof(uint64_t), list_count + 1, file) == list_count + 1 &&
+         fwrite(postings, sizeof(uint32_t), starts[list_count], file) == starts[list_count];
+    free(next);
+    free(starts);
+    free(postings);
+    return ok;
+}
+
+/**
+ * @brief Writes the start date order of a new index.
+ *
+ * The dates are collected in record order and sorted by a stable radix sort on the day, so records with the
+ * same start date stay in file order.
+ *
+ * @param file The index file, positioned after the posting lists.
+ * @param header The header being built. The section offset and size are stored into it.
+ * @param dates The start date of every valid record that has one, in record order. Used as scratch space.
+ * @param count Number of dates.
+ *
+ * @return True if everything was written.
+ */
+bool write_index_start_order(FILE *file, IndexHeader *header, IndexDateEntry *dates, size_t count) {
+    long position = ftell(file);
+    if (position < 0) return false;
+    static const char padding[8] = {0};
+    size_t padding_length = (8 - position % 8) % 8;
+    bool ok = fwrite(padding, 1, padding_length, file) == padding_length;
+    header->start_order_offset = (uint64_t) position + padding_length;
+    header->start_order_count = count;
+
+    IndexDateEntry *scratch = malloc((count > 0 ? count : 1) * sizeof(IndexDateEntry));
+    if (scratch == NULL) return false;
+    IndexDateEntry *current = dates;
+    IndexDateEntry *next = scratch;
+    // One pass per byte of the day, biased so negative days sort first. Bytes all days share are skipped.
+    for (int shift = 0; shift < 32; shift += 8) {
+        size_t starts[257] = {0};
+        for (size_t i = 0; i < count; i++) {
+            starts[((((uint32_t) current[i].day ^ 0x80000000u) >> shift) & 0xffu) + 1]++;
+        }
+        bool shared = false;
+        for (size_t byte = 0; byte < 256; byte++) {
+            shared = shared || starts[byte + 1] == count;
+            starts[byte + 1] += starts[byte];
+        }
+        if (shared) continue;
+        for (size_t i = 0; i < count; i++) {
+            next[starts[(((uint32_t) current[i].day ^ 0x80000000u) >> shift) & 0xffu]++] = current[i];
+        }
+        IndexDateEntry *sorted = next;
+        next = current;
+        current = sorted;
+    }
+    ok = ok && fwrite(current, sizeof(IndexDateEntry), count, file) == count;
+    free(scratch);
+    return ok;
+}
+
+/**
+ * @brief Builds the sidecar index of the mapped journal.
+ *
+ * The index is written to a temporary file and renamed over `JOURNAL_INDEX_FILE`, so readers never see a
+ * partially written index. Records are streamed to the file, only the posting bucket and the start date
+ * of every record (12 bytes per line) and the interned genres are kept in memory.
+ *
+ * @param journal The mapped journal to describe.
+ *
+ * @return True if the index was written, false on an I/O error (which is reported).
+ */
+bool build_journal_index(const MappedJournal *journal) {
+    const char *temp_path = JOURNAL_INDEX_FILE ".tmp";
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        perror("Failed to create journal index");
+        return false;
+    }
+    IndexHeader header;
+    memset(&header, 0, sizeof(IndexHeader));
+    header.magic = JOURNAL_INDEX_MAGIC;
+    header.version = JOURNAL_INDEX_VERSION;
+    header.journal_size = journal->size;
+    header.journal_mtime_sec = journal->file_stat.st_mtim.tv_sec;
+    header.journal_mtime_nsec = journal->file_stat.st_mtim.tv_nsec;
+    bool ok = fwrite(&header, sizeof(IndexHeader), 1, file) == 1;
+
+    GenreDictionary genres;
+    memset(&genres, 0, sizeof(GenreDictionary));
+    uint32_t *buckets = NULL;
+    IndexDateEntry *dates = NULL;
+    size_t bucket_capacity = 0;
+    size_t date_count = 0;
+    size_t offset = 0;
+    IndexRecord record;
+    while (ok && offset < journal->size) {
+        const char *newline = memchr(journal->data + offset, '\n', journal->size - offset);
+        size_t line_end = newline != NULL ? (size_t) (newline - journal->data) : journal->size;
+        fill_index_record(&record, journal->data, offset, line_end - offset, &genres);
+        ok = fwrite(&record, sizeof(IndexRecord), 1, file) == 1;
+        if (header.record_count == bucket_capacity) {
+            bucket_capacity = bucket_capacity == 0 ? 4096 : bucket_capacity * 2;
+            uint32_t *resized = realloc(buckets, bucket_capacity * sizeof(uint32_t));
+            if (resized != NULL) buckets = resized;
+            IndexDateEntry *resized_dates = realloc(dates, bucket_capacity * sizeof(IndexDateEntry));
+            if (resized_dates != NULL) dates = resized_dates;
+            if (resized == NULL || resized_dates == NULL) {
+                ok = false;
+                break;
+            }
+        }
+        if (!(record.flags & INDEX_RECORD_INVALID) && record.start_day != DATE_NONE) {
+            dates[date_count].day = record.start_day;
+            dates[date_count].record = (uint32_t) header.record_count;
+            date_count++;
+        }
+        // Invalid lines get their own list, stored after the genres, so they can be reported in order
+        buckets[header.record_count] = record.flags & INDEX_RECORD_INVALID ? UINT32_MAX - 1
+                                       : record.genre_id == INDEX_GENRE_OVERFLOW ? UINT32_MAX
+                                       : record.genre_id;
+        header.record_count++;
+        offset = line_end + 1;
+    }
+    for (uint64_t i = 0; ok && i < header.record_count; i++) {
+        if (buckets[i] == UINT32_MAX - 1) buckets[i] = (uint32_t) genres.count;
+    }
+    ok = ok && write_index_postings(file, &header, &genres, buckets) &&
+         write_index_start_order(file, &header, dates, date_count);
+    free(buckets);
+    free(dates);
+    genre_dictionary_free(&genres);
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(IndexHeader), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (ok && rename(temp_path, JOURNAL_INDEX_FILE) == 0) return true;
+    perror("Failed to write journal index");
+    unlink(temp_path);
+    return false;
+}
+
+/**
+ * @brief Releases an index mapped by `open_journal_index`.
+ */
+void close_journal_index(JournalIndex *index) {
+    if (index->mapping != NULL) munmap(index->mapping, index->size);
+    free(index->genre_map);
+    memset(index, 0, sizeof(JournalIndex));
+}
+
+/**
+ * @brief Interns the genre table of the index into `genre_dictionary` and remembers the ID translation.
+ *
+ * @return True on success, false if the table is corrupt or memory ran out.
+ */
+bool load_index_genres(JournalIndex *index) {
+    const IndexHeader *header = index->header;
+    index->genre_map = malloc((header->genre_count > 0 ? header->genre_count : 1) * sizeof(uint32_t));
+    if (index->genre_map == NULL) return false;
+    const char *cursor = (const char *) index->mapping + header->genre_table_offset;
+    const char *end = (const char *) index->mapping + header->postings_offset;
+    for (uint32_t id = 0; id < header->genre_count; id++) {
+        uint32_t length;
+        if ((size_t) (end - cursor) < sizeof(uint32_t)) return false;
+        memcpy(&length, cursor, sizeof(uint32_t));
+        cursor += sizeof(uint32_t);
+        if ((size_t) (end - cursor) < length) return false;
+        TextSlice name = {cursor, length};
+        index->genre_map[id] = genre_dictionary_intern(&genre_dictionary, name);
+        cursor += length;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps the sidecar index if it exists and is up to date with the journal.
+ *
+ * @param journal The mapped journal the index has to describe.
+ * @param index Receives the mapped index. On success it must be released with `close_journal_index`.
+ *
+ * @return True if a valid and current index was mapped, false if it is missing, corrupt or stale.
+ */
+bool open_journal_index(const MappedJournal *journal, JournalIndex *index) {
+    memset(index, 0, sizeof(JournalIndex));
+    int fd = open(JOURNAL_INDEX_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    index->mapping = mapping;
+    index->size = st.st_size;
+    index->header = mapping;
+    index->records = (const IndexRecord *) ((const char *) mapping + sizeof(IndexHeader));
+    const IndexHeader *header = index->header;
+    bool valid = index_matches_journal(header, journal) &&
+                 header->genre_table_offset == sizeof(IndexHeader) + header->record_count * sizeof(IndexRecord) &&
+                 header->postings_offset >= header->genre_table_offset && header->postings_offset % 8 == 0 &&
+                 header->postings_offset + (header->genre_count + 2) * sizeof(uint64_t) <= index->size;
+    if (valid) {
+        index->posting_starts = (const uint64_t *) ((const char *) mapping + header->postings_offset);
+        index->postings = (const uint32_t *) (index->posting_starts + header->genre_count + 2);
+        size_t postings_end = header->postings_offset + (header->genre_count + 2) * sizeof(uint64_t) +
+                              index->posting_starts[header->genre_count + 1] * sizeof(uint32_t);
+        valid = postings_end <= header->start_order_offset && header->start_order_offset % 8 == 0 &&
+                header->start_order_count <= header->record_count &&
+                header->start_order_offset + header->start_order_count * sizeof(IndexDateEntry) <= index->size &&
+                load_index_genres(index);
+        index->start_order = (const IndexDateEntry *) ((const char *) mapping + header->start_order_offset);
+    }
+    if (!valid) {
+        close_journal_index(index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps the sidecar index, rebuilding it first if it does not match the journal anymore.
+ *
+ * @return True if an index describing the journal is mapped, otherwise false.
+ */
+bool load_journal_index(const MappedJournal *journal, JournalIndex *index) {
+    if (open_journal_index(journal, index)) return true;
+    return build_journal_index(journal) && open_journal_index(journal, index);
+}
+
+/**
+ * @brief Rebuilds the entry view of an indexed line without tokenizing it.
+ *
+ * The score and the day numbers of the dates are taken from the record, the genre is the interned copy from
+ * `genre_dictionary`.
+ */
+void entry_from_index_record(const char *data, const JournalIndex *index, const IndexRecord *record,
+                             JournalEntry *entry) {
+    const char *line = data + record->line_offset;
+    reset_entry(entry);
+    for (int field = 0; field < record->field_count; field++) {
+        if (field == 5) continue;
+        uint32_t end = field + 1 < record->field_count ? record->field_offset[field + 1] - 1 : record->line_length;
+        TextSlice token = {line + record->field_offset[field], end - record->field_offset[field]};
+        if (field == 3) {
+            entry->start_date = token;
+        } else if (field == 4) {
+            if (token.length > 0) entry->end_date = token;
+        } else {
+            set_entry_field(entry, field, token);
+        }
+    }
+    entry->start_day = record->start_day;
+    entry->end_day = record->end_day;
+    entry->score = record->score;
+    entry->id = record->line_offset;
+    if (list_show_ids) entry->id_check = hash_slice((TextSlice) {line, record->line_length});
+    uint32_t genre_id = record->genre_id != INDEX_GENRE_OVERFLOW ? index->genre_map[record->genre_id] : GENRE_NONE;
+    if (genre_id != GENRE_NONE) {
+        entry->genre = genre_dictionary.names[genre_id];
+        entry->genre_id = genre_id;
+    } else {
+        intern_entry_genre(entry);
+    }
+}
+
+/**
+ * @brief Lists entries of the journal described by the sidecar index.
+ *
+ * Records come from the fixed-width index array, the mapped journal is only read for the text of the
+ * fields. Entries are filtered in blocks like in `list_mapped_entries`.
+ */
+void list_indexed_entries(const MappedJournal *journal, const JournalIndex *index, const JournalFilter *filter,
+                          ListCounts *counts, ListSink *sink) {
+    EntryBlock *block = malloc(sizeof(EntryBlock));
+    if (block == NULL) {
+        perror("Failed to allocate memory for journal entries");
+        return;
+    }
+    FilterStats stats;
+    init_filter_stats(&stats, filter);
+    block->count = 0;
+    block->partial = false;
+    for (uint64_t i = 0; i < index->header->record_count; i++) {
+        const IndexRecord *record = &index->records[i];
+        if (record->flags & INDEX_RECORD_INVALID) {
+            flush_entry_block(block, filter, &stats, counts, sink);
+            report_invalid_line(sink->out, journal->data + record->line_offset, record->line_length);
+            continue;
+        }
+        entry_from_index_record(journal->data, index, record, &block->entries[block->count]);
+        if (++block->count == LIST_BLOCK_SIZE) flush_entry_block(block, filter, &stats, counts, sink);
+    }
+    flush_entry_block(block, filter, &stats, counts, sink);
+    free(block);
+}
+
+/**
+ * @brief Finds the posting list of a genre in the index.
+ *
+ * @param index The mapped index.
+ * @param genre_id ID of the genre in `genre_dictionary`.
+ * @param list Receives the position of the list in `posting_starts`. Genres that do not occur in the
+ *             journal get the empty list past the invalid lines.
+ *
+ * @return True if the posting list is complete, false if the genre may be among the genres that did not
+ *         fit into the index table (the records must be scanned then).
+ */
+bool find_genre_postings(const JournalIndex *index, uint32_t genre_id, uint32_t *list) {
+    for (uint32_t id = 0; genre_id != GENRE_NONE && id < index->header->genre_count; id++) {
+        if (index->genre_map[id] == genre_id) {
+            *list = id;
+            return true;
+        }
+    }
+    *list = index->header->genre_count + 1;
+    return index->header->genre_count < INDEX_GENRE_OVERFLOW;
+}
+
+/**
+ * @brief Finds the records whose start date lies in a range, using the start date order of the index.
+ *
+ * @return The position of the first entry of the order in the range. `*end` receives the position after
+ *         the last one.
+ */
+size_t find_start_range(const JournalIndex *index, int32_t min_day, int32_t max_day, size_t *end) {
+    const IndexDateEntry *order = index->start_order;
+    size_t low = 0;
+    size_t high = index->header->start_order_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (order[middle].day < min_day) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    size_t first = low;
+    high = index->header->start_order_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (order[middle].day <= max_day) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *end = low;
+    return first;
+}
+
+/**
+ * @brief Chooses the records of the index which have to be checked for a filter, instead of all of them.
+ *
+ * A genre the filter requires gives its posting list, a start date range it requires gives a range of the
+ * start date order. When both apply, the shorter one is used. The records of a date range are in date order,
+ * so they are put back into file order by marking them in a bitmap, which costs one bit per record instead
+ * of a sort.
+ *
+ * @param index The mapped index.
+ * @param filter The compiled filter.
+ * @param candidates Receives the record numbers, in ascending order.
+ * @param count Receives the number of records.
+ * @param owned Receives the list if it was allocated for the query and must be freed, otherwise NULL.
+ *
+ * @return True if a list was chosen, false if all records have to be scanned.
+ */
+bool find_index_candidates(const JournalIndex *index, const JournalFilter *filter, const uint32_t **candidates,
+                           size_t *count, uint32_t **owned) {
+    *owned = NULL;
+    bool found = false;
+    uint32_t genre_list;
+    uint32_t genre_id = filter_required_genre(filter);
+    if (genre_id != GENRE_NONE && find_genre_postings(index, genre_id, &genre_list)) {
+        const uint64_t *starts = index->posting_starts;
+        bool listed = genre_list <= index->header->genre_count;
+        *candidates = index->postings + (listed ? starts[genre_list] : 0);
+        *count = listed ? starts[genre_list + 1] - starts[genre_list] : 0;
+        found = true;
+    }
+    int32_t min_day;
+    int32_t max_day;
+    if (!filter_required_start_range(filter, &min_day, &max_day)) return found;
+    size_t range_end;
+    size_t range_start = find_start_range(index, min_day, max_day, &range_end);
+    size_t range_count = range_end - range_start;
+    if (found && *count <= range_count) return true;
+
+    uint64_t record_count = index->header->record_count;
+    uint64_t *bitmap = calloc(record_count / 64 + 1, sizeof(uint64_t));
+    uint32_t *records = malloc((range_count > 0 ? range_count : 1) * sizeof(uint32_t));
+    if (bitmap == NULL || records == NULL) {
+        free(bitmap);
+        free(records);
+        return found;
+    }
+    for (size_t i = range_start; i < range_end; i++) {
+        uint32_t record = index->start_order[i].record;
+        bitmap[record / 64] |= (uint64_t) 1 << (record % 64);
+    }
+    size_t used = 0;
+    for (uint64_t word = 0; word <= record_count / 64; word++) {
+        for (uint64_t bits = bitmap[word]; bits != 0; bits &= bits - 1) {
+            records[used++] = (uint32_t) (word * 64 + (uint64_t) __builtin_ctzll(bits));
+        }
+    }
+    free(bitmap);
+    *candidates = records;
+    *count = used;
+    *owned = records;
+    return true;
+}
+
+/**
+ * @brief Lists the entries of a list of candidate records instead of all records.
+ *
+ * Used when the filter requires a genre or a start date range (`find_index_candidates`). The whole filter
+ * is evaluated only for the candidates.
+ *
+ * The candidates are merged with the posting list of invalid lines, so invalid lines are reported at the
+ * same place as in a full scan. The total of valid entries is known from the list sizes.
+ */
+void list_index_candidates(const MappedJournal *journal, const JournalIndex *index, const uint32_t *candidates,
+                           size_t count, const JournalFilter *filter, ListCounts *counts, ListSink *sink) {
+    const uint64_t *starts = index->posting_starts;
+    uint32_t invalid_list = index->header->genre_count;
+    const uint32_t *matches = candidates;
+    const uint32_t *matches_end = candidates + count;
+    const uint32_t *invalid = index->postings + starts[invalid_list];
+    const uint32_t *invalid_end = index->postings + starts[invalid_list + 1];
+    counts->total += index->header->record_count - (uint64_t) (invalid_end - invalid);
+
+    JournalEntry entry;
+    while (matches < matches_end || invalid < invalid_end) {
+        if (invalid < invalid_end && (matches == matches_end || *invalid < *matches)) {
+            const IndexRecord *record = &index->records[*invalid++];
+            report_invalid_line(sink->out, journal->data + record->line_offset, record->line_length);
+        } else {
+            entry_from_index_record(journal->data, index, &index->records[*matches++], &entry);
+            if (!filter_matches(filter, &entry)) continue;
+            emit_entry(sink, &entry);
+            counts->listed++;
+        }
+    }
+}
+
+/**
+ * @brief Replaces a file with a temporary file, used for files derived from the journal.
+ *
+ * @return The descriptor of the temporary file, whose path is stored into `temp_path`, or -1 on error.
+ */
+int create_temp_file(const char *path, char *temp_path, size_t size) {
+    snprintf(temp_path, size, "%s.XXXXXX", path);
+    int fd = mkstemp(temp_path);
+    if (fd >= 0 && fchmod(fd, 0644) != 0) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Orders author IDs of a dictionary by their names for `qsort_r`.
+ */
+int compare_author_ids(const void *a, const void *b, void *context) {
+    const GenreDictionary *authors = context;
+    return compare_author_names(authors->names[*(const uint32_t *) a], authors->names[*(const uint32_t *) b], false);
+}
+
+/**
+ * @brief Builds the author index of the journal and starts an empty delta for it.
+ *
+ * Normalized authors are interned into a local dictionary while the journal is tokenized, then their IDs
+ * are sorted by name and the line offsets are distributed to the posting lists by a counting sort, so every
+ * list stays in journal order. The index is written to a temporary file and renamed.
+ *
+ * @param journal The mapped journal to index.
+ *
+ * @return True if the index was written, false on an error (which is reported).
+ */
+bool build_author_index(const MappedJournal *journal) {
+    GenreDictionary authors;
+    memset(&authors, 0, sizeof(GenreDictionary));
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    uint64_t *offsets = NULL;
+    uint32_t *line_authors = NULL;
+    char *name = NULL;
+    size_t name_capacity = 0;
+    size_t line_count = 0;
+    size_t line_capacity = 0;
+    AuthorIndexHeader header;
+    memset(&header, 0, sizeof(AuthorIndexHeader));
+    bool ok = tokenizer != NULL;
+    if (ok) init_line_tokenizer(tokenizer, journal->data, journal->data + journal->size, select_delimiter_scanner());
+    TokenizedLine line;
+    while (ok && next_tokenized_line(tokenizer, &line)) {
+        if (line_count == line_capacity) {
+            line_capacity = line_capacity == 0 ? 4096 : line_capacity * 2;
+            uint64_t *resized = realloc(offsets, line_capacity * sizeof(uint64_t));
+            if (resized != NULL) offsets = resized;
+            uint32_t *resized_authors = realloc(line_authors, line_capacity * sizeof(uint32_t));
+            if (resized_authors != NULL) line_authors = resized_authors;
+            ok = resized != NULL && resized_authors != NULL;
+        }
+        if (ok && line.field_count >= 4 && (name == NULL || line.fields[1].length > name_capacity)) {
+            name_capacity = line.fields[1].length * 2 + 64;
+            char *resized = realloc(name, name_capacity);
+            if (resized != NULL) name = resized;
+            ok = resized != NULL;
+        }
+        if (!ok) break;
+        offsets[line_count] = (uint64_t) (line.data - journal->data);
+        if (line.field_count < 4) {
+            line_authors[line_count++] = UINT32_MAX;
+            header.invalid_count++;
+            continue;
+        }
+        TextSlice normalized = {name, normalize_author_name(line.fields[1], name)};
+        line_authors[line_count] = genre_dictionary_intern(&authors, normalized);
+        ok = line_authors[line_count++] != GENRE_NONE;
+    }
+    free(tokenizer);
+    free(name);
+
+    // Ranks of the authors in name order, then a counting sort of the lines by rank
+    size_t author_count = authors.count;
+    uint32_t *order = ok ? malloc((author_count + 1) * sizeof(uint32_t)) : NULL;
+    uint32_t *ranks = ok ? malloc((author_count + 1) * sizeof(uint32_t)) : NULL;
+    uint64_t *name_starts = ok ? calloc(author_count + 1, sizeof(uint64_t)) : NULL;
+    uint64_t *starts = ok ? calloc(author_count + 1, sizeof(uint64_t)) : NULL;
+    uint64_t *postings = ok ? malloc((line_count + 1) * sizeof(uint64_t)) : NULL;
+    ok = ok && order != NULL && ranks != NULL && name_starts != NULL && starts != NULL && postings != NULL;
+    if (ok) {
+        for (uint32_t id = 0; id < author_count; id++) order[id] = id;
+        qsort_r(order, author_count, sizeof(uint32_t), compare_author_ids, &authors);
+        for (size_t rank = 0; rank < author_count; rank++) {
+            ranks[order[rank]] = (uint32_t) rank;
+            name_starts[rank + 1] = name_starts[rank] + authors.names[order[rank]].length;
+        }
+        for (size_t i = 0; i < line_count; i++) {
+            if (line_authors[i] != UINT32_MAX) starts[ranks[line_authors[i]] + 1]++;
+        }
+        for (size_t rank = 0; rank < author_count; rank++) starts[rank + 1] += starts[rank];
+        header.entry_count = starts[author_count];
+        // `ranks` becomes the next free position of each author, invalid lines go after the postings
+        for (uint32_t id = 0; id < author_count; id++) ranks[id] = (uint32_t) starts[ranks[id]];
+        size_t invalid = header.entry_count;
+        for (size_t i = 0; i < line_count; i++) {
+            postings[line_authors[i] != UINT32_MAX ? ranks[line_authors[i]]++ : invalid++] = offsets[i];
+        }
+    }
+
+    char temp_path[64];
+    int fd = ok ? create_temp_file(JOURNAL_AUTHOR_FILE, temp_path, sizeof(temp_path)) : -1;
+    header.magic = JOURNAL_AUTHOR_MAGIC;
+    header.version = JOURNAL_AUTHOR_VERSION;
+    header.journal_inode = journal->file_stat.st_ino;
+    header.journal_size = journal->size;
+    header.journal_mtime_sec = journal->file_stat.st_mtim.tv_sec;
+    header.journal_mtime_nsec = journal->file_stat.st_mtim.tv_nsec;
+    header.author_count = author_count;
+    header.names_size = ok ? name_starts[author_count] : 0;
+    if (fd >= 0) {
+        OutputBuffer out;
+        output_init(&out, fd);
+        output_bytes(&out, (const char *) &header, sizeof(AuthorIndexHeader));
+        output_bytes(&out, (const char *) name_starts, (author_count + 1) * sizeof(uint64_t));
+        output_bytes(&out, (const char *) starts, (author_count + 1) * sizeof(uint64_t));
+        output_bytes(&out, (const char *) postings, line_count * sizeof(uint64_t));
+        for (size_t rank = 0; rank < author_count; rank++) output_slice(&out, authors.names[order[rank]]);
+        output_free(&out);
+        ok = !out.failed;
+        ok = close(fd) == 0 && ok;
+        if (ok) ok = rename(temp_path, JOURNAL_AUTHOR_FILE) == 0;
+        else unlink(temp_path);
+    } else {
+        ok = false;
+    }
+    free(offsets);
+    free(line_authors);
+    free(order);
+    free(ranks);
+    free(name_starts);
+    free(starts);
+    free(postings);
+    genre_dictionary_free(&authors);
+
+    // The delta starts empty and identifies the index it belongs to
+    fd = ok ? create_temp_file(JOURNAL_AUTHOR_DELTA_FILE, temp_path, sizeof(temp_path)) : -1;
+    if (fd >= 0) {
+        AuthorDeltaHeader delta_header = {JOURNAL_AUTHOR_DELTA_MAGIC, JOURNAL_AUTHOR_VERSION, header.journal_size,
+                                          header.journal_mtime_sec, header.journal_mtime_nsec};
+        ok = write(fd, &delta_header, sizeof(delta_header)) == sizeof(delta_header);
+        ok = close(fd) == 0 && ok && rename(temp_path, JOURNAL_AUTHOR_DELTA_FILE) == 0;
+        if (!ok) unlink(temp_path);
+    } else {
+        ok = false;
+    }
+    if (!ok) perror("Failed to write author index");
+    return ok;
+}
+
+/**
+ * @brief Releases an author index opened by `open_author_index`.
+ */
+void close_author_index(AuthorIndex *index) {
+    if (index->mapping != NULL) munmap(index->mapping, index->size);
+    free(index->delta);
+    memset(index, 0, sizeof(AuthorIndex));
+}
+
+/**
+ * @brief Reads the delta of a mapped author index and checks that together they cover the journal.
+ *
+ * The records must follow the lines of the index in journal order, and the last one must end where the
+ * journal ends and carry its modification time.
+ *
+ * @return True if the index and its delta describe the journal as it is now.
+ */
+bool load_author_delta(AuthorIndex *index, const MappedJournal *journal) {
+    int fd = open(JOURNAL_AUTHOR_DELTA_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    AuthorDeltaHeader header;
+    bool ok = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(AuthorDeltaHeader) &&
+              (st.st_size - sizeof(AuthorDeltaHeader)) % sizeof(AuthorDeltaRecord) == 0 &&
+              read(fd, &header, sizeof(header)) == sizeof(header);
+    index->delta_count = ok ? (st.st_size - sizeof(AuthorDeltaHeader)) / sizeof(AuthorDeltaRecord) : 0;
+    size_t delta_size = index->delta_count * sizeof(AuthorDeltaRecord);
+    ok = ok && (index->delta = malloc(delta_size > 0 ? delta_size : 1)) != NULL &&
+         read(fd, index->delta, delta_size) == (ssize_t) delta_size;
+    close(fd);
+    if (!ok || header.magic != JOURNAL_AUTHOR_DELTA_MAGIC || header.version != JOURNAL_AUTHOR_VERSION ||
+        header.journal_size != index->header->journal_size ||
+        header.journal_mtime_sec != index->header->journal_mtime_sec ||
+        header.journal_mtime_nsec != index->header->journal_mtime_nsec) {
+        return false;
+    }
+    uint64_t end = header.journal_size;
+    AuthorDeltaRecord last = {0, 0, 0, header.journal_mtime_sec, header.journal_mtime_nsec};
+    for (size_t i = 0; i < index->delta_count; i++) {
+        last = index->delta[i];
+        if (last.line_offset < end) return false;
+        end = last.line_offset + last.line_length + 1;
+    }
+    return end == journal->size && last.journal_mtime_sec == journal->file_stat.st_mtim.tv_sec &&
+           last.journal_mtime_nsec == journal->file_stat.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Maps the author index and reads its delta.
+ *
+ * @return True if the index and its delta describe the journal as it is now, otherwise false.
+ */
+bool open_author_index(const MappedJournal *journal, AuthorIndex *index) {
+    memset(index, 0, sizeof(AuthorIndex));
+    int fd = open(JOURNAL_AUTHOR_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(AuthorIndexHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    index->mapping = mapping;
+    index->size = st.st_size;
+    index->header = mapping;
+    const AuthorIndexHeader *header = index->header;
+    size_t available = (index->size - sizeof(AuthorIndexHeader)) / sizeof(uint64_t);
+    bool valid = header->magic == JOURNAL_AUTHOR_MAGIC && header->version == JOURNAL_AUTHOR_VERSION &&
+                 header->journal_inode == (uint64_t) journal->file_stat.st_ino &&
+                 header->journal_size <= journal->size && header->author_count < available / 2 &&
+                 header->entry_count + header->invalid_count <= available - 2 * (header->author_count + 1) &&
+                 index->size == sizeof(AuthorIndexHeader) +
+                                (2 * (header->author_count + 1) + header->entry_count + header->invalid_count) *
+                                sizeof(uint64_t) + header->names_size;
+    if (valid) {
+        index->name_starts = (const uint64_t *) ((const char *) mapping + sizeof(AuthorIndexHeader));
+        index->posting_starts = index->name_starts + header->author_count + 1;
+        index->postings = index->posting_starts + header->author_count + 1;
+        index->invalid = index->postings + header->entry_count;
+        index->names = (const char *) (index->invalid + header->invalid_count);
+        valid = index->name_starts[header->author_count] == header->names_size &&
+                index->posting_starts[header->author_count] == header->entry_count;
+        for (size_t author = 0; valid && author < header->author_count; author++) {
+            valid = index->name_starts[author] <= index->name_starts[author + 1] &&
+                    index->posting_starts[author] <= index->posting_starts[author + 1];
+        }
+        valid = valid && load_author_delta(index, journal);
+    }
+    if (!valid) {
+        close_author_index(index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Maps the author index, rebuilding it first if it is missing or stale, or if its delta grew large.
+ *
+ * The delta is merged into the index by the rebuild, once it has more than `AUTHOR_DELTA_MERGE_LINES`
+ * lines and more than an eighth of the lines of the index.
+ *
+ * @return True if an index describing the journal is mapped, otherwise false.
+ */
+bool load_author_index(const MappedJournal *journal, AuthorIndex *index) {
+    if (open_author_index(journal, index)) {
+        uint64_t indexed = index->header->entry_count + index->header->invalid_count;
+        if (index->delta_count <= AUTHOR_DELTA_MERGE_LINES || index->delta_count <= indexed / 8) return true;
+        close_author_index(index);
+    }
+    return build_author_index(journal) && open_author_index(journal, index);
+}
+
+/**
+ * @brief Returns the author name at a position of the sorted table of the index.
+ */
+TextSlice author_index_name(const AuthorIndex *index, size_t author) {
+    TextSlice name = {index->names + index->name_starts[author],
+                      index->name_starts[author + 1] - index->name_starts[author]};
+    return name;
+}
+
+/**
+ * @brief Finds the authors of the index matching an author predicate by a binary search in the sorted table.
+ *
+ * @return The position of the first matching author, `*end` receives the position after the last one.
+ */
+size_t find_author_range(const AuthorIndex *index, const FilterPredicate *predicate, size_t *end) {
+    size_t low = 0;
+    size_t high = index->header->author_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (compare_author_names(author_index_name(index, middle), predicate->author, false) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    bool prefix = predicate->kind == FILTER_AUTHOR_PREFIX;
+    size_t last = low;
+    while (last < index->header->author_count &&
+           compare_author_names(author_index_name(index, last), predicate->author, prefix) == 0) {
+        last++;
+        if (!prefix) break;
+    }
+    *end = last;
+    return low;
+}
+
+/**
+ * @brief Orders line offsets for `qsort`.
+ */
+int compare_offsets(const void *a, const void *b) {
+    uint64_t left = *(const uint64_t *) a;
+    uint64_t right = *(const uint64_t *) b;
+    return (left > right) - (left < right);
+}
+
+/**
+ * @brief Lists the journal line at an offset if it is an entry matching the filter.
+ *
+ * @return False if the line is invalid, which is reported.
+ */
+bool list_journal_line(const MappedJournal *journal, uint64_t offset, const JournalFilter *filter,
+                       ListCounts *counts, ListSink *sink) {
+    const char *line = journal->data + offset;
+    const char *newline = memchr(line, '\n', journal->size - offset);
+    size_t length = (newline != NULL ? newline : journal->data + journal->size) - line;
+    JournalEntry entry;
+    if (!parse_entry(line, length, &entry)) {
+        report_invalid_line(sink->out, line, length);
+        return false;
+    }
+    entry.id = offset;
+    if (list_show_ids) entry.id_check = hash_slice((TextSlice) {line, length});
+    if (filter_matches(filter, &entry)) {
+        emit_entry(sink, &entry);
+        counts->listed++;
+    }
+    return true;
+}
+
+/**
+ * @brief Lists the entries of the authors a filter requires, looked up in the author index.
+ *
+ * The posting lists of the matching authors (one for `--author`, a range of the table for
+ * `--author-prefix`) are merged in journal order with the list of invalid lines, so invalid lines are
+ * reported at the same place as in a full scan. Only those lines are parsed and checked by the whole filter.
+ * Lines of the delta are checked afterwards, those whose author hash differs from the query are skipped
+ * without reading them.
+ *
+ * @param predicate The author predicate of the filter, see `filter_required_author`.
+ */
+void list_author_entries(const MappedJournal *journal, const AuthorIndex *index, const FilterPredicate *predicate,
+                         const JournalFilter *filter, ListCounts *counts, ListSink *sink) {
+    ProfilePhase previous = profile_enter(PROFILE_LOAD);
+    size_t end;
+    size_t first = find_author_range(index, predicate, &end);
+    const uint64_t *matches = index->postings + index->posting_starts[first];
+    const uint64_t *matches_end = index->postings + index->posting_starts[end];
+    uint64_t *merged = NULL;
+    if (end - first > 1) {
+        // Lists of several authors are merged into journal order
+        size_t count = matches_end - matches;
+        merged = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+        if (merged == NULL) {
+            perror("Failed to allocate memory for author postings");
+            profile_enter(previous);
+            return;
+        }
+        memcpy(merged, matches, count * sizeof(uint64_t));
+        qsort(merged, count, sizeof(uint64_t), compare_offsets);
+        matches = merged;
+        matches_end = merged + count;
+    }
+    const uint64_t *invalid = index->invalid;
+    const uint64_t *invalid_end = index->invalid + index->header->invalid_count;
+    counts->total += index->header->entry_count;
+    while (matches < matches_end || invalid < invalid_end) {
+        bool is_invalid = invalid < invalid_end && (matches == matches_end || *invalid < *matches);
+        list_journal_line(journal, is_invalid ? *invalid++ : *matches++, filter, counts, sink);
+    }
+    free(merged);
+
+    uint32_t hash = author_name_hash(predicate->author);
+    for (size_t i = 0; i < index->delta_count; i++) {
+        const AuthorDeltaRecord *record = &index->delta[i];
+        if (record->author_hash != 0 && record->author_hash != hash && predicate->kind == FILTER_AUTHOR) {
+            counts->total++;
+            continue;
+        }
+        counts->total += list_journal_line(journal, record->line_offset, filter, counts, sink);
+    }
+    profile_enter(previous);
+}
+
+/**
+ * @brief Upper bound of the size of `length` bytes compressed by `lz_compress`.
+ */
+size_t lz_compress_bound(size_t length) {
+    return length + length / 255 + 16;
+}
+
+/**
+ * @brief Appends the rest of a length which does not fit into its 4 bits of the token: bytes of 255 and a
+ *        last smaller byte.
+ */
+uint8_t *lz_write_length(uint8_t *out, size_t length) {
+    for (; length >= 255; length -= 255) *out++ = 255;
+    *out++ = (uint8_t) length;
+    return out;
+}
+
+/**
+ * @brief Appends one sequence of `lz_compress`: literals, then a match of earlier text.
+ *
+ * @param match_length Length of the match, 0 for the last sequence which has only literals.
+ */
+uint8_t *lz_write_sequence(uint8_t *out, const uint8_t *literals, size_t literal_length, size_t offset,
+                           size_t match_length) {
+    uint8_t *token = out++;
+    size_t match_code = match_length > 0 ? match_length - LZ_MIN_MATCH : 0;
+    *token = (uint8_t) ((literal_length < 15 ? literal_length : 15) << 4 | (match_code < 15 ? match_code : 15));
+    if (literal_length >= 15) out = lz_write_length(out, literal_length - 15);
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0) return out;
+    *out++ = (uint8_t) offset;
+    *out++ = (uint8_t) (offset >> 8);
+    if (match_code >= 15) out = lz_write_length(out, match_code - 15);
+    return out;
+}
+
+/**
+ * @brief Compresses a block of text with a small LZ77 codec.
+ *
+ * The output is a series of sequences. Each is a token byte with the number of literals in its high 4 bits
+ * and the match length minus `LZ_MIN_MATCH` in its low 4 bits (15 means the length continues in the next
+ * bytes), the literals and the distance of the match back in the text as 2 bytes. The last sequence has
+ * only literals. Matches are found through a hash table of the last position of each 4-byte sequence,
+ * which is enough for the authors, genres and dates a journal repeats on every line.
+ *
+ * @param output Receives the compressed data, it must hold `lz_compress_bound(length)` bytes.
+ *
+ * @return Size of the compressed data.
+ */
+size_t lz_compress(const uint8_t *input, size_t length, uint8_t *output) {
+    uint32_t table[1u << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+    uint8_t *out = output;
+    size_t anchor = 0;
+    size_t position = 0;
+    // Matches start before the last bytes, so reading a sequence never goes past the input
+    size_t limit = length > 12 ? length - 12 : 0;
+    while (position < limit) {
+        uint32_t sequence;
+        uint32_t previous;
+        memcpy(&sequence, input + position, sizeof(uint32_t));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = (uint32_t) position;
+        memcpy(&previous, input + candidate, sizeof(uint32_t));
+        if (candidate >= position || position - candidate > LZ_MAX_OFFSET || previous != sequence) {
+            position++;
+            continue;
+        }
+        size_t match = LZ_MIN_MATCH;
+        while (position + match < length && input[candidate + match] == input[position + match]) match++;
+        out = lz_write_sequence(out, input + anchor, position - anchor, position - candidate, match);
+        position += match;
+        anchor = position;
+    }
+    out = lz_write_sequence(out, input + anchor, length - anchor, 0, 0);
+    return (size_t) (out - output);
+}
+
+/**
+ * @brief Reads the rest of a length of `lz_compress` and adds it to `length`.
+ */
+bool lz_read_length(const uint8_t **input, const uint8_t *end, size_t *length) {
+    uint8_t byte;
+    do {
+        if (*input == end) return false;
+        byte = *(*input)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * @brief Decompresses a block of `lz_compress`.
+ *
+ * Every length and distance is checked against the input and the output, so a damaged store cannot make
+ * it read or write out of bounds.
+ *
+ * @return True if the data decompressed to exactly `output_length` bytes.
+ */
+bool lz_decompress(const uint8_t *input, size_t length, uint8_t *output, size_t output_length) {
+    const uint8_t *end = input + length;
+    uint8_t *out = output;
+    uint8_t *out_end = output + output_length;
+    while (input < end) {
+        unsigned int token = *input++;
+        size_t literal_length = token >> 4;
+        size_t match_length = (token & 15) + LZ_MIN_MATCH;
+        // Short sequence far from both ends: fixed size copies, which compile to a few moves
+        if (literal_length < 15 && match_length <= 16 && end - input >= 32 && out_end - out >= 32) {
+            memcpy(out, input, 16);
+            out += literal_length;
+            input += literal_length;
+            size_t offset = input[0] | (size_t) input[1] << 8;
+            input += 2;
+            if (offset >= 16 && offset <= (size_t) (out - output)) {
+                memcpy(out, out - offset, 16);
+                out += match_length;
+                continue;
+            }
+            if (offset == 0 || offset > (size_t) (out - output)) return false;
+            for (size_t i = 0; i < match_length; i++, out++) *out = *(out - offset);
+            continue;
+        }
+        if (literal_length == 15 && !lz_read_length(&input, end, &literal_length)) return false;
+        if (literal_length > (size_t) (end - input) || literal_length > (size_t) (out_end - out)) return false;
+        memcpy(out, input, literal_length);
+        out += literal_length;
+        input += literal_length;
+        if (out == out_end) return input == end;
+        if (end - input < 2) return false;
+        size_t offset = input[0] | (size_t) input[1] << 8;
+        input += 2;
+        if (match_length == 15 + LZ_MIN_MATCH && !lz_read_length(&input, end, &match_length)) return false;
+        if (offset == 0 || offset > (size_t) (out - output) || match_length > (size_t) (out_end - out)) return false;
+        const uint8_t *match = out - offset;
+        if (offset >= match_length) {
+            memcpy(out, match, match_length);
+            out += match_length;
+        } else {
+            // The match overlaps the text it produces, e.g. a run of one byte
+            for (size_t i = 0; i < match_length; i++) *out++ = match[i];
+        }
+    }
+    return out == out_end;
+}
+
+/**
+ * @brief Checksum of a compressed block. It hashes 8 bytes at a time, so it costs little next to the
+ *        decompression.
+ */
+uint64_t store_checksum(const uint8_t *data, size_t length) {
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ length;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(uint64_t));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++) hash = (hash ^ data[i]) * 0x100000001b3ull;
+    return hash ^ (hash >> 32);
+}
+
+/**
+ * @brief Starts the zone map of an empty block of the compressed store.
+ */
+void init_store_block(StoreBlock *block, uint64_t text_offset) {
+    memset(block, 0, sizeof(StoreBlock));
+    block->text_offset = text_offset;
+    block->min_score = UINT32_MAX;
+    block->min_start_day = INT32_MAX;
+    block->max_start_day = INT32_MIN;
+    block->min_end_day = INT32_MAX;
+    block->max_end_day = INT32_MIN;
+}
+
+/**
+ * @brief Adds a journal line to the zone map of a block, as the list filters see it.
+ */
+void add_store_line(StoreBlock *block, const TextSlice *fields, int count, GenreDictionary *genres) {
+    if (count < 4) {
+        block->invalid_count++;
+        return;
+    }
+    JournalEntry entry;
+    entry_from_fields(&entry, fields, count);
+    pack_entry_days(&entry, FILTER_NEEDS_START_DAY | FILTER_NEEDS_END_DAY);
+    block->record_count++;
+    if (filter_if_reading(&entry)) {
+        block->reading_count++;
+    } else {
+        block->completed_count++;
+    }
+    if (entry.score < block->min_score) block->min_score = entry.score;
+    if (entry.score > block->max_score) block->max_score = entry.score;
+    if (entry.start_day < block->min_start_day) block->min_start_day = entry.start_day;
+    if (entry.start_day > block->max_start_day) block->max_start_day = entry.start_day;
+    if (entry.end_day < block->min_end_day) block->min_end_day = entry.end_day;
+    if (entry.end_day > block->max_end_day) block->max_end_day = entry.end_day;
+    uint32_t id = genre_dictionary_intern(genres, entry.genre);
+    block->genre_bits |= 1ull << (id < STORE_GENRE_BITS ? id : STORE_GENRE_BITS);
+}
+
+/**
+ * @brief Checks if some day of a block's range can satisfy a date range predicate.
+ */
+bool day_range_may_match(int32_t min_day, int32_t max_day, const FilterPredicate *predicate) {
+    if (predicate->negated) return min_day < predicate->min_day || max_day > predicate->max_day;
+    return max_day >= predicate->min_day && min_day <= predicate->max_day;
+}
+
+/**
+ * @brief Checks the zone map of a block against one predicate.
+ *
+ * @param genre_bit The bit of the predicate's genre in the genre bitmaps (`store_genre_bit`).
+ *
+ * @return False if no valid line of the block can satisfy the predicate.
+ */
+bool predicate_may_match_block(const FilterPredicate *predicate, const StoreBlock *block, uint64_t genre_bit) {
+    bool negated = predicate->negated;
+    switch (predicate->kind) {
+        case FILTER_GENRE:
+            // The shared bit of the genres past the bitmap cannot tell them apart
+            if (negated) return (block->genre_bits & ~genre_bit) != 0 || genre_bit == 1ull << STORE_GENRE_BITS;
+            return (block->genre_bits & genre_bit) != 0;
+        case FILTER_READING: return (negated ? block->completed_count : block->reading_count) > 0;
+        case FILTER_COMPLETED: return (negated ? block->reading_count : block->completed_count) > 0;
+        case FILTER_SCORE:
+            return negated ? block->min_score < predicate->min_score : block->max_score >= predicate->min_score;
+        case FILTER_START_RANGE: return day_range_may_match(block->min_start_day, block->max_start_day, predicate);
+        case FILTER_END_RANGE: return day_range_may_match(block->min_end_day, block->max_end_day, predicate);
+        case FILTER_AUTHOR:
+        case FILTER_AUTHOR_PREFIX:
+            // Blocks keep no summary of their authors
+            return true;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks if a block of the compressed store has to be read for a filter.
+ *
+ * @param genre_bits The genre bit of every predicate of the filter.
+ */
+bool block_may_match(const JournalFilter *filter, const StoreBlock *block, const uint64_t *genre_bits) {
+    // Invalid lines are reported by the listing, so their blocks are always read
+    if (block->invalid_count > 0) return true;
+    if (filter->matches_nothing) return false;
+    for (size_t i = 0; i < filter->count; i++) {
+        if (!predicate_may_match_block(&filter->predicates[i], block, genre_bits[i])) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Releases a store opened by `open_journal_store`.
+ */
+void close_journal_store(JournalStore *store) {
+    if (store->mapping != NULL) munmap(store->mapping, store->size);
+    memset(store, 0, sizeof(JournalStore));
+}
+
+/**
+ * @brief Maps the compressed store and checks that it belongs to the journal and is consistent.
+ *
+ * Besides the identity of the journal, the genre table is walked and the blocks must lie inside the file
+ * and cover the first `covered_size` bytes of the journal one after another, so listing from the store
+ * cannot skip or repeat a line.
+ *
+ * @return True if the store can be used for the mapped journal.
+ */
+bool open_journal_store(const MappedJournal *journal, JournalStore *store) {
+    memset(store, 0, sizeof(JournalStore));
+    int fd = open(JOURNAL_STORE_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(StoreHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    store->mapping = mapping;
+    store->size = st.st_size;
+    store->header = mapping;
+    const StoreHeader *header = store->header;
+    uint32_t hash;
+    bool valid = header->magic == JOURNAL_STORE_MAGIC && header->version == JOURNAL_STORE_VERSION &&
+                 header->journal_inode == journal->file_stat.st_ino && header->covered_size > 0 &&
+                 header->covered_size <= journal->size &&
+                 journal_tail_hash(-1, journal->data, header->covered_size, &hash) && hash == header->tail_hash &&
+                 header->genre_table_offset >= sizeof(StoreHeader) &&
+                 header->genre_table_offset <= header->blocks_offset && header->blocks_offset % 8 == 0 &&
+                 header->blocks_offset <= store->size &&
+                 header->block_count <= (store->size - header->blocks_offset) / sizeof(StoreBlock);
+    const char *cursor = (const char *) mapping + (valid ? header->genre_table_offset : 0);
+    const char *table_end = (const char *) mapping + (valid ? header->blocks_offset : 0);
+    for (uint32_t i = 0; valid && i < header->genre_count; i++) {
+        uint32_t length;
+        valid = (size_t) (table_end - cursor) >= sizeof(uint32_t);
+        if (!valid) break;
+        memcpy(&length, cursor, sizeof(uint32_t));
+        valid = length <= (size_t) (table_end - cursor) - sizeof(uint32_t);
+        cursor += sizeof(uint32_t) + length;
+    }
+    store->blocks = (const StoreBlock *) ((const char *) mapping + (valid ? header->blocks_offset : 0));
+    uint64_t text_end = 0;
+    for (uint64_t i = 0; valid && i < header->block_count; i++) {
+        const StoreBlock *block = &store->blocks[i];
+        valid = block->text_offset == text_end && block->text_length <= header->max_block_length &&
+                block->data_offset >= sizeof(StoreHeader) && block->data_offset <= header->genre_table_offset &&
+                block->compressed_length <= header->genre_table_offset - block->data_offset;
+        text_end += block->text_length;
+    }
+    if (!valid || text_end != header->covered_size) {
+        close_journal_store(store);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the bit of a genre in the genre bitmaps of the store, 0 if no line of the store has it.
+ */
+uint64_t store_genre_bit(const JournalStore *store, const char *genre) {
+    const StoreHeader *header = store->header;
+    const char *cursor = (const char *) store->mapping + header->genre_table_offset;
+    for (uint32_t id = 0; id < header->genre_count; id++) {
+        uint32_t length;
+        memcpy(&length, cursor, sizeof(uint32_t));
+        if (slice_equals_string((TextSlice) {cursor + sizeof(uint32_t), length}, genre)) {
+            return 1ull << (id < STORE_GENRE_BITS ? id : STORE_GENRE_BITS);
+        }
+        cursor += sizeof(uint32_t) + length;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lists the entries of the journal from the compressed store.
+ *
+ * A block whose zone map shows that the filter rejects all its lines is skipped without being
+ * decompressed, its lines are only counted. The other blocks are decompressed into one buffer and listed by
+ * `list_mapped_range`, as is the part of the journal appended after the store was built. A damaged block,
+ * which fails its checksum or does not decompress, is listed from the journal text instead.
+ */
+void list_store_entries(const MappedJournal *journal, const JournalStore *store, const JournalFilter *filter,
+                        ListCounts *counts, ListSink *sink) {
+    uint64_t genre_bits[FILTER_MAX_PREDICATES];
+    for (size_t i = 0; i < filter->count; i++) {
+        const FilterPredicate *predicate = &filter->predicates[i];
+        genre_bits[i] = predicate->kind == FILTER_GENRE ? store_genre_bit(store, predicate->genre) : 0;
+    }
+    const StoreHeader *header = store->header;
+    uint8_t *text = malloc(header->max_block_length > 0 ? header->max_block_length : 1);
+    for (uint64_t i = 0; i < header->block_count; i++) {
+        const StoreBlock *block = &store->blocks[i];
+        if (!block_may_match(filter, block, genre_bits)) {
+            counts->total += block->record_count;
+            continue;
+        }
+        const char *begin = journal->data + block->text_offset;
+        const uint8_t *data = (const uint8_t *) store->mapping + block->data_offset;
+        ProfilePhase previous = profile_enter(PROFILE_READ);
+        if (text != NULL && store_checksum(data, block->compressed_length) == block->checksum &&
+            lz_decompress(data, block->compressed_length, text, block->text_length)) {
+            begin = (const char *) text;
+        }
+        profile_enter(previous);
+        list_mapped_range(begin, begin + block->text_length, block->text_offset, filter, counts, sink, true);
+    }
+    free(text);
+    list_mapped_range(journal->data + header->covered_size, journal->data + journal->size, header->covered_size,
+                      filter, counts, sink, true);
+}
+
+/**
+ * @brief Releases the journal of the daemon and leaves it empty.
+ */
+void free_served_journal(ServedJournal *served) {
+    free(served->data);
+    free(served->records);
+    genre_dictionary_free(&served->genres);
+    memset(served, 0, sizeof(ServedJournal));
+}
+
+/**
+ * @brief Brings the journal of the daemon up to date with the journal file.
+ *
+ * When the file only grew, just the appended tail is read and described by new records. A last line that
+ * was not terminated is described again, as it may have been completed. The end of the text already
+ * loaded is compared with the file, so a journal rewritten by other means is noticed and loaded again
+ * from the start, as is a replaced, truncated or modified file.
+ *
+ * @return True if the journal in memory matches the file, false if the file cannot be read.
+ */
+bool refresh_served_journal(ServedJournal *served) {
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    size_t known = served->size;
+    bool appended = served->loaded && st.st_ino == served->file_stat.st_ino &&
+                    st.st_dev == served->file_stat.st_dev && (size_t) st.st_size >= known;
+    if (appended && (size_t) st.st_size == known) {
+        appended = st.st_mtim.tv_sec == served->file_stat.st_mtim.tv_sec &&
+                   st.st_mtim.tv_nsec == served->file_stat.st_mtim.tv_nsec;
+    } else if (appended && known > 0) {
+        char tail[STATS_TAIL_CHECK];
+        size_t length = known < STATS_TAIL_CHECK ? known : STATS_TAIL_CHECK;
+        appended = pread(fd, tail, length, (off_t) (known - length)) == (ssize_t) length &&
+                   memcmp(tail, served->data + known - length, length) == 0;
+    }
+    if (!appended) {
+        served->size = 0;
+        served->record_count = 0;
+        genre_dictionary_free(&served->genres);
+    }
+    bool ok = true;
+    if ((size_t) st.st_size > served->size) {
+        size_t size = st.st_size;
+        if (size > served->capacity) {
+            size_t capacity = served->capacity == 0 ? 64 * 1024 : served->capacity;
+            while (capacity < size) capacity *= 2;
+            char *resized = realloc(served->data, capacity);
+            ok = resized != NULL;
+            if (ok) {
+                served->data = resized;
+                served->capacity = capacity;
+            }
+        }
+        for (size_t position = served->size; ok && position < size;) {
+            ssize_t read = pread(fd, served->data + position, size - position, (off_t) position);
+            ok = read > 0;
+            position += ok ? (size_t) read : 0;
+        }
+        size_t offset = served->size;
+        if (ok && served->record_count > 0 && served->data[served->size - 1] != '\n') {
+            offset = served->records[--served->record_count].line_offset;
+        }
+        while (ok && offset < size) {
+            const char *newline = memchr(served->data + offset, '\n', size - offset);
+            size_t line_end = newline != NULL ? (size_t) (newline - served->data) : size;
+            if (served->record_count == served->record_capacity) {
+                size_t capacity = served->record_capacity == 0 ? 4096 : served->record_capacity * 2;
+                IndexRecord *resized = realloc(served->records, capacity * sizeof(IndexRecord));
+                ok = resized != NULL;
+                if (!ok) break;
+                served->records = resized;
+                served->record_capacity = capacity;
+            }
+            fill_index_record(&served->records[served->record_count++], served->data, offset, line_end - offset,
+                              &served->genres);
+            offset = line_end + 1;
+        }
+        served->size = size;
+    }
+    close(fd);
+    served->file_stat = st;
+    served->loaded = ok;
+    if (!ok) {
+        perror("Failed to load the journal");
+        served->size = 0;
+        served->record_count = 0;
+    }
+    return ok;
+}
+
+/**
+ * @brief Lists entries of the journal held by the daemon.
+ *
+ * The records are listed like the records of the sidecar index (`list_indexed_entries`), so the journal
+ * is not parsed again. Genre IDs of the records are mapped to `genre_dictionary` for this request.
+ */
+void list_served_entries(const ServedJournal *served, const JournalFilter *filter, ListCounts *counts,
+                         ListSink *sink) {
+    IndexHeader header;
+    memset(&header, 0, sizeof(IndexHeader));
+    header.record_count = served->record_count;
+    header.genre_count = (uint32_t) served->genres.count;
+    JournalIndex index;
+    memset(&index, 0, sizeof(JournalIndex));
+    index.header = &header;
+    index.records = served->records;
+    index.genre_map = malloc((served->genres.count > 0 ? served->genres.count : 1) * sizeof(uint32_t));
+    if (index.genre_map == NULL) {
+        perror("Failed to allocate memory for journal entries");
+        return;
+    }
+    for (size_t id = 0; id < served->genres.count; id++) {
+        index.genre_map[id] = genre_dictionary_intern(&genre_dictionary, served->genres.names[id]);
+    }
+    MappedJournal journal = {served->data, served->size, served->file_stat};
+    list_indexed_entries(&journal, &index, filter, counts, sink);
+    free(index.genre_map);
+}
+
+/**
+ * @brief Sets `stop_requested` on SIGINT or SIGTERM.
+ */
+void request_stop(int signal_number) {
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+/**
+ * @brief Makes SIGINT and SIGTERM set `stop_requested` instead of ending the process.
+ *
+ * The handler is installed without `SA_RESTART`, so a blocking call of the command returns with `EINTR`
+ * and the command can finish its work, e.g. print its summary or remove its socket.
+ */
+void handle_stop_signals() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+/**
+ * @brief Lists the entries appended to the journal after `offset` as they arrive, until SIGINT or SIGTERM.
+ *
+ * The journal is watched with inotify. After each modification only the bytes appended since the last one
+ * are read, at most `FOLLOW_READ_SIZE` at a time, and their complete lines are filtered and emitted by
+ * `list_mapped_range`, so an update costs as much as the appended data. A line which is not terminated yet
+ * is kept until its newline arrives. A truncated journal is followed again from its start, a journal which
+ * is moved or deleted ends the command.
+ *
+ * `compact` renames a new file over the journal. The open descriptor keeps the old file, which gets no
+ * further events once its last link is gone (`IN_ATTRIB`), so after every event the journal path is checked
+ * for another inode. The rest of the old file is listed first, then the new file is followed from its end,
+ * as it starts with the compacted entries which were already listed.
+ *
+ * @param offset Where the listing stopped, just after a newline or at the start of the journal.
+ * @param filter The compiled filter.
+ * @param counts Counters to update.
+ * @param sink Where the matching entries go. Its output is flushed after each update.
+ */
+void follow_journal(size_t offset, const JournalFilter *filter, ListCounts *counts, ListSink *sink) {
+    const uint32_t watched_events = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+    int notify = inotify_init1(IN_CLOEXEC);
+    int fd = open(JOURNAL_FILE, O_RDONLY | O_CLOEXEC);
+    int watch = notify >= 0 && fd >= 0 ? inotify_add_watch(notify, JOURNAL_FILE, watched_events) : -1;
+    if (watch < 0) {
+        perror("Failed to watch the journal");
+        if (notify >= 0) close(notify);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    handle_stop_signals();
+    char *pending = malloc(FOLLOW_READ_SIZE);
+    size_t used = 0;
+    size_t capacity = FOLLOW_READ_SIZE;
+    bool watching = pending != NULL;
+    bool replaced = false;
+    while (watching && !stop_requested) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) break;
+        if ((size_t) st.st_size < offset + used) {
+            output_string(sink->out, "Journal was truncated, following it from the start\n");
+            offset = 0;
+            used = 0;
+        }
+        while (offset + used < (size_t) st.st_size) {
+            if (used == capacity) {
+                // A single line longer than the read size
+                char *grown = realloc(pending, capacity * 2);
+                if (grown == NULL) break;
+                pending = grown;
+                capacity *= 2;
+            }
+            size_t wanted = (size_t) st.st_size - offset - used;
+            if (wanted > capacity - used) wanted = capacity - used;
+            ssize_t length = pread(fd, pending + used, wanted, (off_t) (offset + used));
+            if (length <= 0) break;
+            const char *newline = memrchr(pending + used, '\n', (size_t) length);
+            used += (size_t) length;
+            if (newline == NULL) continue;
+            size_t complete = (size_t) (newline - pending) + 1;
+            list_mapped_range(pending, pending + complete, offset, filter, counts, sink, true);
+            memmove(pending, pending + complete, used - complete);
+            offset += complete;
+            used -= complete;
+        }
+        if (replaced) {
+            // The old file is read to its end, no writer appends to it after the rename
+            int next = open(JOURNAL_FILE, O_RDONLY | O_CLOEXEC);
+            int next_watch = next >= 0 ? inotify_add_watch(notify, JOURNAL_FILE, watched_events) : -1;
+            struct stat next_stat;
+            if (next_watch < 0 || fstat(next, &next_stat) != 0) {
+                if (next >= 0) close(next);
+                output_string(sink->out, "Journal was moved or deleted, stopped following it\n");
+                break;
+            }
+            inotify_rm_watch(notify, watch);
+            close(fd);
+            fd = next;
+            watch = next_watch;
+            replaced = false;
+            // A line still waiting for its newline is copied to the end of the new file
+            size_t size = (size_t) next_stat.st_size;
+            bool kept = used > 0 && used <= size;
+            char *tail = kept ? malloc(used) : NULL;
+            kept = tail != NULL && pread(fd, tail, used, (off_t) (size - used)) == (ssize_t) used &&
+                   memcmp(tail, pending, used) == 0;
+            free(tail);
+            if (!kept) used = 0;
+            offset = size - used;
+            output_string(sink->out, "Journal was compacted, following the new journal file\n");
+            continue;
+        }
+        output_flush(sink->out);
+        _Alignas(struct inotify_event) char events[4096];
+        ssize_t length = read(notify, events, sizeof(events));
+        if (length < 0) {
+            if (errno != EINTR) perror("Failed to watch the journal");
+            watching = errno == EINTR;
+            continue;
+        }
+        for (char *cursor = events; cursor < events + length;) {
+            const struct inotify_event *event = (const struct inotify_event *) cursor;
+            if (event->wd == watch && (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED))) watching = false;
+            cursor += sizeof(struct inotify_event) + event->len;
+        }
+        struct stat current;
+        if (watching && stat(JOURNAL_FILE, &current) != 0) {
+            watching = false;
+        } else if (watching && fstat(fd, &st) == 0 && (current.st_ino != st.st_ino || current.st_dev != st.st_dev)) {
+            replaced = true;
+        }
+        if (!watching) output_string(sink->out, "Journal was moved or deleted, stopped following it\n");
+    }
+    output_flush(sink->out);
+    free(pending);
+    close(fd);
+    close(notify);
+}
+
+/**
+ * @brief Loads the checkpoints of the line offset index, creating it or bringing it up to date first.
+ *
+ * An index which no longer matches the journal is started again from scratch, one which covers only a
+ * prefix of the journal is extended by the complete lines after it. The index is locked while it is read
+ * and updated, as writers extend it concurrently.
+ *
+ * @param journal The journal the pages are listed from.
+ * @param checkpoints Receives the checkpoints, to be freed by the caller.
+ * @param checkpoint_count Receives the number of checkpoints.
+ *
+ * @return False if the index cannot be loaded (which is reported).
+ */
+bool load_line_offsets(const MappedJournal *journal, uint64_t **checkpoints, size_t *checkpoint_count) {
+    int fd = open(JOURNAL_OFFSETS_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    int locked = -1;
+    while (fd >= 0 && (locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+    OffsetsHeader header;
+    uint32_t tail_hash;
+    bool ok = locked == 0;
+    bool valid = ok && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                 header.magic == JOURNAL_OFFSETS_MAGIC && header.version == JOURNAL_OFFSETS_VERSION &&
+                 header.stride == LINE_OFFSET_STRIDE && header.journal_inode == journal->file_stat.st_ino &&
+                 header.journal_size <= journal->size &&
+                 (header.journal_size == 0 ||
+                  (journal_tail_hash(-1, journal->data, header.journal_size, &tail_hash) &&
+                   tail_hash == header.tail_hash));
+    if (ok && !valid) {
+        memset(&header, 0, sizeof(OffsetsHeader));
+        header.magic = JOURNAL_OFFSETS_MAGIC;
+        header.version = JOURNAL_OFFSETS_VERSION;
+        header.journal_inode = journal->file_stat.st_ino;
+        header.stride = LINE_OFFSET_STRIDE;
+        ok = ftruncate(fd, 0) == 0;
+    }
+    const char *last_newline = journal->size > header.journal_size
+                               ? memrchr(journal->data + header.journal_size, '\n',
+                                         journal->size - header.journal_size)
+                               : NULL;
+    if (ok && last_newline != NULL) {
+        size_t covered = (size_t) (last_newline - journal->data) + 1;
+        ok = journal_tail_hash(-1, journal->data, covered, &tail_hash) &&
+             extend_line_offsets(fd, &header, journal->data + header.journal_size, covered - header.journal_size,
+                                 &journal->file_stat, tail_hash);
+    }
+    *checkpoint_count = ok ? (header.entry_count + header.stride - 1) / header.stride : 0;
+    *checkpoints = ok ? malloc((*checkpoint_count + 1) * sizeof(uint64_t)) : NULL;
+    size_t length = *checkpoint_count * sizeof(uint64_t);
+    ok = *checkpoints != NULL && pread(fd, *checkpoints, length, sizeof(OffsetsHeader)) == (ssize_t) length;
+    if (fd >= 0) close(fd);
+    if (!ok) {
+        perror("Failed to load the line offset index");
+        free(*checkpoints);
+        *checkpoints = NULL;
+    }
+    return ok;
+}
+
+/**
+ * @brief Lists one page of entries, scanning the journal from a line start and stopping once the page is
+ *        full.
+ *
+ * Entries are parsed one by one, as a page is usually a small part of the journal. Invalid lines are
+ * reported only within the page. Lines changed by `update` or `delete` are taken from `journal_overlay`.
+ *
+ * @param journal The journal.
+ * @param start Offset of the line the scan starts at.
+ * @param skip Number of matching entries to pass over before the page starts.
+ * @param limit Number of entries of the page.
+ * @param filter The compiled filter.
+ * @param counts Counters to update, `total` counts the scanned entries.
+ * @param sink Where the entries of the page go.
+ *
+ * @return Offset just after the last line of the page, where the next page starts, or the size of the
+ *         journal if the scan reached its end.
+ */
+size_t list_page(const MappedJournal *journal, size_t start, size_t skip, size_t limit,
+                 const JournalFilter *filter, ListCounts *counts, ListSink *sink) {
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    if (tokenizer == NULL) {
+        perror("Failed to allocate memory for journal tokenizer");
+        return journal->size;
+    }
+    init_line_tokenizer(tokenizer, journal->data + start, journal->data + journal->size,
+                        select_delimiter_scanner());
+    size_t position = journal->size;
+    const OverlayChange *change = find_overlay_change(&journal_overlay, start);
+    TokenizedLine line;
+    while (counts->listed < limit && next_tokenized_line(tokenizer, &line)) {
+        uint64_t id = (uint64_t) (line.data - journal->data);
+        size_t line_end = (size_t) id + line.length + 1;
+        uint32_t id_check = list_show_ids ? hash_slice((TextSlice) {line.data, line.length}) : 0;
+        if (!apply_overlay_change(&line, id, &change)) continue;
+        if (line.field_count < 4) {
+            if (skip == 0) report_invalid_line(sink->out, line.data, line.length);
+            continue;
+        }
+        JournalEntry entry;
+        entry_from_fields(&entry, line.fields, line.field_count);
+        entry.id = id;
+        entry.id_check = id_check;
+        pack_entry_days(&entry, filter->needs);
+        counts->total++;
+        if (!filter_matches(filter, &entry)) continue;
+        if (skip > 0) {
+            skip--;
+            continue;
+        }
+        emit_entry(sink, &entry);
+        counts->listed++;
+        position = line_end;
+    }
+    free(tokenizer);
+    return position < journal->size ? position : journal->size;
+}
+
+/**
+ * @brief Check of a cursor position: the hash of the text just before it, so a cursor of a journal that
+ *        was rewritten since is refused.
+ */
+uint32_t cursor_check(const MappedJournal *journal, size_t offset) {
+    size_t length = offset < 64 ? offset : 64;
+    return hash_slice((TextSlice) {length > 0 ? journal->data + offset - length : "", length});
+}
+
+/**
+ * @brief Decodes a cursor token printed after a page, `<offset in hex>.<check in hex>`.
+ *
+ * @return True if the token is well formed and points to the start of a line of the unchanged journal.
+ */
+bool parse_list_cursor(const MappedJournal *journal, const char *cursor, size_t *offset) {
+    char *end;
+    errno = 0;
+    unsigned long long position = strtoull(cursor, &end, 16);
+    if (errno != 0 || end == cursor || *end != '.') return false;
+    const char *check_text = end + 1;
+    unsigned long check = strtoul(check_text, &end, 16);
+    if (end == check_text || *end != '\0' || position > journal->size) return false;
+    if (position > 0 && journal->data[position - 1] != '\n') return false;
+    *offset = (size_t) position;
+    return check == cursor_check(journal, *offset);
+}
+
+/**
+ * @brief Returns the stream for the summary after the listed entries, which is separated from them by an
+ *        empty line in the text format.
+ *
+ * Records of the other formats go to other programs, so their summary goes to stderr and does not mix with
+ * them.
+ */
+FILE *start_list_summary() {
+    if (list_format != LIST_FORMAT_TEXT) return stderr;
+    fputs("\n", stdout);
+    return stdout;
+}
+
+/**
+ * @brief Lists one page of the journal for `--offset`, `--limit` and `--cursor`.
+ *
+ * Without a filter and cursor, the page starts at an entry number: the line offset index
+ * (`load_line_offsets`) gives the offset of the nearest preceding checkpoint and at most
+ * `LINE_OFFSET_STRIDE - 1` entries are passed over from there. The checkpoints count journal lines, so they
+ * are not used while the change log holds changes (`journal_overlay`), as a deleted line is no entry.
+ * Otherwise the scan starts at the cursor of the previous page (or at the start of the journal) and passes
+ * over `options->offset` matching entries. Either way the scan stops when the page is full and the cursor
+ * of the next page is printed, unless the journal was read to its end. The summary has no "/total" part,
+ * as the total is known only after reading the whole journal.
+ */
+void list_page_entries(const MappedJournal *journal, const JournalFilter *filter, const ListOptions *options) {
+    size_t start = 0;
+    size_t skip = options->offset;
+    if (options->cursor != NULL && !parse_list_cursor(journal, options->cursor, &start)) {
+        printf("Invalid cursor, or the journal was changed since it was printed\n");
+        return;
+    }
+    if (filter->count == 0 && !filter->matches_nothing && options->cursor == NULL && skip >= LINE_OFFSET_STRIDE &&
+        journal_overlay.count == 0) {
+        uint64_t *checkpoints;
+        size_t checkpoint_count;
+        if (!load_line_offsets(journal, &checkpoints, &checkpoint_count)) return;
+        size_t checkpoint = skip / LINE_OFFSET_STRIDE;
+        if (checkpoint >= checkpoint_count) checkpoint = checkpoint_count - 1;
+        if (checkpoint_count > 0) {
+            start = checkpoints[checkpoint];
+            skip -= checkpoint * LINE_OFFSET_STRIDE;
+        }
+        free(checkpoints);
+    }
+    ListCounts counts = {0, 0};
+    OutputBuffer out;
+    output_init(&out, STDOUT_FILENO);
+    ListSink sink = {&out, NULL};
+    fflush(stdout);
+    output_list_header(&out);
+    size_t next = list_page(journal, start, skip, options->limit > 0 ? options->limit : SIZE_MAX, filter, &counts,
+                            &sink);
+    output_free(&out);
+    FILE *summary = start_list_summary();
+    fprintf(summary, "Listed entries %zu\n", counts.listed);
+    if (next < journal->size) {
+        fprintf(summary, "Next page: --cursor %zx.%08x\n", next, (unsigned int) cursor_check(journal, next));
+    }
+}
+
+/**
+ * @brief Lists journal entries from the journal file, applying an optional filter.
+ *
+ * This function reads entries from the journal file, parses them into `JournalEntry` structures,
+ * optionally filters them using the provided filter function, and displays the filtered results.
+ * It also reports the total number of entries and the number of filtered entries that were listed.
+ *
+ * @param filter The compiled filter. A filter without predicates lists all entries.
+ * @param options Options controlling how the journal is read.
+ *
+ * @note The journal entries are expected to be stored in a file defined by the `JOURNAL_FILE` macro.
+ *       Each line of the file should represent a single entry in a specific delimited format. The
+ *       exact format of the entries is handled by the `parse_entry` and `load_entry` functions.
+ *
+ * - If the journal file cannot be opened for reading, an error is displayed, and the function exits early.
+ * - A page (`options->paged`) is listed by `list_page_entries`, which stops scanning once the page is full.
+ * - In the daemon, entries are listed from the journal held in memory (`list_served_entries`) instead.
+ * - Lines changed by `update` and `delete` are read from the change log into `journal_overlay`. While
+ *   there are changes, the indexes are not used and the changes are applied by `list_mapped_entries`, until
+ *   `compact` writes them into the journal.
+ * - If `options->use_index` is set and the filter requires an author, only the entries of the author are
+ *   read, as found in the author index `JOURNAL_AUTHOR_FILE` (`list_author_entries`). The index is built
+ *   on the first such query and rebuilt when it is stale.
+ * - If the sidecar index `JOURNAL_INDEX_FILE` exists and `options->use_index` is set, entries are listed
+ *   from the index (`list_indexed_entries`). A stale index is rebuilt first. A filter which requires a genre
+ *   or a start date range only checks the records of the genre posting list or of the date range
+ *   (`list_index_candidates`).
+ * - Otherwise, if the compressed store `JOURNAL_STORE_FILE` matches the journal, entries are listed from
+ *   its blocks and the blocks the filter rejects are skipped (`list_store_entries`).
+ * - Otherwise the journal is memory-mapped and entries are parsed as views into the mapping
+ *   (`list_mapped_entries`), by `options->threads` threads. If the file cannot be mapped, it is read line
+ *   by line instead (`list_stream_entries`).
+ * - Entries are printed through an `OutputBuffer` on stdout, which is flushed before the summary. With a sort
+ *   field or a limit they are collected by an `EntrySorter` during the scan and printed after it, the
+ *   summary then counts the printed entries.
+ * - With `options->follow`, a last line without a newline is left out of the scan and the entries appended
+ *   afterwards are listed as they arrive (`follow_journal`).
+ * - At the end of the process, a summary is printed indicating the number of entries listed and the
+ *   total number of entries in the file.
+ *
+ * @warning If the journal file is not in the expected format or contains invalid entries, those entries
+ *          are skipped, and the function continues processing the remaining entries.
+ */
+void list_entries(const JournalFilter *filter, const ListOptions *options) {
+    ProfilePhase previous = profile_enter(PROFILE_READ);
+    int fd = served_journal == NULL ? open(JOURNAL_FILE, O_RDONLY) : -1;
+    if (served_journal == NULL && fd < 0) {
+        perror("Failed to open file for reading\n");
+        return;
+    }
+    if (options->paged) {
+        MappedJournal journal;
+        if (served_journal != NULL) {
+            MappedJournal served = {served_journal->data, served_journal->size, served_journal->file_stat};
+            load_journal_overlay(served.data, served.size, &served.file_stat, &journal_overlay);
+            list_page_entries(&served, filter, options);
+        } else if (map_journal(fd, &journal)) {
+            load_journal_overlay(journal.data, journal.size, &journal.file_stat, &journal_overlay);
+            list_page_entries(&journal, filter, options);
+            unmap_journal(&journal);
+        } else {
+            printf("Only a regular journal file can be paged\n");
+        }
+        free_journal_overlay(&journal_overlay);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    ListCounts counts = {0, 0};
+    Arena arena;
+    arena_init(&arena);
+    MappedJournal journal;
+    OutputBuffer out;
+    output_init(&out, STDOUT_FILENO);
+    EntrySorter sorter;
+    bool sorted = options->sort_field != SORT_NONE || options->limit > 0;
+    if (sorted) {
+        init_entry_sorter(&sorter, options->sort_field, options->descending, options->limit, options->sort_memory);
+    }
+    ListSink sink = {&out, sorted ? &sorter : NULL};
+    size_t listed_size = 0;
+    bool followable = false;
+    if (served_journal != NULL) {
+        MappedJournal served = {served_journal->data, served_journal->size, served_journal->file_stat};
+        load_journal_overlay(served.data, served.size, &served.file_stat, &journal_overlay);
+        fflush(stdout);
+        output_list_header(&out);
+        profile_enter(PROFILE_OTHER);
+        if (journal_overlay.count > 0) {
+            list_mapped_entries(&served, filter, &counts, 1, &sink);
+        } else {
+            list_served_entries(served_journal, filter, &counts, &sink);
+        }
+    } else if (map_journal(fd, &journal)) {
+        size_t mapped_size = journal.size;
+        if (options->follow && journal.size > 0 && journal.data[journal.size - 1] != '\n') {
+            // A follower lists only complete lines, the last one is listed once its newline is appended
+            const char *newline = memrchr(journal.data, '\n', journal.size);
+            journal.size = newline != NULL ? (size_t) (newline - journal.data) + 1 : 0;
+        }
+        listed_size = journal.size;
+        followable = true;
+        load_journal_overlay(journal.data, journal.size, &journal.file_stat, &journal_overlay);
+        // The indexes describe the journal text, changed lines are applied by a scan of the text
+        bool use_index = options->use_index && journal.size == mapped_size && journal_overlay.count == 0;
+        JournalIndex index;
+        JournalStore store;
+        AuthorIndex authors;
+        const FilterPredicate *author = filter->matches_nothing ? NULL : filter_required_author(filter);
+        bool authored = use_index && journal.size > 0 && author != NULL && load_author_index(&journal, &authors);
+        bool indexed = !authored && use_index && access(JOURNAL_INDEX_FILE, F_OK) == 0 &&
+                       load_journal_index(&journal, &index);
+        bool stored = !authored && !indexed && use_index && open_journal_store(&journal, &store);
+        fflush(stdout);
+        output_list_header(&out);
+        profile_enter(PROFILE_OTHER);
+        const uint32_t *candidates;
+        size_t candidate_count;
+        uint32_t *owned_candidates;
+        if (authored) {
+            list_author_entries(&journal, &authors, author, filter, &counts, &sink);
+            close_author_index(&authors);
+        } else if (indexed && !filter->matches_nothing &&
+            find_index_candidates(&index, filter, &candidates, &candidate_count, &owned_candidates)) {
+            list_index_candidates(&journal, &index, candidates, candidate_count, filter, &counts, &sink);
+            free(owned_candidates);
+            close_journal_index(&index);
+        } else if (indexed) {
+            list_indexed_entries(&journal, &index, filter, &counts, &sink);
+            close_journal_index(&index);
+        } else if (stored) {
+            list_store_entries(&journal, &store, filter, &counts, &sink);
+            close_journal_store(&store);
+        } else {
+            list_mapped_entries(&journal, filter, &counts, options->threads, &sink);
+        }
+        journal.size = mapped_size;
+        unmap_journal(&journal);
+        close(fd);
+    } else {
+        FILE *file = fdopen(fd, "r");
+        if (file == NULL) {
+            perror("Failed to open file for reading\n");
+            close(fd);
+            if (sorted) free_entry_sorter(&sorter);
+            return;
+        }
+        fflush(stdout);
+        output_list_header(&out);
+        profile_enter(PROFILE_OTHER);
+        list_stream_entries(file, &arena, filter, &counts, &sink);
+        fclose(file);
+    }
+    if (options->follow && followable) {
+        follow_journal(listed_size, filter, &counts, &sink);
+    } else if (options->follow) {
+        output_string(&out, "Only a regular journal file can be followed\n");
+    }
+    if (sorted) {
+        size_t printed = finish_entry_sorter(&sorter, &out);
+        counts.listed = printed != SIZE_MAX ? printed : 0;
+        free_entry_sorter(&sorter);
+    }
+    output_free(&out);
+    fprintf(start_list_summary(), "Listed entries %zu/%zu\n", counts.listed, counts.total);
+    free_journal_overlay(&journal_overlay);
+    print_arena_stats(&arena, "list");
+    profile_arena(&arena);
+    arena_free(&arena);
+    profile_enter(previous);
+}
+
+/**
+ * @brief Parses the date value of a date filter option into a day number.
+ *
+ * @param option The option, for the error message.
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ * @param value_index Position of the value in `argv`.
+ * @param day Receives the day number of the date.
+ *
+ * @return True if the value is a valid YYYY-MM-DD date, otherwise false (which is reported).
+ */
+bool parse_filter_date(const char *option, int argc, char *argv[], int value_index, int32_t *day) {
+    if (value_index >= argc || !is_valid_date(argv[value_index])) {
+        printf("Invalid date for %s. Correct format is YYYY-MM-DD (ISO 8601)\n", option);
+        return false;
+    }
+    *day = date_to_day_number(slice_from_string(argv[value_index]));
+    return true;
+}
+
+/**
+ * @brief Handles the "list" command for displaying journal entries based on various filters or criteria.
+ *
+ * This function processes command-line arguments to determine which subset of journal entries to display.
+ * It supports filtering entries by any combination of genre, author, reading status, completion status, score
+ * and start or end date ranges, each of which can be negated, or listing all entries when no specific filter is provided.
+ *
+ * @param argc The number of arguments passed to the program, including the program name.
+ *             Must be at least 2 for the command to work, as the "list" command itself requires input.
+ * @param argv An array of null-terminated C-strings representing the arguments passed to the program.
+ *             For filtering, additional arguments in the following formats are expected:
+ *             - "--genre <genre_name>" to filter entries by a specific genre.
+ *             - "--reading" to filter entries that are currently being read.
+ *             - "--completed" to filter entries that have been completed.
+ *             - "--score <score_threshold>" to filter entries with a score equal to or higher than the given value.
+ *             - "--author <name>" and "--author-prefix <text>" to filter entries by author, or by the start of
+ *               the author name. Case and runs of spaces do not matter.
+ *             - "--started-after <date>" and "--started-before <date>" to filter entries started after or before
+ *               the given day (exclusive).
+ *             - "--finished-between <from> <to>" to filter entries finished within the given days (inclusive).
+ *             - "--not" to negate the filter option that follows.
+ *             - "--no-index" to parse the journal text even when the sidecar index exists.
+ *             - "--ids" to print the record ID of every entry, which `update` and `delete` take.
+ *             - "--format text|jsonl|tsv|raw" to print the entries as blocks of text (the default), JSON lines,
+ *               tab separated values or journal lines. The summary then goes to stderr.
+ *             - "--threads <count>" to parse the journal text with the given number of threads.
+ *             - "--sort score|start|end|name" and "--desc" to print the entries sorted by the given field.
+ *             - "--limit <count>" to print only the first entries, of the sorted order if "--sort" is given.
+ *             - "--sort-memory <megabytes>" to set the memory budget of a full sort, past which sorted runs
+ *               are spilled to temporary files.
+ *             - "--follow" to keep listing the matching entries appended to the journal until interrupted.
+ *             - "--offset <count>" and "--cursor <token>" to list one page of "--limit" entries, after the given
+ *               number of matching entries and from the position where the previous page ended.
+ *
+ * @details
+ * - If fewer than 2 arguments are provided, an error message is displayed and help information is shown.
+ * - Every filter option adds a predicate to the filter (`add_filter_predicate`) and an entry is listed only
+ *   if it satisfies all of them, e.g. "--completed --genre fantasy --score 4". The whole filter is evaluated
+ *   in a single scan of the journal.
+ * - If no filter option is provided, the function lists all entries by calling `list_entries` with an empty
+ *   filter.
+ * - If an unsupported filter option is provided, an error message is displayed and help information is shown.
+ *
+ * Functions invoked within this function:
+ * - `print_help()`: Displays help information about the command.
+ * - `compile_filter(JournalFilter *filter)`: Orders the predicates from the cheapest one.
+ * - `list_entries(const JournalFilter *filter, const ListOptions *options)`: Executes the filtering and listing
+ *   of journal entries.
+ *
+ * Edge cases handled:
+ * - If an invalid filter option is provided, an error message is displayed with usage instructions.
+ * - If a required argument for a filter (e.g., genre name for "--genre") is missing, the function avoids invalid memory access.
+ */
+void list_cmd(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("Not enough arguments for list command\n");
+        print_help();
+        return;
+    }
+    JournalFilter filter;
+    init_filter(&filter);
+    bool negate_next = false;
+    ListOptions options = {true, 1, SORT_NONE, false, 0, SORT_MEMORY_BUDGET, false, false, 0, NULL};
+    // The daemon runs many requests, the flags must not stay set from a previous one
+    list_show_ids = false;
+    list_format = LIST_FORMAT_TEXT;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--no-index") == 0) {
+            options.use_index = false;
+        } else if (strcmp(argv[i], "--ids") == 0) {
+            list_show_ids = true;
+        } else if (strcmp(argv[i], "--format") == 0) {
+            const char *format = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(format, "text") == 0) {
+                list_format = LIST_FORMAT_TEXT;
+            } else if (strcmp(format, "jsonl") == 0) {
+                list_format = LIST_FORMAT_JSONL;
+            } else if (strcmp(format, "tsv") == 0) {
+                list_format = LIST_FORMAT_TSV;
+            } else if (strcmp(format, "raw") == 0) {
+                list_format = LIST_FORMAT_RAW;
+            } else {
+                printf("Invalid format, expected text, jsonl, tsv or raw\n");
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            char *end = NULL;
+            long threads = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+            if (end == NULL || *end != '\0' || threads < 1 || threads > LIST_MAX_THREADS) {
+                printf("Invalid thread count, expected a number from 1 to %d\n", LIST_MAX_THREADS);
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            options.threads = (int) threads;
+        } else if (strcmp(argv[i], "--sort") == 0) {
+            const char *field = i + 1 < argc ? argv[++i] : "";
+            if (strcmp(field, "score") == 0) {
+                options.sort_field = SORT_SCORE;
+            } else if (strcmp(field, "start") == 0) {
+                options.sort_field = SORT_START;
+            } else if (strcmp(field, "end") == 0) {
+                options.sort_field = SORT_END;
+            } else if (strcmp(field, "name") == 0) {
+                options.sort_field = SORT_NAME;
+            } else {
+                printf("Invalid sort field, expected score, start, end or name\n");
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+        } else if (strcmp(argv[i], "--desc") == 0) {
+            options.descending = true;
+        } else if (strcmp(argv[i], "--follow") == 0) {
+            options.follow = true;
+        } else if (strcmp(argv[i], "--offset") == 0) {
+            char *end = NULL;
+            long long value = i + 1 < argc ? strtoll(argv[++i], &end, 10) : -1;
+            if (end == NULL || *end != '\0' || value < 0) {
+                printf("Invalid offset, expected a number of entries\n");
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            options.offset = (size_t) value;
+            options.paged = true;
+        } else if (strcmp(argv[i], "--cursor") == 0) {
+            if (i + 1 >= argc) {
+                printf("Option --cursor requires the token printed after the previous page\n");
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            options.cursor = argv[++i];
+            options.paged = true;
+        } else if (strcmp(argv[i], "--limit") == 0 || strcmp(argv[i], "--sort-memory") == 0) {
+            bool limit = strcmp(argv[i], "--limit") == 0;
+            char *end = NULL;
+            long value = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+            if (end == NULL || *end != '\0' || value < 1 || (!limit && value > 1024 * 1024)) {
+                printf(limit ? "Invalid limit, expected a positive number\n"
+                             : "Invalid sort memory, expected a number of megabytes from 1 to 1048576\n");
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            if (limit) {
+                options.limit = (size_t) value;
+            } else {
+                options.sort_memory = (size_t) value * 1024 * 1024;
+            }
+        } else if (strcmp(argv[i], "--not") == 0) {
+            negate_next = !negate_next;
+        } else {
+            bool added;
+            if (strcmp(argv[i], "--genre") == 0) {
+                added = add_filter_predicate(&filter, FILTER_GENRE, argv[++i], negate_next);
+            } else if (strcmp(argv[i], "--reading") == 0) {
+                added = add_filter_predicate(&filter, FILTER_READING, NULL, negate_next);
+            } else if (strcmp(argv[i], "--completed") == 0) {
+                added = add_filter_predicate(&filter, FILTER_COMPLETED, NULL, negate_next);
+            } else if (strcmp(argv[i], "--score") == 0) {
+                added = add_filter_predicate(&filter, FILTER_SCORE, argv[++i], negate_next);
+            } else if (strcmp(argv[i], "--author") == 0) {
+                added = add_filter_predicate(&filter, FILTER_AUTHOR, argv[++i], negate_next);
+            } else if (strcmp(argv[i], "--author-prefix") == 0) {
+                added = add_filter_predicate(&filter, FILTER_AUTHOR_PREFIX, argv[++i], negate_next);
+            } else if (strcmp(argv[i], "--started-after") == 0 || strcmp(argv[i], "--started-before") == 0) {
+                int32_t day;
+                if (!parse_filter_date(argv[i], argc, argv, i + 1, &day)) {
+                    genre_dictionary_free(&genre_dictionary);
+                    return;
+                }
+                bool after = strcmp(argv[i++], "--started-after") == 0;
+                added = add_date_range_predicate(&filter, FILTER_START_RANGE, after ? day + 1 : INT32_MIN + 1,
+                                                 after ? INT32_MAX : day - 1, negate_next);
+            } else if (strcmp(argv[i], "--finished-between") == 0) {
+                int32_t first_day;
+                int32_t last_day;
+                if (!parse_filter_date(argv[i], argc, argv, i + 1, &first_day) ||
+                    !parse_filter_date(argv[i], argc, argv, i + 2, &last_day)) {
+                    genre_dictionary_free(&genre_dictionary);
+                    return;
+                }
+                i += 2;
+                added = add_date_range_predicate(&filter, FILTER_END_RANGE, first_day, last_day, negate_next);
+            } else {
+                printf("Unknown filter option: %s\n", argv[i]);
+                print_help();
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            if (!added) {
+                printf("Too many filter options, at most %d are supported\n", FILTER_MAX_PREDICATES);
+                genre_dictionary_free(&genre_dictionary);
+                return;
+            }
+            negate_next = false;
+        }
+    }
+    if (negate_next) {
+        printf("Option --not must be followed by a filter option\n");
+        genre_dictionary_free(&genre_dictionary);
+        return;
+    }
+    if (options.descending && options.sort_field == SORT_NONE) {
+        printf("Option --desc requires --sort\n");
+        genre_dictionary_free(&genre_dictionary);
+        return;
+    }
+    if (options.paged && (options.sort_field != SORT_NONE || options.follow)) {
+        printf("Options --offset and --cursor cannot be combined with --sort or --follow\n");
+        genre_dictionary_free(&genre_dictionary);
+        return;
+    }
+    if (options.follow && (options.sort_field != SORT_NONE || options.limit > 0 || served_journal != NULL)) {
+        printf(served_journal != NULL ? "Option --follow is not served by the daemon, use --no-daemon\n"
+                                      : "Option --follow cannot be combined with --sort or --limit\n");
+        genre_dictionary_free(&genre_dictionary);
+        return;
+    }
+    compile_filter(&filter);
+    list_entries(&filter, &options);
+    genre_dictionary_free(&genre_dictionary);
+}
+
+/**
+ * @brief Checks if an argument of the command line equals `argument`.
+ */
+bool has_argument(int argc, char *argv[], const char *argument) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], argument) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Handles the "export" command, which writes the entries for other programs.
+ *
+ * `export [--format jsonl|tsv|raw] [--file <path>]` takes the options of `list` and runs it with the JSON
+ * lines format unless another one is given. With `--file` the records are written to the file instead of
+ * stdout, the same way the daemon connects a request to its client. The summary goes to stderr.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ */
+void export_cmd(int argc, char *argv[]) {
+    char **list_argv = malloc(((size_t) argc + 2) * sizeof(char *));
+    if (list_argv == NULL) {
+        perror("Failed to allocate memory for export");
+        return;
+    }
+    const char *path = NULL;
+    int list_argc = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i >= 2 && strcmp(argv[i], "--file") == 0) {
+            path = i + 1 < argc ? argv[++i] : "";
+        } else {
+            list_argv[list_argc++] = argv[i];
+        }
+    }
+    if (!has_argument(argc, argv, "--format")) {
+        list_argv[list_argc++] = "--format";
+        list_argv[list_argc++] = "jsonl";
+    }
+    struct stat journal_stat;
+    struct stat file_stat;
+    int fd = -1;
+    if (path != NULL && path[0] == '\0') {
+        printf("Option --file requires the path of the exported file\n");
+    } else if (path != NULL && stat(path, &file_stat) == 0 && stat(JOURNAL_FILE, &journal_stat) == 0 &&
+               file_stat.st_ino == journal_stat.st_ino && file_stat.st_dev == journal_stat.st_dev) {
+        printf("The journal cannot be exported over itself\n");
+    } else if (path != NULL && (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        perror("Failed to open the export file");
+    } else if (path != NULL) {
+        fflush(stdout);
+        int saved_stdout = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        list_cmd(list_argc, list_argv);
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    } else {
+        list_cmd(list_argc, list_argv);
+    }
+    free(list_argv);
+}
+
+/**
+ * @brief Decodes a record ID printed by `list --ids`, `<offset in hex>.<check in hex>`.
+ *
+ * @return True if the ID is well formed. Whether it still names an entry is checked against the journal.
+ */
+bool parse_record_id(const char *text, uint64_t *offset, uint32_t *check) {
+    char *end;
+    errno = 0;
+    unsigned long long position = strtoull(text, &end, 16);
+    if (errno != 0 || end == text || *end != '.' || text[0] == '-') return false;
+    const char *check_text = end + 1;
+    unsigned long value = strtoul(check_text, &end, 16);
+    if (errno != 0 || end == check_text || *end != '\0' || check_text[0] == '-' || value > UINT32_MAX) return false;
+    *offset = position;
+    *check = (uint32_t) value;
+    return true;
+}
+
+/**
+ * @brief Appends one record to the change log of the journal.
+ *
+ * A log which belongs to another journal file is started again, and a record cut short by a crash at the
+ * end of the log is dropped first, so the new record is not read as part of it. The caller holds the
+ * journal lock, which all writers of the log take.
+ *
+ * @param journal_stat The journal the change applies to.
+ * @param overlay The log as loaded by `load_journal_overlay`.
+ * @param record The record.
+ * @param line The new journal line of an update, `record->length` bytes.
+ *
+ * @return True if the record was written, false on an error (which is reported).
+ */
+bool append_change(const struct stat *journal_stat, const JournalOverlay *overlay, const ChangeRecord *record,
+                   const char *line) {
+    int fd = open(JOURNAL_CHANGES_FILE, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("Failed to open the change log");
+        return false;
+    }
+    ChangesHeader header = {JOURNAL_CHANGES_MAGIC, JOURNAL_CHANGES_VERSION, journal_stat->st_ino};
+    struct iovec parts[3] = {{&header, 0}, {(void *) record, sizeof(ChangeRecord)}, {(void *) line, record->length}};
+    bool ok = true;
+    if (overlay->log_end == 0) {
+        ok = ftruncate(fd, 0) == 0;
+        parts[0].iov_len = sizeof(ChangesHeader);
+    } else if (overlay->log_end < overlay->size) {
+        ok = ftruncate(fd, (off_t) overlay->log_end) == 0;
+    }
+    size_t length = parts[0].iov_len + parts[1].iov_len + parts[2].iov_len;
+    ok = ok && writev(fd, parts, 3) == (ssize_t) length;
+    if (!ok) perror("Failed to write the change log");
+    ok = close(fd) == 0 && ok;
+    return ok;
+}
+
+/**
+ * @brief Copies a range of journal lines to the compacted journal, with the changes of the overlay applied.
+ *
+ * The unchanged lines between two changes are copied at once. A deleted line is left out, an updated line
+ * is replaced by its new text.
+ *
+ * @param out The compacted journal.
+ * @param data The journal text.
+ * @param begin Offset of the first line of the range.
+ * @param end End of the range, just after a newline or at the end of the journal.
+ */
+void write_compacted_range(OutputBuffer *out, const char *data, size_t begin, size_t end,
+                           const JournalOverlay *overlay) {
+    const OverlayChange *changes_end = overlay->changes + overlay->count;
+    size_t position = begin;
+    for (const OverlayChange *change = find_overlay_change(overlay, begin);
+         change < changes_end && change->offset < end; change++) {
+        // Empty runs are skipped, the buffer may not be allocated yet and the journal may be empty
+        if (change->offset > position) output_bytes(out, data + position, change->offset - position);
+        const char *newline = memchr(data + change->offset, '\n', end - change->offset);
+        position = newline != NULL ? (size_t) (newline - data) + 1 : end;
+        if (change->deleted) continue;
+        output_slice(out, change->line);
+        output_bytes(out, "\n", 1);
+    }
+    if (end > position) output_bytes(out, data + position, end - position);
+}
+
+/**
+ * @brief Writes the changes of the change log into the journal and removes the log.
+ *
+ * The journal is rewritten into a temporary file in one streaming pass and renamed over the journal, so
+ * readers see either the old or the new file. Writers are not blocked during the pass: only the lines
+ * appended meanwhile are copied while the journal lock is held, just before the rename. If the log changed
+ * during the pass, the whole journal is copied again under the lock. Record IDs are offsets of the lines,
+ * so entries after a changed line get new IDs.
+ *
+ * @param verbose True to print the result, a background compaction only reports errors.
+ *
+ * @return True if the journal was compacted or there was nothing to do.
+ */
+bool compact_journal(bool verbose) {
+    int fd = open(JOURNAL_FILE, O_RDONLY | O_CLOEXEC);
+    MappedJournal journal;
+    if (fd < 0 || !map_journal(fd, &journal)) {
+        perror("Failed to open the journal for compaction");
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    close(fd);
+    JournalOverlay overlay;
+    bool ok = load_journal_overlay(journal.data, journal.size, &journal.file_stat, &overlay);
+    if (ok && overlay.record_count == 0) {
+        if (verbose) printf("Nothing to compact, the journal has no changes\n");
+        free_journal_overlay(&overlay);
+        unmap_journal(&journal);
+        return true;
+    }
+    char temp_path[64];
+    int temp = ok ? create_temp_file(JOURNAL_FILE, temp_path, sizeof(temp_path)) : -1;
+    OutputBuffer out;
+    output_init(&out, temp);
+    // Complete lines are copied without the lock, the rest once the writers are stopped
+    const char *last_newline = journal.size > 0 ? memrchr(journal.data, '\n', journal.size) : NULL;
+    size_t copied = last_newline != NULL ? (size_t) (last_newline - journal.data) + 1 : 0;
+    if (temp >= 0) write_compacted_range(&out, journal.data, 0, copied, &overlay);
+    size_t log_size = overlay.size;
+    uint64_t inode = journal.file_stat.st_ino;
+    size_t applied = overlay.count;
+    size_t old_size = journal.size;
+    unmap_journal(&journal);
+
+    int locked = temp >= 0 && !out.failed ? open_locked_journal() : -1;
+    struct stat log_stat;
+    ok = locked >= 0 && map_journal(locked, &journal) && journal.file_stat.st_ino == inode;
+    if (ok && (stat(JOURNAL_CHANGES_FILE, &log_stat) != 0 || (size_t) log_stat.st_size != log_size)) {
+        // Changes were made during the pass, copy everything again with the log as it is now
+        free_journal_overlay(&overlay);
+        output_flush(&out);
+        ok = !out.failed && ftruncate(temp, 0) == 0 && lseek(temp, 0, SEEK_SET) == 0 &&
+             load_journal_overlay(journal.data, journal.size, &journal.file_stat, &overlay);
+        copied = 0;
+        applied = overlay.count;
+    }
+    if (ok) {
+        write_compacted_range(&out, journal.data, copied, journal.size, &overlay);
+        old_size = journal.size;
+    }
+    if (locked >= 0) unmap_journal(&journal);
+    output_flush(&out);
+    ok = ok && !out.failed && fchmod(temp, journal.file_stat.st_mode & 07777) == 0 && fsync(temp) == 0;
+    off_t new_size = temp >= 0 ? lseek(temp, 0, SEEK_END) : 0;
+    output_free(&out);
+    if (temp >= 0) ok = close(temp) == 0 && ok;
+    ok = ok && rename(temp_path, JOURNAL_FILE) == 0 && unlink(JOURNAL_CHANGES_FILE) == 0;
+    if (!ok && temp >= 0) unlink(temp_path);
+    if (locked >= 0) close(locked);
+    free_journal_overlay(&overlay);
+    if (!ok) {
+        perror("Failed to compact the journal");
+        return false;
+    }
+    if (verbose) {
+        printf("Compacted the journal: %zu changes applied, %zu bytes before, %lld bytes now\n", applied,
+               old_size, (long long) new_size);
+    }
+    return true;
+}
+
+/**
+ * @brief Compacts the journal in a child process, so the command that filled the change log returns at once.
+ */
+void start_background_compaction() {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t child = fork();
+    if (child == 0) _exit(compact_journal(false) ? 0 : 1);
+    if (child < 0) {
+        perror("Failed to start the compaction");
+    } else {
+        printf("The change log has %d or more records, compacting the journal in the background\n",
+               COMPACT_CHANGE_THRESHOLD);
+    }
+}
+
+/**
+ * @brief Handles the "update" and "delete" commands, which change an entry without rewriting the journal.
+ *
+ * The entry is named by its record ID, printed by `list --ids`. A change is appended to the change log
+ * `JOURNAL_CHANGES_FILE` while the journal lock is held: the new line of an updated entry, or a tombstone of
+ * a deleted one. List applies the changes when it reads the journal. Once the log has
+ * `COMPACT_CHANGE_THRESHOLD` records, the journal is compacted in the background (`compact_journal`).
+ *
+ * `update --id <id>` takes the options of `new`, each replacing one field of the entry. An empty `--end`,
+ * `--score` or `--note` removes the field. The changed entry goes through `entry_validation_error`.
+ *
+ * The record ID carries the hash of the journal line (`parse_record_id`). An ID whose line is gone or holds
+ * another entry, as after `compact`, is rejected.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ * @param kind `CHANGE_UPDATE` or `CHANGE_DELETE`.
+ *
+ * @return The exit code, 1 if the entry was not changed.
+ */
+int change_cmd(int argc, char *argv[], ChangeKind kind) {
+    const char *command = kind == CHANGE_UPDATE ? "update" : "delete";
+    const char *id_text = NULL;
+    for (int i = 2; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--id") == 0) id_text = argv[i + 1];
+    }
+    uint64_t id;
+    uint32_t id_check;
+    if (id_text == NULL || !parse_record_id(id_text, &id, &id_check)) {
+        printf("The %s command needs the record ID of an entry: --id <id>, as printed by list --ids\n", command);
+        return 1;
+    }
+    int fd = open_locked_journal();
+    if (fd < 0) return 1;
+    MappedJournal journal;
+    JournalOverlay overlay;
+    memset(&overlay, 0, sizeof(JournalOverlay));
+    if (!map_journal(fd, &journal)) {
+        printf("Only a regular journal file can be changed\n");
+        close(fd);
+        return 1;
+    }
+    bool ok = load_journal_overlay(journal.data, journal.size, &journal.file_stat, &overlay);
+    JournalEntry entry;
+    TextSlice original = {NULL, 0};
+    if (ok && id < journal.size && (id == 0 || journal.data[id - 1] == '\n')) {
+        const char *newline = memchr(journal.data + id, '\n', journal.size - id);
+        original.data = journal.data + id;
+        original.length = (newline != NULL ? newline : journal.data + journal.size) - original.data;
+    }
+    // An ID printed before `compact` moved the lines may point to another line now
+    if (ok && original.data != NULL && hash_slice(original) != id_check) original.data = NULL;
+    const OverlayChange *change = find_overlay_change(&overlay, id);
+    bool changed = change < overlay.changes + overlay.count && change->offset == id;
+    TextSlice current = changed && !change->deleted ? change->line : original;
+    if (ok && (original.data == NULL || (changed && change->deleted) ||
+               !parse_entry(current.data, current.length, &entry))) {
+        printf("No entry with record ID %s, IDs change when the journal is compacted, list them again\n", id_text);
+        ok = false;
+    }
+
+    Arena arena;
+    arena_init(&arena);
+    OutputBuffer line;
+    output_init(&line, -1);
+    for (int i = 2; ok && kind == CHANGE_UPDATE && i < argc; i++) {
+        char *value = get_option_value(&arena, argc, argv, i);
+        bool empty = value != NULL && value[0] == '\0';
+        if (strcmp(argv[i], "--name") == 0) {
+            entry.book_name = slice_from_string(value);
+        } else if (strcmp(argv[i], "--author") == 0) {
+            entry.author = slice_from_string(value);
+        } else if (strcmp(argv[i], "--genre") == 0) {
+            entry.genre = slice_from_string(value);
+        } else if (strcmp(argv[i], "--start") == 0) {
+            entry.start_date = slice_from_string(get_date(value));
+            ok = value == NULL || slice_is_present(entry.start_date);
+        } else if (strcmp(argv[i], "--end") == 0) {
+            entry.end_date = empty ? (TextSlice) {NULL, 0} : slice_from_string(get_date(value));
+            ok = empty || value == NULL || slice_is_present(entry.end_date);
+        } else if (strcmp(argv[i], "--score") == 0) {
+            if (empty) {
+                entry.score = 0;
+            } else if (value != NULL) {
+                ok = get_score(value, &entry.score);
+            }
+        } else if (strcmp(argv[i], "--note") == 0) {
+            entry.note = empty ? (TextSlice) {NULL, 0} : slice_from_string(value);
+        } else {
+            continue;
+        }
+        if (value == NULL) {
+            printf("Missing value for %s\n", argv[i]);
+            ok = false;
+        }
+        i++;
+    }
+    const char *error = ok && kind == CHANGE_UPDATE ? entry_validation_error(&entry) : NULL;
+    if (error != NULL) {
+        printf("Error: %s\n", error);
+        ok = false;
+    }
+    if (ok && kind == CHANGE_UPDATE) output_journal_line(&line, &entry);
+    // The record holds the line without its newline
+    ChangeRecord record = {id, ok ? hash_slice(original) : 0, kind, line.used > 0 ? line.used - 1 : 0};
+    ok = ok && !line.failed && append_change(&journal.file_stat, &overlay, &record, line.data);
+    size_t record_count = overlay.record_count + 1;
+    free_journal_overlay(&overlay);
+    unmap_journal(&journal);
+    close(fd);
+    // The fields may point into the journal or the log, which are released, so the new line is printed
+    if (ok && kind == CHANGE_UPDATE && parse_entry(line.data, record.length, &entry)) {
+        printf("Entry updated:\n");
+        fflush(stdout);
+        OutputBuffer out;
+        output_init(&out, STDOUT_FILENO);
+        print_entry(&out, &entry);
+        output_free(&out);
+    } else if (ok) {
+        printf("Entry %s deleted\n", id_text);
+    }
+    output_free(&line);
+    arena_free(&arena);
+    if (ok && record_count >= COMPACT_CHANGE_THRESHOLD) start_background_compaction();
+    return ok ? 0 : 1;
+}
+
+/**
+ * @brief Handles the "compact" command, which writes the changes of `update` and `delete` into the journal.
+ *
+ * @return The exit code, 1 if the journal could not be compacted.
+ */
+int compact_cmd() {
+    return compact_journal(true) ? 0 : 1;
+}
+
+/**
+ * @brief Handles the "index" command, which builds or refreshes the sidecar index of the journal.
+ *
+ * Once the index exists, `list` reads the journal through it and rebuilds it automatically whenever the
+ * journal changes.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program. The command has no options.
+ */
+void index_cmd(int argc, char *argv[]) {
+    (void) argc;
+    (void) argv;
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+        return;
+    }
+    MappedJournal journal;
+    if (!map_journal(fd, &journal)) {
+        printf("Journal file cannot be indexed, it is not a regular file\n");
+        close(fd);
+        return;
+    }
+    JournalIndex index;
+    if (load_journal_index(&journal, &index)) {
+        printf("Journal index %s is up to date: %llu lines\n", JOURNAL_INDEX_FILE,
+               (unsigned long long) index.header->record_count);
+        close_journal_index(&index);
+    }
+    unmap_journal(&journal);
+    close(fd);
+}
+
+/**
+ * @brief Compresses one block of the store and appends it to the store file.
+ *
+ * @param compressed Buffer for the compressed data, grown as needed.
+ */
+bool write_store_block(FILE *file, StoreBlock *block, const char *text, uint8_t **compressed,
+                       size_t *compressed_capacity, uint64_t *data_offset) {
+    size_t bound = lz_compress_bound(block->text_length);
+    if (bound > *compressed_capacity) {
+        uint8_t *grown = realloc(*compressed, bound);
+        if (grown == NULL) return false;
+        *compressed = grown;
+        *compressed_capacity = bound;
+    }
+    size_t length = lz_compress((const uint8_t *) text, block->text_length, *compressed);
+    block->data_offset = *data_offset;
+    block->compressed_length = (uint32_t) length;
+    block->checksum = store_checksum(*compressed, length);
+    *data_offset += length;
+    return fwrite(*compressed, 1, length, file) == length;
+}
+
+/**
+ * @brief Builds the compressed store of the complete lines of the mapped journal, see `StoreHeader`.
+ *
+ * Lines are split by a `LineTokenizer` and grouped into blocks of `STORE_BLOCK_LINES` lines (or fewer, if
+ * their text reaches `STORE_BLOCK_SIZE`). Each block is compressed on its own by `lz_compress` and
+ * streamed to the file, only the block headers and the genres are kept in memory. The store is written to
+ * a temporary file and renamed over `JOURNAL_STORE_FILE`.
+ *
+ * @param journal The mapped journal.
+ * @param header Receives the header of the new store.
+ *
+ * @return True if the store was written, false on an I/O error (which is reported).
+ */
+bool build_journal_store(const MappedJournal *journal, StoreHeader *header) {
+    const char *temp_path = JOURNAL_STORE_FILE ".tmp";
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        perror("Failed to create compressed store");
+        return false;
+    }
+    const char *last_newline = journal->size > 0 ? memrchr(journal->data, '\n', journal->size) : NULL;
+    size_t covered = last_newline != NULL ? (size_t) (last_newline - journal->data) + 1 : 0;
+    memset(header, 0, sizeof(StoreHeader));
+    header->magic = JOURNAL_STORE_MAGIC;
+    header->version = JOURNAL_STORE_VERSION;
+    header->journal_inode = journal->file_stat.st_ino;
+    header->covered_size = covered;
+    bool ok = fwrite(header, sizeof(StoreHeader), 1, file) == 1 &&
+              (covered == 0 || journal_tail_hash(-1, journal->data, covered, &header->tail_hash));
+
+    GenreDictionary genres;
+    memset(&genres, 0, sizeof(GenreDictionary));
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    StoreBlock *blocks = NULL;
+    size_t block_capacity = 0;
+    uint8_t *compressed = NULL;
+    size_t compressed_capacity = 0;
+    uint64_t data_offset = sizeof(StoreHeader);
+    ok = ok && tokenizer != NULL;
+    if (ok && covered > 0) {
+        init_line_tokenizer(tokenizer, journal->data, journal->data + covered, select_delimiter_scanner());
+        StoreBlock block;
+        init_store_block(&block, 0);
+        size_t lines = 0;
+        TokenizedLine line;
+        bool more = true;
+        while (ok && more) {
+            more = next_tokenized_line(tokenizer, &line);
+            size_t text_end = covered;
+            if (more) {
+                add_store_line(&block, line.fields, line.field_count, &genres);
+                lines++;
+                text_end = (size_t) (line.data - journal->data) + line.length + 1;
+                if (text_end > covered) text_end = covered;
+                if (lines < STORE_BLOCK_LINES && text_end - block.text_offset < STORE_BLOCK_SIZE) continue;
+            }
+            if (lines == 0) break;
+            block.text_length = (uint32_t) (text_end - block.text_offset);
+            if (header->block_count == block_capacity) {
+                block_capacity = block_capacity == 0 ? 256 : block_capacity * 2;
+                StoreBlock *grown = realloc(blocks, block_capacity * sizeof(StoreBlock));
+                if (grown == NULL) {
+                    ok = false;
+                    break;
+                }
+                blocks = grown;
+            }
+            ok = write_store_block(file, &block, journal->data + block.text_offset, &compressed,
+                                   &compressed_capacity, &data_offset);
+            if (block.text_length > header->max_block_length) header->max_block_length = block.text_length;
+            blocks[header->block_count++] = block;
+            init_store_block(&block, text_end);
+            lines = 0;
+        }
+    }
+    header->genre_table_offset = data_offset;
+    header->genre_count = (uint32_t) genres.count;
+    for (size_t i = 0; ok && i < genres.count; i++) {
+        uint32_t length = (uint32_t) genres.names[i].length;
+        ok = fwrite(&length, sizeof(uint32_t), 1, file) == 1 &&
+             fwrite(genres.names[i].data, 1, length, file) == length;
+        data_offset += sizeof(uint32_t) + length;
+    }
+    static const char padding[8] = {0};
+    size_t padding_length = (8 - data_offset % 8) % 8;
+    header->blocks_offset = data_offset + padding_length;
+    ok = ok && fwrite(padding, 1, padding_length, file) == padding_length &&
+         fwrite(blocks, sizeof(StoreBlock), header->block_count, file) == header->block_count;
+    free(blocks);
+    free(compressed);
+    free(tokenizer);
+    genre_dictionary_free(&genres);
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(StoreHeader), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (ok && rename(temp_path, JOURNAL_STORE_FILE) == 0) return true;
+    perror("Failed to write compressed store");
+    unlink(temp_path);
+    return false;
+}
+
+/**
+ * @brief Handles the "pack" command, which builds the compressed store of the journal.
+ *
+ * The store (`JOURNAL_STORE_FILE`) holds the complete lines of the journal in compressed blocks with zone
+ * maps. Unless the sidecar index exists, `list` reads the journal from the store, skips the blocks the
+ * filter rejects and reads only the lines appended since the store was built from the text. The store is
+ * not updated by appends, running `pack` again rebuilds it.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program. The command has no options.
+ */
+void pack_cmd(int argc, char *argv[]) {
+    if (argc > 2) {
+        printf("Unknown option for pack command: %s\n", argv[2]);
+        return;
+    }
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+        return;
+    }
+    MappedJournal journal;
+    if (!map_journal(fd, &journal)) {
+        printf("Journal file cannot be compressed, it is not a regular file\n");
+        close(fd);
+        return;
+    }
+    StoreHeader header;
+    struct stat store_stat;
+    if (build_journal_store(&journal, &header) && stat(JOURNAL_STORE_FILE, &store_stat) == 0) {
+        printf("Compressed store %s: %llu blocks, %llu bytes of journal into %llu bytes (%.1f%%)\n",
+               JOURNAL_STORE_FILE, (unsigned long long) header.block_count,
+               (unsigned long long) header.covered_size, (unsigned long long) store_stat.st_size,
+               header.covered_size > 0 ? 100.0 * (double) store_stat.st_size / (double) header.covered_size : 0.0);
+    }
+    unmap_journal(&journal);
+    close(fd);
+}
+
+/**
+ * @brief Checks one journal line for the `verify` command.
+ *
+ * Besides the rules of `entry_validation_error`, which every written entry has to pass, the line must have
+ * the four required fields, at most `JOURNAL_FIELD_COUNT` fields and a score that is empty or a single digit
+ * from 1 to 5.
+ *
+ * @return NULL for a valid line, otherwise a description of the first problem found.
+ */
+const char *verify_line_error(const TokenizedLine *line) {
+    if (line->field_count < 4) return "missing required fields";
+    const TextSlice *last = &line->fields[line->field_count - 1];
+    if (last->data + last->length != line->data + line->length) return "too many fields";
+    if (line->field_count > 5) {
+        TextSlice score = line->fields[5];
+        if (score.length > 1 || (score.length == 1 && (score.data[0] < '1' || score.data[0] > '5'))) {
+            return "score must be from 1 to 5";
+        }
+    }
+    JournalEntry entry;
+    entry_from_fields(&entry, line->fields, line->field_count);
+    return entry_validation_error(&entry);
+}
+
+/**
+ * @brief Verifies a range of whole lines of a mapped journal, see `RangeScanner`.
+ *
+ * Every invalid line is reported with its byte offset in the journal. `counts->total` counts the lines and
+ * `counts->listed` the invalid ones. Lines changed by `update` or `delete` are checked as `list` reads them,
+ * with the text of `journal_overlay`.
+ */
+void verify_mapped_range(const char *data, size_t begin, size_t end, const JournalFilter *filter,
+                         ListCounts *counts, OutputBuffer *out) {
+    (void) filter;
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    if (tokenizer == NULL) {
+        perror("Failed to allocate memory for journal tokenizer");
+        out->failed = true;
+        return;
+    }
+    init_line_tokenizer(tokenizer, data + begin, data + end, select_delimiter_scanner());
+    const OverlayChange *change = find_overlay_change(&journal_overlay, begin);
+    TokenizedLine line;
+    while (next_tokenized_line(tokenizer, &line)) {
+        size_t line_offset = (size_t) (line.data - data);
+        if (!apply_overlay_change(&line, line_offset, &change)) continue;
+        counts->total++;
+        const char *error = verify_line_error(&line);
+        if (error == NULL) continue;
+        char offset[32];
+        int length = snprintf(offset, sizeof(offset), "%zu", line_offset);
+        output_string(out, "Invalid line at offset ");
+        output_bytes(out, offset, (size_t) length);
+        output_string(out, ": ");
+        output_string(out, error);
+        output_string(out, "\n");
+        counts->listed++;
+    }
+    free(tokenizer);
+}
+
+/**
+ * @brief Handles the "verify" command, which checks the integrity of the whole journal.
+ *
+ * Every line is checked by `verify_line_error` and invalid lines are reported by their byte offset, in file
+ * order. Lines deleted by `delete` are not checked and lines changed by `update` are checked with their new
+ * text, so the journal is verified as `list` reads it. The journal is memory-mapped and checked by worker threads in parallel (`run_parallel_scan`),
+ * one per online CPU unless `--threads <count>` says otherwise.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ *
+ * @return The exit status of the program: 0 if the journal is valid, 1 if it has invalid lines or cannot
+ *         be read.
+ */
+int verify_cmd(int argc, char *argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > LIST_MAX_THREADS) threads = LIST_MAX_THREADS;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0) {
+            char *end = NULL;
+            threads = i + 1 < argc ? strtol(argv[++i], &end, 10) : 0;
+            if (end == NULL || *end != '\0' || threads < 1 || threads > LIST_MAX_THREADS) {
+                printf("Invalid thread count, expected a number from 1 to %d\n", LIST_MAX_THREADS);
+                return 1;
+            }
+        } else {
+            printf("Unknown option for verify command: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+        return 1;
+    }
+    MappedJournal journal;
+    if (!map_journal(fd, &journal)) {
+        printf("Journal file cannot be verified, it is not a regular file\n");
+        close(fd);
+        return 1;
+    }
+    ListCounts counts = {0, 0};
+    OutputBuffer out;
+    output_init(&out, STDOUT_FILENO);
+    bool ok = load_journal_overlay(journal.data, journal.size, &journal.file_stat, &journal_overlay);
+    if (!ok) {
+        // Nothing is verified, the failure is reported below
+    } else if (threads <= 1 || journal.size <= LIST_CHUNK_SIZE) {
+        verify_mapped_range(journal.data, 0, journal.size, NULL, &counts, &out);
+    } else {
+        ok = run_parallel_scan(&journal, verify_mapped_range, NULL, &counts, (int) threads, &out);
+    }
+    ok = ok && !out.failed;
+    output_free(&out);
+    free_journal_overlay(&journal_overlay);
+    unmap_journal(&journal);
+    close(fd);
+    if (!ok) {
+        printf("Journal verification failed\n");
+        return 1;
+    }
+    printf("Verified %zu lines, %zu invalid\n", counts.total, counts.listed);
+    return counts.listed > 0 ? 1 : 0;
+}
+
+/**
+ * @brief Adds the entries of a range of whole lines of the mapped journal to the aggregates.
+ *
+ * Lines without the required fields are counted in `invalid_lines`, like the lines list reports. Lines
+ * changed by `update` or `delete` are counted as `journal_overlay` has them.
+ */
+void scan_stats_range(JournalStats *stats, const MappedJournal *journal, size_t begin) {
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    if (tokenizer == NULL) {
+        perror("Failed to allocate memory for journal tokenizer");
+        stats->failed = true;
+        return;
+    }
+    init_line_tokenizer(tokenizer, journal->data + begin, journal->data + journal->size, select_delimiter_scanner());
+    const OverlayChange *change = find_overlay_change(&journal_overlay, begin);
+    TokenizedLine line;
+    JournalEntry entry;
+    while (next_tokenized_line(tokenizer, &line)) {
+        if (!apply_overlay_change(&line, (uint64_t) (line.data - journal->data), &change)) continue;
+        if (entry_from_fields(&entry, line.fields, line.field_count)) {
+            add_stats_entry(stats, &entry);
+        } else {
+            stats->invalid_lines++;
+        }
+    }
+    free(tokenizer);
+}
+
+/**
+ * @brief Orders group IDs by the group name, for `qsort_r` with the dictionary of the groups as context.
+ */
+int compare_stats_groups(const void *a, const void *b, void *context) {
+    const GenreDictionary *groups = context;
+    TextSlice left = groups->names[*(const uint32_t *) a];
+    TextSlice right = groups->names[*(const uint32_t *) b];
+    int order = memcmp(left.data, right.data, left.length < right.length ? left.length : right.length);
+    if (order != 0) return order;
+    return (left.length > right.length) - (left.length < right.length);
+}
+
+/**
+ * @brief Prints one row of the stats table. Averages of groups without any value are printed as "-".
+ */
+void print_stats_row(const char *name, const StatsCounters *counters) {
+    char score[16] = "-";
+    char days[24] = "-";
+    if (counters->scored > 0) snprintf(score, sizeof(score), "%.2f", (double) counters->score_sum / counters->scored);
+    if (counters->timed > 0) snprintf(days, sizeof(days), "%.1f", (double) counters->duration_sum / counters->timed);
+    double completed = counters->entries > 0 ? 100.0 * counters->completed / counters->entries : 0;
+    printf("%-24s %7llu %9s %9.1f%% %9s\n", name, (unsigned long long) counters->entries, score, completed, days);
+}
+
+/**
+ * @brief Prints the aggregates of one grouping as a table ordered by the group name, with a total row.
+ */
+void print_journal_stats(const JournalStats *stats, StatsGrouping grouping) {
+    static const char *const grouping_names[STATS_GROUPINGS] = {"genre", "author", "year"};
+    const GenreDictionary *groups = &stats->groups[grouping];
+    uint32_t *order = malloc((groups->count + 1) * sizeof(uint32_t));
+    if (order == NULL) {
+        perror("Failed to allocate memory for journal stats");
+        return;
+    }
+    StatsCounters total = {0, 0, 0, 0, 0, 0};
+    for (size_t id = 0; id < groups->count; id++) {
+        order[id] = (uint32_t) id;
+        add_stats_counters(&total, &stats->counters[grouping][id]);
+    }
+    qsort_r(order, groups->count, sizeof(uint32_t), compare_stats_groups, (void *) groups);
+    printf("Stats by %s\n", grouping_names[grouping]);
+    printf("%-24s %7s %9s %10s %9s\n", "Group", "Books", "Avg score", "Completed", "Avg days");
+    for (size_t i = 0; i < groups->count; i++) {
+        print_stats_row(groups->names[order[i]].data, &stats->counters[grouping][order[i]]);
+    }
+    print_stats_row("Total", &total);
+    if (stats->invalid_lines > 0) {
+        printf("Skipped %llu invalid lines\n", (unsigned long long) stats->invalid_lines);
+    }
+    free(order);
 }
 
 /**
- * @brief Splits a string into tokens based on specified delimiters.
+ * @brief Handles the "stats" command, which prints aggregates of the journal grouped by genre, author or
+ *        start year: the number of books, the average score, the completion rate and the average reading
+ *        duration in days.
  *
- * This function extracts the next token from the string pointed to by `*stringp`, where tokens are
- * delimited by any of the characters in the string `delim`. It modifies the input string in-place,
- * replacing the first delimiter encountered with a null terminator (`'\0'`) and updating `*stringp`
- * to point to the character following the token. If no more tokens are found, `*stringp` is set to NULL.
+ * The aggregates come from the state file `JOURNAL_STATS_FILE` when it still describes the journal, so an
+ * unchanged journal is not scanned at all. The writers do not touch the state file, so after `new` and
+ * `import` the journal only grew past it and just the appended lines are scanned. Otherwise the whole
+ * mapped journal is scanned in one pass. The state file is then rewritten under the journal lock, unless
+ * the journal changed meanwhile or its last line is not terminated yet.
  *
- * @param stringp A pointer to the string pointer to be tokenized. This parameter must not be NULL.
- *                The string pointed to by `*stringp` is updated to reflect progress through the string.
- *                On the first call, `*stringp` should point to the start of the string to tokenize.
- * @param delim A null-terminated string containing the delimiter characters. The function treats each
- *              character in `delim` as a possible token delimiter. This parameter must not be NULL.
+ * The state file describes the journal text only. While the change log holds changes of `update` and
+ * `delete`, it is neither read nor written and the whole journal is scanned with the changes applied.
  *
- * @return A pointer to the next token extracted from the string, or NULL if there are no more tokens.
+ * Options:
+ * - `--by genre|author|year`: the grouping, `genre` by default.
  *
- * - If `*stringp` points to NULL when the function is called, NULL is returned.
- * - The function uses `strcspn` to determine the position of the first delimiter within the input string.
- * - If a delimiter is found, it is replaced with a null terminator (`'\0`), effectively splitting the string.
- * - After processing, `*stringp` is updated to point to the next segment of the input string.
- * - If the end of the string is reached, `*stringp` is set to NULL, indicating there are no more tokens.
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
  */
-char *strsep(char **stringp, const char *delim) {
-    char *rv = *stringp;
-    if (rv) {
-        *stringp += strcspn(*stringp, delim);
-        if (**stringp) {
-            *(*stringp)++ = '\0';
+void stats_cmd(int argc, char *argv[]) {
+    StatsGrouping grouping = STATS_BY_GENRE;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--by") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "genre") == 0) {
+                grouping = STATS_BY_GENRE;
+            } else if (strcmp(argv[i], "author") == 0) {
+                grouping = STATS_BY_AUTHOR;
+            } else if (strcmp(argv[i], "year") == 0) {
+                grouping = STATS_BY_YEAR;
+            } else {
+                printf("Unknown stats grouping: %s, expected genre, author or year\n", argv[i]);
+                return;
+            }
+        } else {
+            printf("Unknown option for stats command: %s\n", argv[i]);
+            return;
+        }
+    }
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+        return;
+    }
+    MappedJournal journal;
+    if (!map_journal(fd, &journal)) {
+        printf("Journal file cannot be mapped, it is not a regular file\n");
+        close(fd);
+        return;
+    }
+    if (!load_journal_overlay(journal.data, journal.size, &journal.file_stat, &journal_overlay)) {
+        unmap_journal(&journal);
+        close(fd);
+        return;
+    }
+    bool changed = journal_overlay.count > 0;
+    JournalStats stats;
+    StatsHeader header;
+    memset(&stats, 0, sizeof(JournalStats));
+    size_t covered = 0;
+    uint32_t tail_hash;
+    if (!changed && read_stats_file(&stats, &header)) {
+        if (stats_match_journal(&header, &journal.file_stat)) {
+            covered = journal.size;
+        } else if (header.journal_inode == (uint64_t) journal.file_stat.st_ino && header.journal_size > 0 &&
+                   header.journal_size < journal.size &&
+                   journal.data[header.journal_size - 1] == '\n' &&
+                   journal_tail_hash(fd, journal.data, header.journal_size, &tail_hash) &&
+                   tail_hash == header.tail_hash) {
+            covered = header.journal_size;
         } else {
-            *stringp = 0;
+            free_journal_stats(&stats);
+        }
+    }
+    if (covered < journal.size) {
+        scan_stats_range(&stats, &journal, covered);
+        if (!changed && !stats.failed && journal.data[journal.size - 1] == '\n' &&
+            journal_tail_hash(fd, journal.data, journal.size, &tail_hash)) {
+            int locked;
+            while ((locked = flock(fd, LOCK_EX)) != 0 && errno == EINTR) {}
+            struct stat current;
+            if (locked == 0 && fstat(fd, &current) == 0 && current.st_size == journal.file_stat.st_size &&
+                current.st_mtim.tv_sec == journal.file_stat.st_mtim.tv_sec &&
+                current.st_mtim.tv_nsec == journal.file_stat.st_mtim.tv_nsec) {
+                write_stats_file(&stats, &journal.file_stat, tail_hash);
+            }
+            flock(fd, LOCK_UN);
         }
     }
-    return rv;
+    if (stats.failed) {
+        printf("Journal stats failed, out of memory\n");
+    } else {
+        print_journal_stats(&stats, grouping);
+    }
+    free_journal_stats(&stats);
+    free_journal_overlay(&journal_overlay);
+    unmap_journal(&journal);
+    close(fd);
 }
 
 /**
- * @brief Validates if the given string represents a valid date in the format YYYY-MM-DD.
+ * @brief Number of bytes of a value encoded by `write_varint`.
+ */
+size_t varint_length(uint32_t value) {
+    size_t length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+/**
+ * @brief Writes a value as a varint, 7 bits per byte starting with the lowest, the high bit marks that more
+ *        bytes follow.
  *
- * This function checks whether the input string conforms to the ISO 8601 date format (YYYY-MM-DD),
- * verifies that the year, month, and day values are within valid ranges, and accounts for leap years
- * when determining the number of days in February.
+ * @return The position after the value.
+ */
+uint8_t *write_varint(uint8_t *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t) value;
+    return out;
+}
+
+/**
+ * @brief Reads a value written by `write_varint`.
  *
- * @param date A null-terminated C-string representing the date to be validated. The input should follow
- *             the fixed-length format of "YYYY-MM-DD" (10 characters). The string must not be null.
+ * @return The position after the value, or NULL if the value is truncated or too long.
+ */
+const uint8_t *read_varint(const uint8_t *cursor, const uint8_t *end, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; cursor < end && shift < 35; shift += 7) {
+        uint8_t byte = *cursor++;
+        result |= (uint32_t) (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = result;
+            return cursor;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Builds the search index of the journal and starts an empty delta for it.
  *
- * @return True if the input string is a valid date in the format YYYY-MM-DD, otherwise false.
+ * The journal is tokenized twice. The first pass collects the line offsets and the size of every posting
+ * list, the second one writes the varint encoded postings straight into the mapped index file, so the
+ * memory needed does not grow with the number of postings. A bucket gets each line only once, `last`
+ * remembers the last line added to every bucket.
  *
- * - If the input string is null or does not have a length of 10, the function returns false.
- * - Each character of the input string is validated to ensure that it either represents a digit or the
- *   expected '-' separator in the appropriate positions (4th and 7th indices).
- * - The year, month, and day are extracted and validated to ensure they fall within permissible ranges:
- *   - Month must be in the range [1, 12].
- *   - Day must be greater than or equal to 1.
- *   - Day must not exceed the maximum number of days in the respective month for the given year.
- * - The function dynamically adjusts February's days in leap years, where the number of days is updated
- *   from 28 to 29 when applicable.
+ * @param journal The mapped journal to index.
  *
+ * @return True if the index was written, false on an error (which is reported).
  */
-bool is_valid_date(const char *date) {
-    if (date == NULL || strlen(date) != 10) return false;
+bool build_search_index(const MappedJournal *journal) {
+    uint32_t *last = malloc(SEARCH_BUCKETS * sizeof(uint32_t));
+    uint64_t *starts = calloc(SEARCH_BUCKETS + 1, sizeof(uint64_t));
+    uint64_t *positions = malloc(SEARCH_BUCKETS * sizeof(uint64_t));
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    uint64_t *lines = NULL;
+    uint32_t *buckets = NULL;
+    size_t line_count = 0;
+    size_t line_capacity = 0;
+    size_t bucket_capacity = 0;
+    char temp_path[64];
+    int fd = -1;
+    char *mapping = MAP_FAILED;
+    size_t size = 0;
+    SearchIndexHeader header;
+    bool ok = last != NULL && starts != NULL && positions != NULL && tokenizer != NULL;
+    for (int pass = 0; ok && pass < 2; pass++) {
+        memset(last, 0xff, SEARCH_BUCKETS * sizeof(uint32_t));
+        init_line_tokenizer(tokenizer, journal->data, journal->data + journal->size, select_delimiter_scanner());
+        uint32_t line_number = 0;
+        TokenizedLine line;
+        while (ok && next_tokenized_line(tokenizer, &line)) {
+            if (line.field_count < 4) continue;
+            if (pass == 0 && line_count == line_capacity) {
+                line_capacity = line_capacity == 0 ? 4096 : line_capacity * 2;
+                uint64_t *resized = realloc(lines, line_capacity * sizeof(uint64_t));
+                if (resized == NULL) ok = false;
+                else lines = resized;
+            }
+            if (line.length > bucket_capacity) {
+                bucket_capacity = line.length * 2;
+                uint32_t *resized = realloc(buckets, bucket_capacity * sizeof(uint32_t));
+                if (resized == NULL) ok = false;
+                else buckets = resized;
+            }
+            if (!ok) break;
+            if (pass == 0) lines[line_count++] = (uint64_t) (line.data - journal->data);
+            size_t found = line_trigram_buckets(line.fields, line.field_count, buckets);
+            for (size_t i = 0; i < found; i++) {
+                uint32_t bucket = buckets[i];
+                if (last[bucket] == line_number) continue;
+                uint32_t gap = last[bucket] == UINT32_MAX ? line_number : line_number - last[bucket];
+                last[bucket] = line_number;
+                if (pass == 0) {
+                    starts[bucket + 1] += varint_length(gap);
+                } else {
+                    positions[bucket] = write_varint((uint8_t *) mapping + positions[bucket], gap) - (uint8_t *) mapping;
+                }
+            }
+            line_number++;
+        }
+        if (!ok || pass == 1) break;
 
-    // Check format YYYY-MM-DD
-    for (int i = 0; i < 10; i++) {
-        if (i == 4 || i == 7) {
-            if (date[i] != '-') return false;
+        for (size_t bucket = 0; bucket < SEARCH_BUCKETS; bucket++) starts[bucket + 1] += starts[bucket];
+        size_t postings_offset = sizeof(SearchIndexHeader) + (line_count + SEARCH_BUCKETS + 1) * sizeof(uint64_t);
+        size = postings_offset + starts[SEARCH_BUCKETS];
+        fd = create_temp_file(JOURNAL_SEARCH_FILE, temp_path, sizeof(temp_path));
+        ok = fd >= 0 && ftruncate(fd, (off_t) size) == 0 &&
+             (mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) != MAP_FAILED;
+        if (!ok) break;
+        memset(&header, 0, sizeof(SearchIndexHeader));
+        header.magic = JOURNAL_SEARCH_MAGIC;
+        header.version = JOURNAL_SEARCH_VERSION;
+        header.journal_inode = journal->file_stat.st_ino;
+        header.journal_size = journal->size;
+        header.journal_mtime_sec = journal->file_stat.st_mtim.tv_sec;
+        header.journal_mtime_nsec = journal->file_stat.st_mtim.tv_nsec;
+        header.line_count = line_count;
+        header.postings_size = starts[SEARCH_BUCKETS];
+        memcpy(mapping, &header, sizeof(SearchIndexHeader));
+        memcpy(mapping + sizeof(SearchIndexHeader), lines, line_count * sizeof(uint64_t));
+        memcpy(mapping + sizeof(SearchIndexHeader) + line_count * sizeof(uint64_t), starts,
+               (SEARCH_BUCKETS + 1) * sizeof(uint64_t));
+        for (size_t bucket = 0; bucket < SEARCH_BUCKETS; bucket++) positions[bucket] = postings_offset + starts[bucket];
+    }
+    if (mapping != MAP_FAILED) munmap(mapping, size);
+    if (fd >= 0) ok = close(fd) == 0 && ok;
+    free(last);
+    free(starts);
+    free(positions);
+    free(tokenizer);
+    free(lines);
+    free(buckets);
+    if (ok) ok = rename(temp_path, JOURNAL_SEARCH_FILE) == 0;
+    else if (fd >= 0) unlink(temp_path);
+
+    // The delta starts empty and identifies the index it belongs to
+    fd = ok ? create_temp_file(JOURNAL_SEARCH_DELTA_FILE, temp_path, sizeof(temp_path)) : -1;
+    if (fd >= 0) {
+        SearchDeltaHeader delta_header = {JOURNAL_SEARCH_DELTA_MAGIC, JOURNAL_SEARCH_VERSION, header.journal_size,
+                                          header.journal_mtime_sec, header.journal_mtime_nsec};
+        ok = write(fd, &delta_header, sizeof(delta_header)) == sizeof(delta_header);
+        ok = close(fd) == 0 && ok && rename(temp_path, JOURNAL_SEARCH_DELTA_FILE) == 0;
+        if (!ok) unlink(temp_path);
+    } else {
+        ok = false;
+    }
+    if (!ok) perror("Failed to write search index");
+    return ok;
+}
+
+/**
+ * @brief Releases a search index opened by `open_search_index`.
+ */
+void close_search_index(SearchIndex *index) {
+    if (index->mapping != NULL) munmap(index->mapping, index->size);
+    free(index->delta);
+    free(index->delta_records);
+    memset(index, 0, sizeof(SearchIndex));
+}
+
+/**
+ * @brief Reads the delta of a mapped search index and checks that together they cover the journal.
+ *
+ * The records are found from the end of the file by their trailers. They must follow the lines of the
+ * index in journal order, and the last one must end where the journal ends and carry its modification time.
+ *
+ * @return True if the index and its delta describe the journal as it is now.
+ */
+bool load_search_delta(SearchIndex *index, const MappedJournal *journal) {
+    int fd = open(JOURNAL_SEARCH_DELTA_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(SearchDeltaHeader) &&
+              (index->delta = malloc(st.st_size)) != NULL && read(fd, index->delta, st.st_size) == st.st_size;
+    close(fd);
+    if (!ok) return false;
+    SearchDeltaHeader header;
+    memcpy(&header, index->delta, sizeof(SearchDeltaHeader));
+    if (header.magic != JOURNAL_SEARCH_DELTA_MAGIC || header.version != JOURNAL_SEARCH_VERSION ||
+        header.journal_size != index->header->journal_size ||
+        header.journal_mtime_sec != index->header->journal_mtime_sec ||
+        header.journal_mtime_nsec != index->header->journal_mtime_nsec) {
+        return false;
+    }
+    size_t capacity = 0;
+    size_t position = st.st_size;
+    while (position > sizeof(SearchDeltaHeader)) {
+        SearchDeltaTrailer trailer;
+        if (position - sizeof(SearchDeltaHeader) < sizeof(SearchDeltaTrailer)) return false;
+        position -= sizeof(SearchDeltaTrailer);
+        memcpy(&trailer, index->delta + position, sizeof(SearchDeltaTrailer));
+        if ((position - sizeof(SearchDeltaHeader)) / sizeof(uint32_t) < trailer.bucket_count) return false;
+        if (index->delta_count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            size_t *resized = realloc(index->delta_records, capacity * sizeof(size_t));
+            if (resized == NULL) return false;
+            index->delta_records = resized;
+        }
+        index->delta_records[index->delta_count++] = position;
+        position -= trailer.bucket_count * sizeof(uint32_t);
+    }
+    uint64_t end = header.journal_size;
+    SearchDeltaTrailer last = {0, 0, 0, header.journal_mtime_sec, header.journal_mtime_nsec};
+    for (size_t i = 0; i < index->delta_count / 2; i++) {
+        size_t swap = index->delta_records[i];
+        index->delta_records[i] = index->delta_records[index->delta_count - 1 - i];
+        index->delta_records[index->delta_count - 1 - i] = swap;
+    }
+    for (size_t i = 0; i < index->delta_count; i++) {
+        memcpy(&last, index->delta + index->delta_records[i], sizeof(SearchDeltaTrailer));
+        if (last.line_offset < end) return false;
+        end = last.line_offset + last.line_length + 1;
+    }
+    return end == journal->size && last.journal_mtime_sec == journal->file_stat.st_mtim.tv_sec &&
+           last.journal_mtime_nsec == journal->file_stat.st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Maps the search index and reads its delta.
+ *
+ * @return True if the index and its delta describe the journal as it is now, otherwise false.
+ */
+bool open_search_index(const MappedJournal *journal, SearchIndex *index) {
+    memset(index, 0, sizeof(SearchIndex));
+    int fd = open(JOURNAL_SEARCH_FILE, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SearchIndexHeader)) {
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    index->mapping = mapping;
+    index->size = st.st_size;
+    index->header = mapping;
+    const SearchIndexHeader *header = index->header;
+    size_t fixed = sizeof(SearchIndexHeader) + (SEARCH_BUCKETS + 1) * sizeof(uint64_t);
+    bool valid = header->magic == JOURNAL_SEARCH_MAGIC && header->version == JOURNAL_SEARCH_VERSION &&
+                 header->journal_inode == (uint64_t) journal->file_stat.st_ino &&
+                 header->journal_size <= journal->size && index->size >= fixed &&
+                 header->line_count <= (index->size - fixed) / sizeof(uint64_t) &&
+                 header->postings_size == index->size - fixed - header->line_count * sizeof(uint64_t);
+    if (valid) {
+        index->lines = (const uint64_t *) ((const char *) mapping + sizeof(SearchIndexHeader));
+        index->bucket_starts = index->lines + header->line_count;
+        index->postings = (const uint8_t *) (index->bucket_starts + SEARCH_BUCKETS + 1);
+        valid = index->bucket_starts[0] == 0 && index->bucket_starts[SEARCH_BUCKETS] == header->postings_size;
+        for (size_t bucket = 0; valid && bucket < SEARCH_BUCKETS; bucket++) {
+            valid = index->bucket_starts[bucket] <= index->bucket_starts[bucket + 1];
+        }
+        valid = valid && load_search_delta(index, journal);
+    }
+    if (!valid) {
+        close_search_index(index);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Keeps only the candidate lines which are in the posting list of a bucket.
+ *
+ * @param candidates Ascending line numbers. When `all` is set, the array is filled with the whole posting
+ *                   list instead and must have room for it (one line per byte of the list is enough).
+ * @param count Number of candidates.
+ *
+ * @return The number of candidates left.
+ */
+size_t intersect_postings(const SearchIndex *index, uint32_t bucket, uint32_t *candidates, size_t count,
+                          bool all) {
+    const uint8_t *cursor = index->postings + index->bucket_starts[bucket];
+    const uint8_t *end = index->postings + index->bucket_starts[bucket + 1];
+    size_t kept = 0;
+    size_t next = 0;
+    uint32_t line = 0;
+    uint32_t gap;
+    for (bool first = true; cursor < end && (all || next < count); first = false) {
+        cursor = read_varint(cursor, end, &gap);
+        if (cursor == NULL) break;
+        line = first ? gap : line + gap;
+        if (all) {
+            candidates[kept++] = line;
+            continue;
+        }
+        while (next < count && candidates[next] < line) next++;
+        if (next < count && candidates[next] == line) candidates[kept++] = candidates[next++];
+    }
+    return kept;
+}
+
+/**
+ * @brief Checks whether a text contains a needle, ignoring the case of ASCII letters.
+ *
+ * @param needle The searched text, already folded by `fold_ascii`.
+ */
+bool slice_contains_folded(TextSlice text, const char *needle, size_t length) {
+    if (!slice_is_present(text) || text.length < length) return false;
+    for (size_t i = 0; i + length <= text.length; i++) {
+        size_t matched = 0;
+        while (matched < length && fold_ascii((unsigned char) text.data[i + matched]) == (unsigned char) needle[matched]) {
+            matched++;
+        }
+        if (matched == length) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether the book name, author or note of an entry contains the folded needle.
+ */
+bool entry_contains_text(const JournalEntry *entry, const char *needle, size_t length) {
+    return slice_contains_folded(entry->book_name, needle, length) ||
+           slice_contains_folded(entry->author, needle, length) ||
+           slice_contains_folded(entry->note, needle, length);
+}
+
+/**
+ * @brief Verifies one candidate line against the needle and prints it if it matches.
+ *
+ * @return True if the line matched.
+ */
+bool search_line(const MappedJournal *journal, uint64_t offset, const char *needle, size_t length,
+                 OutputBuffer *out) {
+    if (offset >= journal->size) return false;
+    const char *line = journal->data + offset;
+    const char *newline = memchr(line, '\n', journal->size - offset);
+    size_t line_length = newline != NULL ? (size_t) (newline - line) : journal->size - offset;
+    JournalEntry entry;
+    if (!parse_entry(line, line_length, &entry) || !entry_contains_text(&entry, needle, length)) return false;
+    print_entry(out, &entry);
+    return true;
+}
+
+/**
+ * @brief Searches the journal with the trigram index.
+ *
+ * Lines of the index come from intersecting the posting lists of the buckets of the needle, starting with
+ * the shortest list. Lines of the delta must have all the buckets of the needle. Every candidate is then
+ * verified against the text of the line.
+ *
+ * @param buckets The sorted, distinct buckets of the needle, at least one.
+ *
+ * @return The number of matching entries.
+ */
+size_t search_indexed(const MappedJournal *journal, const SearchIndex *index, uint32_t *buckets, size_t count,
+                      const char *needle, size_t length, OutputBuffer *out) {
+    size_t found = 0;
+    uint32_t *by_size = malloc(count * sizeof(uint32_t));
+    if (by_size == NULL) {
+        out->failed = true;
+        return 0;
+    }
+    memcpy(by_size, buckets, count * sizeof(uint32_t));
+    // Insertion sort by list size, a needle has only a few buckets
+    for (size_t i = 1; i < count; i++) {
+        uint32_t current = by_size[i];
+        uint64_t size = index->bucket_starts[current + 1] - index->bucket_starts[current];
+        size_t j = i;
+        for (; j > 0 && index->bucket_starts[by_size[j - 1] + 1] - index->bucket_starts[by_size[j - 1]] > size; j--) {
+            by_size[j] = by_size[j - 1];
+        }
+        by_size[j] = current;
+    }
+    uint64_t shortest = index->bucket_starts[by_size[0] + 1] - index->bucket_starts[by_size[0]];
+    uint32_t *candidates = malloc((shortest + 1) * sizeof(uint32_t));
+    if (candidates == NULL) {
+        free(by_size);
+        out->failed = true;
+        return 0;
+    }
+    size_t candidate_count = intersect_postings(index, by_size[0], candidates, 0, true);
+    for (size_t i = 1; i < count && candidate_count > 0; i++) {
+        candidate_count = intersect_postings(index, by_size[i], candidates, candidate_count, false);
+    }
+    for (size_t i = 0; i < candidate_count; i++) {
+        if (candidates[i] < index->header->line_count &&
+            search_line(journal, index->lines[candidates[i]], needle, length, out)) {
+            found++;
+        }
+    }
+    free(candidates);
+    free(by_size);
+
+    for (size_t i = 0; i < index->delta_count; i++) {
+        SearchDeltaTrailer trailer;
+        memcpy(&trailer, index->delta + index->delta_records[i], sizeof(SearchDeltaTrailer));
+        const uint32_t *record = (const uint32_t *) (index->delta + index->delta_records[i]) - trailer.bucket_count;
+        bool candidate = true;
+        for (size_t j = 0; j < count && candidate; j++) {
+            candidate = bsearch(&buckets[j], record, trailer.bucket_count, sizeof(uint32_t), compare_buckets) != NULL;
+        }
+        if (candidate && search_line(journal, trailer.line_offset, needle, length, out)) found++;
+    }
+    return found;
+}
+
+/**
+ * @brief Searches the journal by verifying every line, used without the index, for needles shorter than a
+ *        trigram and while the change log holds changes, which are applied from `journal_overlay`.
+ *
+ * @return The number of matching entries.
+ */
+size_t search_mapped_journal(const MappedJournal *journal, const char *needle, size_t length, OutputBuffer *out) {
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    if (tokenizer == NULL) {
+        out->failed = true;
+        return 0;
+    }
+    size_t found = 0;
+    init_line_tokenizer(tokenizer, journal->data, journal->data + journal->size, select_delimiter_scanner());
+    const OverlayChange *change = journal_overlay.changes;
+    TokenizedLine line;
+    JournalEntry entry;
+    while (next_tokenized_line(tokenizer, &line)) {
+        if (!apply_overlay_change(&line, (uint64_t) (line.data - journal->data), &change)) continue;
+        if (entry_from_fields(&entry, line.fields, line.field_count) && entry_contains_text(&entry, needle, length)) {
+            print_entry(out, &entry);
+            found++;
+        }
+    }
+    free(tokenizer);
+    return found;
+}
+
+/**
+ * @brief Handles the "search" command, which prints the entries whose book name, author or note contain a
+ *        text, ignoring the case of ASCII letters.
+ *
+ * The search uses the trigram index `JOURNAL_SEARCH_FILE`, which is built on the first search and rebuilt
+ * when the journal changed other than by `new` and `import` (those extend its delta), or when the delta
+ * grew past `SEARCH_DELTA_MERGE_LINES` lines and an eighth of the index. Texts shorter than three bytes
+ * have no trigram and are searched by scanning the journal. The index covers the journal text only, so
+ * while the change log holds changes of `update` and `delete`, the journal is scanned with them applied.
+ *
+ * Options:
+ * - `--no-index`: scan the journal even if the text could use the index.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
+ */
+void search_cmd(int argc, char *argv[]) {
+    const char *text = NULL;
+    bool use_index = true;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--no-index") == 0) {
+            use_index = false;
+        } else if (text == NULL) {
+            text = argv[i];
         } else {
-            if (!isdigit(date[i])) return false;
+            printf("Unknown option for search command: %s\n", argv[i]);
+            return;
+        }
+    }
+    if (text == NULL || text[0] == '\0') {
+        printf("Search needs a text, e.g. search \"hobbit\"\n");
+        return;
+    }
+    size_t length = strlen(text);
+    char *needle = malloc(length + 1);
+    uint32_t *buckets = malloc((length + 1) * sizeof(uint32_t));
+    if (needle == NULL || buckets == NULL) {
+        perror("Failed to allocate memory for search");
+        free(needle);
+        free(buckets);
+        return;
+    }
+    for (size_t i = 0; i <= length; i++) needle[i] = (char) fold_ascii((unsigned char) text[i]);
+    size_t bucket_count = sort_unique_buckets(buckets, collect_trigram_buckets((TextSlice) {needle, length},
+                                                                               buckets, 0));
+    int fd = open(JOURNAL_FILE, O_RDONLY);
+    MappedJournal journal;
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+    } else if (!map_journal(fd, &journal)) {
+        printf("Journal file cannot be searched, it is not a regular file\n");
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0 && !load_journal_overlay(journal.data, journal.size, &journal.file_stat, &journal_overlay)) {
+        unmap_journal(&journal);
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0) {
+        OutputBuffer out;
+        output_init(&out, STDOUT_FILENO);
+        size_t found = 0;
+        bool indexed = false;
+        if (use_index && bucket_count > 0 && journal.size > 0 && journal_overlay.count == 0) {
+            SearchIndex index;
+            bool loaded = open_search_index(&journal, &index);
+            if (loaded && index.delta_count > SEARCH_DELTA_MERGE_LINES &&
+                index.delta_count > index.header->line_count / 8) {
+                close_search_index(&index);
+                loaded = false;
+            }
+            if (!loaded) loaded = build_search_index(&journal) && open_search_index(&journal, &index);
+            if (loaded) {
+                found = search_indexed(&journal, &index, buckets, bucket_count, needle, length, &out);
+                close_search_index(&index);
+                indexed = true;
+            }
         }
+        if (!indexed && journal.size > 0) found = search_mapped_journal(&journal, needle, length, &out);
+        output_free(&out);
+        printf("Found %zu entries\n", found);
+        free_journal_overlay(&journal_overlay);
+        unmap_journal(&journal);
+        close(fd);
+    }
+    free(needle);
+    free(buckets);
+}
+
+/**
+ * @brief Fills the address of the socket the daemon listens on, next to the journal.
+ */
+void journal_socket_address(struct sockaddr_un *address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, JOURNAL_SOCKET_FILE, sizeof(address->sun_path) - 1);
+}
+
+/**
+ * @brief Reads exactly `length` bytes from a socket.
+ */
+bool read_fully(int fd, void *data, size_t length) {
+    char *cursor = data;
+    while (length > 0) {
+        ssize_t read_length = read(fd, cursor, length);
+        if (read_length < 0 && errno == EINTR) continue;
+        if (read_length <= 0) return false;
+        cursor += read_length;
+        length -= (size_t) read_length;
     }
+    return true;
+}
 
-    int year = (int) strtol(date, NULL, 10);
-    int month = (int) strtol(date + 5, NULL, 10);
-    int day = (int) strtol(date + 8, NULL, 10);
+/**
+ * @brief Runs a command of the normal CLI through a running daemon.
+ *
+ * The request is the number of arguments followed by each argument, as a `uint32_t` length and its bytes.
+ * Standard output and error of this process go along with it (`SCM_RIGHTS`), so the daemon prints the
+ * answer and its error messages straight to them. After the request is sent, the write side of the socket
+ * is shut down, which marks its end, and the daemon answers with the exit status of the command.
+ *
+ * @param status Receives the exit status of the command run by the daemon.
+ *
+ * @return True if a daemon took the command, false if none is running and the command must run locally.
+ */
+bool forward_to_daemon(int argc, char *argv[], int *status) {
+    OutputBuffer request;
+    output_init(&request, -1);
+    uint32_t count = (uint32_t) argc;
+    output_bytes(&request, (const char *) &count, sizeof(uint32_t));
+    for (int i = 0; i < argc; i++) {
+        uint32_t length = (uint32_t) strlen(argv[i]);
+        output_bytes(&request, (const char *) &length, sizeof(uint32_t));
+        output_bytes(&request, argv[i], length);
+    }
+    int fd = request.failed || request.used >= SERVE_MAX_REQUEST ? -1 : socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    journal_socket_address(&address);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        if (fd >= 0) close(fd);
+        output_free(&request);
+        return false;
+    }
+    // The daemon writes to the same output, what is buffered here must come first
+    fflush(stdout);
+    fflush(stderr);
+    int output_fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(output_fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec part = {request.data, request.used};
+    struct msghdr message = {NULL, 0, &part, 1, control, sizeof(control), 0};
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(output_fds));
+    memcpy(CMSG_DATA(header), output_fds, sizeof(output_fds));
+    ssize_t sent;
+    while ((sent = sendmsg(fd, &message, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    bool ok = sent > 0;
+    OutputBuffer rest = {fd, NULL, 0, 0, false};
+    struct iovec tail = {request.data + (ok ? sent : 0), request.used - (ok ? (size_t) sent : 0)};
+    ok = ok && output_writev(&rest, &tail, 1);
+    output_free(&request);
+    if (!ok) {
+        // Nothing was run, the command runs locally
+        close(fd);
+        return false;
+    }
+    shutdown(fd, SHUT_WR);
+    int32_t answer;
+    if (!read_fully(fd, &answer, sizeof(answer))) {
+        fprintf(stderr, "The daemon stopped before it answered the request\n");
+        answer = 1;
+    }
+    close(fd);
+    *status = answer;
+    return true;
+}
 
-    if (month < 1 || month > 12) return false;
-    if (day < 1) return false;
+/**
+ * @brief Reads what a client sent since the last call, with its standard output and error if they arrive.
+ *
+ * The connection is not blocking, so a client which sends nothing stalls no one.
+ *
+ * @return 1 if the whole request was read (the client shut its side down), 0 if more is to come, -1 if the
+ *         connection failed or the request is too large.
+ */
+int read_pending_request(PendingRequest *pending) {
+    for (;;) {
+        char control[CMSG_SPACE(2 * sizeof(int))];
+        struct iovec part = {pending->data + pending->used, SERVE_MAX_REQUEST - pending->used};
+        struct msghdr message = {NULL, 0, &part, 1, control, sizeof(control), 0};
+        ssize_t length = recvmsg(pending->fd, &message, MSG_CMSG_CLOEXEC);
+        if (length < 0 && errno == EINTR) continue;
+        if (length < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL;
+             header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int fds[2];
+            for (size_t i = 0; i < count; i++) {
+                memcpy(&fds[i < 2 ? i : 1], CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                if (i >= 2 || pending->output_fds[i] >= 0) {
+                    close(fds[i < 2 ? i : 1]);
+                } else {
+                    pending->output_fds[i] = fds[i];
+                }
+            }
+        }
+        if (length == 0) return 1;
+        pending->used += (size_t) length;
+        if (pending->used == SERVE_MAX_REQUEST) return -1;
+    }
+}
 
-    // Check for leap year
-    if ((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)) {
-        days_in_month[1] = 29;
+/**
+ * @brief Closes a connection of the daemon with the descriptors the client passed.
+ */
+void close_pending_request(PendingRequest *pending) {
+    close(pending->fd);
+    for (int i = 0; i < 2; i++) {
+        if (pending->output_fds[i] >= 0) close(pending->output_fds[i]);
     }
+    free(pending->data);
+}
 
-    if (day > days_in_month[month - 1]) return false;
+/**
+ * @brief Runs a request read by `read_pending_request` with standard output and error of the client.
+ *
+ * Only `list` and `new` are served. The journal in memory is refreshed first, and when the journal file
+ * cannot be read the command runs as in the CLI, which reports the error. The exit status of the command is
+ * sent back to the client.
+ */
+void serve_request(PendingRequest *pending, ServedJournal *served) {
+    char *strings = malloc(pending->used + 1);
+    char *argv[SERVE_MAX_ARGUMENTS + 1];
+    uint32_t argc = 0;
+    size_t position = sizeof(uint32_t);
+    size_t used = 0;
+    bool ok = strings != NULL && pending->used >= sizeof(uint32_t) && pending->output_fds[0] >= 0 &&
+              pending->output_fds[1] >= 0;
+    if (ok) memcpy(&argc, pending->data, sizeof(uint32_t));
+    ok = ok && argc >= 2 && argc <= SERVE_MAX_ARGUMENTS;
+    for (uint32_t i = 0; ok && i < argc; i++) {
+        uint32_t length;
+        ok = pending->used - position >= sizeof(uint32_t);
+        if (!ok) break;
+        memcpy(&length, pending->data + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+        ok = length <= pending->used - position;
+        if (!ok) break;
+        argv[i] = strings + used;
+        memcpy(argv[i], pending->data + position, length);
+        argv[i][length] = '\0';
+        position += length;
+        used += length + 1;
+    }
+    int32_t status = 1;
+    if (ok) {
+        argv[argc] = NULL;
+        fflush(stdout);
+        fflush(stderr);
+        int saved_fds[2] = {dup(STDOUT_FILENO), dup(STDERR_FILENO)};
+        dup2(pending->output_fds[0], STDOUT_FILENO);
+        dup2(pending->output_fds[1], STDERR_FILENO);
+        if (strcmp(argv[1], "list") == 0 || strcmp(argv[1], "new") == 0) {
+            served_journal = refresh_served_journal(served) ? served : NULL;
+            if (strcmp(argv[1], "list") == 0) {
+                list_cmd((int) argc, argv);
+            } else {
+                new_cmd((int) argc, argv);
+            }
+            served_journal = NULL;
+            status = 0;
+        } else {
+            fprintf(stderr, "Command %s is not served by the daemon\n", argv[1]);
+        }
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_fds[0], STDOUT_FILENO);
+        dup2(saved_fds[1], STDERR_FILENO);
+        close(saved_fds[0]);
+        close(saved_fds[1]);
+    }
+    if (send(pending->fd, &status, sizeof(status), MSG_NOSIGNAL) != sizeof(status)) {
+        perror("Failed to answer a request");
+    }
+    free(strings);
+}
 
+/**
+ * @brief Accepts a connection of the daemon if it comes from the user the daemon runs as (`SO_PEERCRED`).
+ *
+ * @return True if the connection was added to `pending`, otherwise it is closed.
+ */
+bool accept_pending_request(int listener, PendingRequest *pending) {
+    int client = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (client < 0) {
+        if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) perror("Failed to accept a request");
+        return false;
+    }
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || peer.uid != geteuid()) {
+        fprintf(stderr, "Refused a request of another user\n");
+        close(client);
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    PendingRequest accepted = {client, {-1, -1}, malloc(SERVE_MAX_REQUEST), 0, now.tv_sec};
+    if (accepted.data == NULL) {
+        close(client);
+        return false;
+    }
+    *pending = accepted;
     return true;
 }
 
 /**
- * @brief Retrieves a valid date string in the format YYYY-MM-DD.
- *
- * This function performs validation on the provided date string to ensure
- * that it adheres to the ISO 8601 date format (YYYY-MM-DD). If the format
- * or content of the date is invalid, an error message is displayed, and
- * the function returns a null pointer. Otherwise, the original input date
- * string is returned.
+ * @brief Handles the "serve" command, which keeps the journal in memory and answers `list` and `new` over
+ *        the Unix socket `JOURNAL_SOCKET_FILE`.
+ *
+ * The journal is loaded once into a `ServedJournal`. Before every request the daemon checks the journal
+ * file and parses only the lines appended since, by `new` or by anyone else. `list` and `new` of the CLI
+ * started in the same directory use the daemon whenever it runs (`forward_to_daemon`). The daemon runs
+ * until it gets SIGINT or SIGTERM and removes the socket.
+ *
+ * The socket is created with mode 0600 and only requests of the user the daemon runs as are accepted.
+ * Requests of up to `SERVE_MAX_PENDING` connections are read at once with `poll`, so a client which is slow
+ * to send its request does not hold up the others, and one which takes more than `SERVE_REQUEST_TIMEOUT`
+ * seconds is dropped. Complete requests run one after another.
+ *
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program. The command has no options.
+ *
+ * @return The exit status of the program.
+ */
+int serve_cmd(int argc, char *argv[]) {
+    if (argc > 2) {
+        printf("Unknown option for serve command: %s\n", argv[2]);
+        return 1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un address;
+    journal_socket_address(&address);
+    // Only the owner may connect, the daemon writes the journal on behalf of its clients
+    mode_t previous_umask = umask(0177);
+    if (listener >= 0 && bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0 &&
+        errno == EADDRINUSE) {
+        // A socket left behind by a daemon which did not stop cleanly refuses connections
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool running = probe >= 0 && connect(probe, (struct sockaddr *) &address, sizeof(address)) == 0;
+        if (probe >= 0) close(probe);
+        if (running) {
+            printf("A daemon is already serving this journal (%s)\n", JOURNAL_SOCKET_FILE);
+            umask(previous_umask);
+            close(listener);
+            return 1;
+        }
+        unlink(JOURNAL_SOCKET_FILE);
+        if (bind(listener, (struct sockaddr *) &address, sizeof(address)) != 0) {
+            close(listener);
+            listener = -1;
+        }
+    }
+    umask(previous_umask);
+    if (listener < 0 || chmod(JOURNAL_SOCKET_FILE, 0600) != 0 || listen(listener, 64) != 0) {
+        perror("Failed to open the daemon socket");
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+    handle_stop_signals();
+    signal(SIGPIPE, SIG_IGN);
+
+    ServedJournal served;
+    memset(&served, 0, sizeof(ServedJournal));
+    refresh_served_journal(&served);
+    printf("Serving %s on %s, %zu lines loaded\n", JOURNAL_FILE, JOURNAL_SOCKET_FILE, served.record_count);
+    fflush(stdout);
+    PendingRequest pending[SERVE_MAX_PENDING];
+    size_t pending_count = 0;
+    struct pollfd fds[SERVE_MAX_PENDING + 1];
+    while (!stop_requested) {
+        fds[0] = (struct pollfd) {pending_count < SERVE_MAX_PENDING ? listener : -1, POLLIN, 0};
+        for (size_t i = 0; i < pending_count; i++) fds[i + 1] = (struct pollfd) {pending[i].fd, POLLIN, 0};
+        if (poll(fds, pending_count + 1, 1000) < 0 && errno != EINTR) {
+            perror("Failed to wait for requests");
+            break;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        // Backwards, so a removed connection is replaced by one already handled
+        for (size_t i = pending_count; i-- > 0;) {
+            int state = fds[i + 1].revents != 0 ? read_pending_request(&pending[i]) : 0;
+            if (state == 0 && now.tv_sec - pending[i].started < SERVE_REQUEST_TIMEOUT) continue;
+            if (state == 1) serve_request(&pending[i], &served);
+            close_pending_request(&pending[i]);
+            pending[i] = pending[--pending_count];
+        }
+        if ((fds[0].revents & POLLIN) && accept_pending_request(listener, &pending[pending_count])) {
+            pending_count++;
+        }
+    }
+    for (size_t i = 0; i < pending_count; i++) close_pending_request(&pending[i]);
+    close(listener);
+    unlink(JOURNAL_SOCKET_FILE);
+    free_served_journal(&served);
+    printf("Daemon stopped\n");
+    return 0;
+}
+
+/**
+ * @brief Sums the field lengths and the score of an entry, so benchmarked parsers can be compared.
+ */
+unsigned long long entry_checksum(const JournalEntry *entry) {
+    return entry->book_name.length + entry->author.length + entry->genre.length + entry->start_date.length +
+           entry->end_date.length + entry->note.length + entry->score;
+}
+
+/**
+ * @brief Tokenizes a benchmark journal the old way: each line is copied into a line buffer as `getline`
+ *        does, cut at the newline with `strcspn` and split in place with `strsep`.
+ */
+unsigned long long bench_strsep(const char *data, size_t size) {
+    unsigned long long checksum = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    const char *cursor = data;
+    const char *end = data + size;
+    while (cursor < end) {
+        const char *newline = memchr(cursor, '\n', end - cursor);
+        size_t length = (newline != NULL ? newline + 1 : end) - cursor;
+        if (length + 1 > capacity) {
+            capacity = (length + 1) * 2;
+            char *grown = realloc(line, capacity);
+            if (grown == NULL) break;
+            line = grown;
+        }
+        memcpy(line, cursor, length);
+        line[length] = '\0';
+        cursor += length;
+
+        line[strcspn(line, "\n")] = '\0';
+        JournalEntry entry;
+        reset_entry(&entry);
+        int field = 0;
+        char *current_line = line;
+        char *token;
+        while ((token = strsep(&current_line, "|")) != NULL) {
+            set_entry_field(&entry, field, slice_from_string(token));
+            field++;
+        }
+        if (has_required_fields(&entry)) checksum += entry_checksum(&entry);
+    }
+    free(line);
+    return checksum;
+}
+
+/**
+ * @brief Tokenizes a benchmark journal line by line with `memchr` (`parse_entry`).
+ */
+unsigned long long bench_memchr(const char *data, size_t size) {
+    unsigned long long checksum = 0;
+    const char *cursor = data;
+    const char *end = data + size;
+    while (cursor < end) {
+        const char *newline = memchr(cursor, '\n', end - cursor);
+        const char *line_end = newline != NULL ? newline : end;
+        JournalEntry entry;
+        if (parse_entry(cursor, line_end - cursor, &entry)) checksum += entry_checksum(&entry);
+        cursor = line_end + 1;
+    }
+    return checksum;
+}
+
+/**
+ * @brief Tokenizes a benchmark journal with a `LineTokenizer` using the given scanner.
+ */
+unsigned long long bench_scanner(const char *data, size_t size, DelimiterScanner scan) {
+    unsigned long long checksum = 0;
+    LineTokenizer *tokenizer = malloc(sizeof(LineTokenizer));
+    if (tokenizer == NULL) return 0;
+    init_line_tokenizer(tokenizer, data, data + size, scan);
+    TokenizedLine line;
+    while (next_tokenized_line(tokenizer, &line)) {
+        JournalEntry entry;
+        if (entry_from_fields(&entry, line.fields, line.field_count)) checksum += entry_checksum(&entry);
+    }
+    free(tokenizer);
+    return checksum;
+}
+
+/**
+ * @brief Builds an in-memory journal for the tokenizer benchmark.
+ *
+ * Lines look like real entries with a long note, which is where the tokenizers differ the most.
+ *
+ * @return The journal text, to be freed by the caller, or NULL if it cannot be allocated.
+ */
+char *build_bench_journal(size_t lines, size_t note_length, size_t *size) {
+    size_t capacity = lines * (note_length + 128);
+    char *data = malloc(capacity);
+    if (data == NULL) return NULL;
+    size_t used = 0;
+    for (size_t i = 0; i < lines; i++) {
+        used += snprintf(data + used, capacity - used, "Book number %zu|Author %zu|genre %zu|2023-%02zu-%02zu|%s|%zu|",
+                         i, i % 1000, i % 12, i % 12 + 1, i % 28 + 1, i % 3 == 0 ? "" : "2024-01-15", i % 6);
+        for (size_t j = 0; j < note_length; j++) {
+            data[used++] = j % 9 == 8 ? ' ' : (char) ('a' + (i + j) % 26);
+        }
+        data[used++] = '\n';
+    }
+    *size = used;
+    return data;
+}
+
+/**
+ * @brief Runs one tokenizer of the benchmark several times and prints its best throughput.
  *
- * @param date A null-terminated C-string representing the date. The string
- *             must not be null and should follow the format YYYY-MM-DD.
- *
- * @return A pointer to the original date string if it is valid, otherwise
- *         NULL.
- *
- * - If the input date is null, the function returns NULL without attempting validation.
- * - The function relies on `is_valid_date` to verify the date's format and
- *   validity. If the date is invalid, an error message is printed, and
- *   the function returns NULL.
- * - If the date is valid, the input pointer is returned unchanged.
+ * @param scan The scanner for a `LineTokenizer`, or NULL to run `tokenize` instead.
  */
-char *get_date(char *date) {
-    if (date == NULL) return NULL;
-    if (!is_valid_date(date)) {
-        printf("Invalid date format. Correct format is YYYY-MM-DD (ISO 8601)\n");
-        return NULL;
+void report_bench_tokenizer(const char *name, const char *data, size_t size, size_t lines,
+                            DelimiterScanner scan, unsigned long long (*tokenize)(const char *, size_t)) {
+    double best = 0;
+    unsigned long long checksum = 0;
+    for (int run = 0; run < 5; run++) {
+        double start = monotonic_seconds();
+        checksum = scan != NULL ? bench_scanner(data, size, scan) : tokenize(data, size);
+        double elapsed = monotonic_seconds() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
     }
-    return date;
+    printf("  %-8s %9.1f MB/s %9.1f ns/line   checksum %llu\n", name, (double) size / best / 1e6,
+           best * 1e9 / (double) lines, checksum);
 }
 
 /**
- * @brief Extracts the value associated with a specified command-line option.
- *
- * This function retrieves the argument string that follows a particular option index
- * in the command-line arguments. If the option does not have a corresponding value,
- * or if the value is misinterpreted as another option (prefixed with "--"), the function
- * returns a null pointer. The returned value is dynamically allocated and should be
- * freed by the caller.
- *
- * @param argc The total number of arguments passed to the program, including the program name.
- * @param argv An array of null-terminated strings containing the command-line arguments.
- * @param option_index The index within `argv` of the target option whose value is to be extracted.
- *
- * @return A pointer to a dynamically allocated string containing the value of the specified option
- * if the value exists and is valid. Returns NULL if:
- * - The index `option_index + 1` is out of bounds.
- * - The argument at `option_index + 1` appears to be an option (starts with "--").
+ * @brief Returns the next number of a splitmix64 sequence, the random source of `bench generate`.
  *
- * The caller is responsible for freeing the allocated string when no longer needed.
+ * The sequence depends only on the seed, so a generated journal can be reproduced byte for byte.
  */
-char *get_option_value(int argc, char *argv[], int option_index) {
-    if (argc <= option_index + 1) return NULL;
-    if (argv[option_index + 1][0] == '-' && argv[option_index + 1][1] == '-') return NULL;
-    char *value = malloc(sizeof(char) * strlen(argv[option_index + 1]));
-    strcpy(value, argv[option_index + 1]);
-    return value;
+uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
 }
 
-void print_entry(JournalEntry *entry) {
-    if (entry == NULL) return;
-    printf("-- %s --\n", entry->book_name);
-    printf("author:           %s\n", entry->author);
-    printf("genre:            %s\n", entry->genre);
-    printf("started reading:  %s\n", entry->start_date);
-    if (entry->end_date) printf("finished reading: %s\n", entry->end_date);
-    if (entry->score != 0) printf("personal score:   %d\n", entry->score);
-    if (entry->note) printf("note:             %s\n", entry->note);
-    printf("-------\n");
+/**
+ * @brief Picks a number below `count`, smaller numbers more often, so a few genres and authors are common
+ *        and most are rare, as in a real journal.
+ */
+size_t random_skewed(uint64_t *state, size_t count) {
+    size_t a = next_random(state) % count;
+    size_t b = next_random(state) % count;
+    return a < b ? a : b;
 }
 
 /**
- * @brief Frees the memory allocated for a JournalEntry structure and its member fields.
+ * @brief Appends a day number as an ISO 8601 date (YYYY-MM-DD), the inverse of `days_from_civil`.
  *
- * This function releases all dynamically allocated resources associated with a JournalEntry,
- * including its string fields (e.g., book name, author, genre, etc.) and the structure itself.
- * It should be called to avoid memory leaks after the JournalEntry is no longer needed.
- *
- * @param entry A pointer to the JournalEntry structure that is to be freed. The pointer must not
- *              be NULL and the memory for all dynamically allocated fields inside the structure
- *              should have been properly assigned before calling this function.
+ * The year must have four digits.
  */
-void free_entry(JournalEntry *entry) {
-    if (entry == NULL) return;
-    free(entry->book_name);
-    free(entry->author);
-    free(entry->genre);
-    free(entry->start_date);
-    free(entry->end_date);
-    free(entry->note);
-    free(entry);
+void output_day(OutputBuffer *out, int32_t day_number) {
+    int32_t shifted = day_number + 719468;
+    int32_t era = (shifted >= 0 ? shifted : shifted - 146096) / 146097;
+    int32_t day_of_era = shifted - era * 146097;
+    int32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int32_t month_index = (5 * day_of_year + 2) / 153;
+    int day = (int) (day_of_year - (153 * month_index + 2) / 5 + 1);
+    int month = (int) (month_index < 10 ? month_index + 3 : month_index - 9);
+    int year = (int) (year_of_era + era * 400) + (month <= 2);
+    char text[10] = {(char) ('0' + year / 1000 % 10), (char) ('0' + year / 100 % 10), (char) ('0' + year / 10 % 10),
+                     (char) ('0' + year % 10), '-', (char) ('0' + month / 10), (char) ('0' + month % 10), '-',
+                     (char) ('0' + day / 10), (char) ('0' + day % 10)};
+    output_bytes(out, text, sizeof(text));
 }
 
 /**
- * @brief Appends a journal entry to the journal file.
+ * @brief Appends one synthetic journal line, in the format written by `output_journal_line`.
  *
- * This function writes a JournalEntry's information to a pre-defined journal file. Each entry is
- * written as a single line with fields separated by the '|' character. The following fields are
- * included in the output: book name, author, genre, start date, end date (optional), score (optional),
- * and note (optional). If any optional field is not provided, it is represented as an empty value
- * between delimiters. The function ensures safe handling of a null entry pointer and handles file
- * opening errors gracefully.
+ * Book names are unique (they end with the line number), genres and authors are drawn from the configured
+ * number of values with `random_skewed` and the start dates advance from 2000 to 2025 over the journal,
+ * as a journal kept over the years would. A finished book has an end date up to 120 days after the start
+ * and a score drawn by the weights; a book still being read has neither.
  *
- * @param entry A pointer to a JournalEntry structure containing information about the journal entry
- *              to be written. If the pointer is null, the function does nothing.
+ * @param out The buffer receiving the line.
+ * @param options Shape of the journal.
+ * @param state State of the random sequence.
+ * @param line Number of the line, from 0.
  */
-void write_entry(JournalEntry *entry) {
-    if (entry == NULL) return;
-    FILE *file = fopen(JOURNAL_FILE, "a");
-    if (file == NULL) {
-        perror("Failed to open file for writing\n");
-        return;
+void output_generated_entry(OutputBuffer *out, const GeneratorOptions *options, uint64_t *state, size_t line) {
+    static const char *const adjectives[] = {"Silent", "Hidden", "Broken", "Golden", "Last", "Northern", "Burning",
+                                             "Quiet", "Wild", "Lost", "Crimson", "Distant", "Frozen", "Secret",
+                                             "Endless", "Little"};
+    static const char *const nouns[] = {"River", "Kingdom", "Garden", "Letter", "Empire", "Voyage", "Mirror",
+                                        "Harbor", "Forest", "Promise", "Winter", "Archive", "Island", "Signal",
+                                        "Tower", "Orchard"};
+    static const char *const first_names[] = {"Anna", "Peter", "Maria", "John", "Eva", "Martin", "Lucia", "Thomas",
+                                              "Sofia", "David", "Elena", "Jakub", "Clara", "Samuel", "Nora",
+                                              "Viktor"};
+    static const char *const last_names[] = {"Novak", "Smith", "Horvath", "Garcia", "Kowalski", "Brown", "Rossi",
+                                             "Muller", "Dubois", "Tanaka", "Silva", "Jensen", "Petrov", "Walsh",
+                                             "Lindqvist", "Moreau"};
+    static const char *const genres[] = {"fantasy", "sci-fi", "mystery", "romance", "history", "biography",
+                                         "thriller", "poetry", "horror", "classics", "philosophy", "travel"};
+    static const char *const words[] = {"great", "story", "slow", "start", "loved", "the", "ending", "characters",
+                                        "recommend", "again", "beautiful", "writing", "too", "long", "read",
+                                        "twist"};
+    const size_t genre_names = sizeof(genres) / sizeof(genres[0]);
+
+    output_string(out, adjectives[next_random(state) % 16]);
+    output_bytes(out, " ", 1);
+    output_string(out, nouns[next_random(state) % 16]);
+    output_bytes(out, " ", 1);
+    output_int(out, (int) ((line + 1) % 1000000000));
+    output_bytes(out, "|", 1);
+
+    size_t author = random_skewed(state, options->authors);
+    output_string(out, first_names[author % 16]);
+    output_bytes(out, " ", 1);
+    output_string(out, last_names[author / 16 % 16]);
+    if (author >= 256) {
+        output_bytes(out, " ", 1);
+        output_int(out, (int) (author / 256));
     }
-    fprintf(file, "%s|%s|%s|%s", entry->book_name, entry->author, entry->genre, entry->start_date);
-    if (entry->end_date != NULL) {
-        fprintf(file, "|%s", entry->end_date);
+    output_bytes(out, "|", 1);
+
+    size_t genre = random_skewed(state, options->genres);
+    if (genre < genre_names) {
+        output_string(out, genres[genre]);
     } else {
-        fprintf(file, "|");
+        output_string(out, "genre-");
+        output_int(out, (int) genre);
     }
-    if (entry->score != 0) {
-        fprintf(file, "|%d", entry->score);
+    output_bytes(out, "|", 1);
+
+    int32_t first_day = days_from_civil(2000, 1, 1);
+    int32_t span = days_from_civil(2025, 12, 1) - first_day;
+    int32_t start = first_day + (int32_t) ((double) line / (double) options->lines * span) +
+                    (int32_t) (next_random(state) % 30);
+    output_day(out, start);
+    output_bytes(out, "|", 1);
+
+    if (next_random(state) % 100 >= options->reading_percent) {
+        output_day(out, start + 1 + (int32_t) (next_random(state) % 120));
+        output_bytes(out, "|", 1);
+        unsigned int total = 0;
+        for (int i = 0; i < 6; i++) total += options->score_weights[i];
+        unsigned int pick = (unsigned int) (next_random(state) % total);
+        int score = 0;
+        while (pick >= options->score_weights[score]) pick -= options->score_weights[score++];
+        if (score != 0) output_int(out, score);
+        output_bytes(out, "|", 1);
     } else {
-        fprintf(file, "|");
+        output_bytes(out, "||", 2);
     }
-    if (entry->note != NULL) {
-        fprintf(file, "|%s", entry->note);
-    } else {
-        fprintf(file, "|");
+
+    size_t note_length = options->note_length > 0 ? next_random(state) % (2 * options->note_length + 1) : 0;
+    size_t written = 0;
+    while (written < note_length) {
+        const char *word = words[next_random(state) % 16];
+        size_t length = strlen(word) + (written > 0);
+        if (written + length > note_length) break;
+        if (written > 0) output_bytes(out, " ", 1);
+        output_string(out, word);
+        written += length;
     }
-    fprintf(file, "\n");
-    fclose(file);
+    output_bytes(out, "\n", 1);
 }
 
 /**
- * @brief Handles the creation of a new journal entry based on command-line arguments.
- *
- * This function parses command-line arguments starting from the third argument (index 2) to extract
- * details necessary for creating a new journal entry, such as the book name, author, genre, start date,
- * end date, score, and an optional note. The values are processed and stored in a dynamically allocated
- * JournalEntry struct.
+ * @brief Parses a non-negative number of a bench option, reporting an invalid value.
  *
- * The following options are supported:
- * - `--name`: Specifies the book name. This option is required.
- * - `--author`: Specifies the author's name. This option is required.
- * - `--genre`: Specifies the book's genre. This option is required.
- * - `--start`: Specifies the start date in a valid date format. This option is required.
- * - `--end`: (Optional) Specifies the end date in a valid date format.
- * - `--score`: (Optional) Specifies a numeric score for the entry.
- * - `--note`: (Optional) Specifies an additional note or description.
+ * @param option Name of the option, for the error message.
+ * @param text The value, NULL if the option has none.
+ * @param max The largest accepted value.
+ * @param value Receives the number.
  *
- * If any required arguments are missing, an error message is displayed, and the function ends without
- * creating an entry.
+ * @return True if the value is a number from 0 to `max`.
+ */
+bool parse_bench_number(const char *option, const char *text, unsigned long long max, unsigned long long *value) {
+    char *end = NULL;
+    if (text != NULL && isdigit((unsigned char) text[0])) *value = strtoull(text, &end, 10);
+    if (end == NULL || *end != '\0' || *value > max) {
+        printf("Invalid value of %s, expected a number from 0 to %llu\n", option, max);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs `bench generate`, which writes a synthetic journal for benchmarks.
  *
- * @param argc The total number of command-line arguments provided to the program.
- * @param argv An array of null-terminated strings representing the command-line arguments.
+ * `bench generate [--lines <int>] [--genres <int>] [--authors <int>] [--reading <percent>]
+ * [--scores <w0,w1,w2,w3,w4,w5>] [--note-length <bytes>] [--seed <int>] [--file <path>]` writes the lines
+ * of `output_generated_entry` to the file (the journal by default). An existing file is never overwritten.
+ * The same options and seed always produce the same journal.
  *
- * - If `argc` is less than 6, the function immediately displays an error message and prints usage
- *   instructions using `print_help`.
- * - For each argument matching one of the supported options, the associated value is extracted using
- *   helper functions like `get_option_value`. For dates, `get_date` is used to process the input.
- * - If memory allocation for the journal entry fails, an error is logged using `perror`, and the function
- *   terminates.
- * - After parsing, the function validates the presence of all required options. Missing required options
- *   result in relevant error messages.
- * - If all required options are valid, the new entry is added by invoking `print_entry` to display it and
- *   `write_entry` to persist it.
- * - Memory associated with the journal entry is released using `free_entry` to avoid memory leaks.
+ * @return The exit code of the program.
  */
-void new_cmd(int argc, char *argv[]) {
-    if (argc < 6) {
-        printf("Not enough arguments for new command\n");
-        print_help();
-        return;
-    }
-    JournalEntry *entry = malloc(sizeof(JournalEntry));
-    if (entry == NULL) {
-        perror("Failed to allocate memory for journal entry");
-        return;
-    }
-    for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "--name") == 0) {
-            entry->book_name = get_option_value(argc, argv, i);
-        } else if (strcmp(argv[i], "--author") == 0) {
-            entry->author = get_option_value(argc, argv, i);
-        } else if (strcmp(argv[i], "--genre") == 0) {
-            entry->genre = get_option_value(argc, argv, i);
-        } else if (strcmp(argv[i], "--start") == 0) {
-            entry->start_date = get_date(get_option_value(argc, argv, i));
-        } else if (strcmp(argv[i], "--end") == 0) {
-            entry->end_date = get_date(get_option_value(argc, argv, i));
-        } else if (strcmp(argv[i], "--score") == 0) {
-            char *score_value = get_option_value(argc, argv, i);
-            if (score_value == NULL) continue;
-            entry->score = strtol(score_value, NULL, 10);
-        } else if (strcmp(argv[i], "--note") == 0) {
-            entry->note = get_option_value(argc, argv, i);
+int bench_generate(int argc, char *argv[]) {
+    GeneratorOptions options = {100000, 12, 2000, 5, {5, 2, 5, 15, 40, 33}, 60, 1};
+    const char *file = JOURNAL_FILE;
+    for (int i = 3; i < argc; i++) {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[++i] : NULL;
+        unsigned long long number = 0;
+        if ((strcmp(option, "--file") == 0 || strcmp(option, "--scores") == 0) && value == NULL) {
+            printf("Option %s requires a value\n", option);
+            return 1;
+        } else if (strcmp(option, "--file") == 0) {
+            file = value;
+        } else if (strcmp(option, "--scores") == 0) {
+            unsigned int total = 0;
+            const char *cursor = value;
+            char *end = NULL;
+            for (int w = 0; w < 6; w++) {
+                unsigned long weight = isdigit((unsigned char) *cursor) ? strtoul(cursor, &end, 10) : 1000001;
+                if (weight > 1000000 || *end != (w < 5 ? ',' : '\0')) {
+                    printf("Invalid score weights, expected six numbers: no score,1,2,3,4,5\n");
+                    return 1;
+                }
+                options.score_weights[w] = (unsigned int) weight;
+                total += (unsigned int) weight;
+                cursor = end + 1;
+            }
+            if (total == 0) {
+                printf("Invalid score weights, at least one must be positive\n");
+                return 1;
+            }
+        } else if (strcmp(option, "--lines") == 0) {
+            if (!parse_bench_number(option, value, 1000000000, &number)) return 1;
+            options.lines = number;
+        } else if (strcmp(option, "--genres") == 0) {
+            if (!parse_bench_number(option, value, 1000000, &number)) return 1;
+            options.genres = number;
+        } else if (strcmp(option, "--authors") == 0) {
+            if (!parse_bench_number(option, value, 1000000000, &number)) return 1;
+            options.authors = number;
+        } else if (strcmp(option, "--reading") == 0) {
+            if (!parse_bench_number(option, value, 100, &number)) return 1;
+            options.reading_percent = (unsigned int) number;
+        } else if (strcmp(option, "--note-length") == 0) {
+            if (!parse_bench_number(option, value, 100000, &number)) return 1;
+            options.note_length = number;
+        } else if (strcmp(option, "--seed") == 0) {
+            if (!parse_bench_number(option, value, UINT64_MAX, &number)) return 1;
+            options.seed = number;
+        } else {
+            printf("Unknown option for bench generate: %s\n", option);
+            return 1;
         }
     }
-
-    bool valid = true;
-    if (entry->book_name == NULL) {
-        printf("Error: Book name is required, with option --name\n");
-        valid = false;
+    if (options.lines == 0 || options.genres == 0 || options.authors == 0) {
+        printf("Options --lines, --genres and --authors must be at least 1\n");
+        return 1;
     }
-    if (entry->author == NULL) {
-        printf("Error: Author is required, with option --author\n");
-        valid = false;
+    int fd = open(file, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            printf("File %s already exists, generate into a new file\n", file);
+        } else {
+            perror("Failed to create the generated journal");
+        }
+        return 1;
     }
-    if (entry->genre == NULL) {
-        printf("Error: Genre is required, with option --genre\n");
-        valid = false;
+    OutputBuffer out;
+    output_init(&out, fd);
+    uint64_t state = options.seed;
+    for (size_t line = 0; line < options.lines && !out.failed; line++) {
+        output_generated_entry(&out, &options, &state, line);
     }
-    if (entry->start_date == NULL) {
-        printf("Error: Start date is required, with option --start\n");
-        valid = false;
+    output_free(&out);
+    off_t bytes = lseek(fd, 0, SEEK_CUR);
+    bool ok = !out.failed && bytes >= 0;
+    if (close(fd) != 0) ok = false;
+    if (!ok) {
+        printf("Failed to generate the journal\n");
+        return 1;
     }
+    printf("Generated %zu entries, %lld bytes to %s\n", options.lines, (long long) bytes, file);
+    return 0;
+}
 
-    if (valid) {
-        printf("New entry added:\n");
-        print_entry(entry);
-        write_entry(entry);
+/**
+ * @brief Counts the entries of a block accepted by one predicate, calling its filter function in a tight loop.
+ */
+size_t count_filter_matches(const FilterPredicate *predicate, JournalEntry *const *entries, size_t count) {
+    size_t matched = 0;
+    switch (predicate->kind) {
+        case FILTER_GENRE:
+            for (size_t i = 0; i < count; i++) matched += filter_by_genre(entries[i], predicate);
+            break;
+        case FILTER_SCORE:
+            for (size_t i = 0; i < count; i++) matched += filter_by_score(entries[i], predicate);
+            break;
+        case FILTER_READING:
+            for (size_t i = 0; i < count; i++) matched += filter_if_reading(entries[i]);
+            break;
+        case FILTER_COMPLETED:
+            for (size_t i = 0; i < count; i++) matched += filter_if_completed(entries[i]);
+            break;
+        default:
+            break;
     }
-    free_entry(entry);
+    return matched;
 }
 
 /**
- * @brief Parses a delimited line of text and constructs a JournalEntry instance.
+ * @brief Times `write_entry` appending the given entries to a journal in a new temporary directory.
  *
- * This function reads a line of text that contains fields separated by the '|' delimiter
- * and attempts to populate a dynamically allocated JournalEntry structure. The fields
- * in the input line are expected to follow the order:
- * book_name, author, genre, start_date, end_date, score, note. If any of the required
- * fields (book_name, author, genre, start_date) are missing or invalid, the function fails
- * and returns a NULL.
+ * The directory is created in the current directory, so the appends hit the same file system as the
+ * benchmarked journal, and it is removed afterwards together with the files the appends created.
  *
- * @param line A null-terminated string containing the delimited line of data. The string
- *             should use the '|' character to separate fields.
- *
- * @return A pointer to a dynamically allocated JournalEntry instance on success, or NULL
- *         if allocation fails or the line does not contain the required fields. The caller
- *         is responsible for freeing the returned JournalEntry using free_entry.
- *
- * - Each field in the input line is processed in sequential order based on its position:
- *   - Field 0: Populates the `book_name` field of the JournalEntry.
- *   - Field 1: Populates the `author` field of the JournalEntry.
- *   - Field 2: Populates the `genre` field of the JournalEntry.
- *   - Field 3: Populates the `start_date` field of the JournalEntry.
- *   - Field 4: Optionally populates the `end_date` field if provided.
- *   - Field 5: Optionally parses the `score` field as an unsigned integer.
- *   - Field 6: Optionally populates the `note` field if provided.
- *
- * - If memory allocation fails for any fields, the function cleans up any
- *   previously allocated memory, logs an error message, and returns NULL.
- * - The function ensures that required fields (`book_name`, `author`, `genre`,
- *   and `start_date`) are not null and contain valid data.
- */
-JournalEntry *load_entry(char *line) {
-    JournalEntry *entry = malloc(sizeof(JournalEntry));
-    if (entry == NULL) {
-        perror("Failed to allocate memory for journal entry");
-        return NULL;
+ * @return False if the directory cannot be used or an append fails. Errors are reported.
+ */
+bool bench_appends(const JournalEntry *entries, size_t count, BenchStage *stage) {
+    static const char *const created_files[] = {JOURNAL_FILE, JOURNAL_SYNC_FILE, JOURNAL_STATS_FILE,
+                                                JOURNAL_SEARCH_DELTA_FILE, JOURNAL_OFFSETS_FILE};
+    char directory[] = "journal-bench-XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        perror("Failed to create a directory for the append benchmark");
+        return false;
     }
-    entry->book_name = NULL;
-    entry->author = NULL;
-    entry->genre = NULL;
-    entry->start_date = NULL;
-    entry->end_date = NULL;
-    entry->score = 0;
-    entry->note = NULL;
-
-    int field = 0;
-    char *current_line = line;
-    char *token;
-    while ((token = strsep(&current_line, "|")) != NULL) {
-        switch (field) {
-            case 0:
-                entry->book_name = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->book_name, token);
-                break;
-            case 1:
-                entry->author = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->author, token);
-                break;
-            case 2:
-                entry->genre = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->genre, token);
-                break;
-            case 3:
-                entry->start_date = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->start_date, token);
-                break;
-            case 4:
-                if (strlen(token) == 0) break;
-                entry->end_date = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->end_date, token);
-                break;
-            case 5:
-                if (strlen(token) == 0) break;
-                entry->score = strtol(token, NULL, 10);
-                break;
-            case 6:
-                if (strlen(token) == 0) break;
-                entry->note = malloc(sizeof(char) * strlen(token));
-                strcpy(entry->note, token);
-                break;
-            default: break;
-        }
-        field++;
+    int previous = open(".", O_RDONLY | O_DIRECTORY);
+    if (previous < 0 || chdir(directory) != 0) {
+        perror("Failed to enter the directory of the append benchmark");
+        if (previous >= 0) close(previous);
+        rmdir(directory);
+        return false;
     }
-    if (entry->book_name == NULL || entry->author == NULL || entry->genre == NULL || entry->start_date == NULL) {
-        printf("Failed to load journal entry from line: %s", line);
-        free_entry(entry);
-        return NULL;
+    bool ok = true;
+    double start = monotonic_seconds();
+    for (size_t i = 0; i < count && ok; i++) ok = write_entry(&entries[i], SYNC_NONE);
+    stage->seconds = monotonic_seconds() - start;
+    struct stat journal_stat;
+    stage->records = count;
+    stage->matched = count;
+    stage->bytes = stat(JOURNAL_FILE, &journal_stat) == 0 ? (size_t) journal_stat.st_size : 0;
+    for (size_t i = 0; i < sizeof(created_files) / sizeof(created_files[0]); i++) unlink(created_files[i]);
+    if (fchdir(previous) != 0 || rmdir(directory) != 0) {
+        perror("Failed to remove the directory of the append benchmark");
+        ok = false;
     }
-    return entry;
+    close(previous);
+    return ok;
 }
 
 /**
- * @brief Filters a journal entry based on its genre.
- *
- * This function is used to check if a given journal entry belongs to a specified genre.
- * It compares the genre field of the journal entry with the provided genre string.
- * Both the journal entry and the genre string must be non-null for the comparison to take place.
- *
- * @param entry A pointer to the JournalEntry structure to be checked.
- *              This parameter must not be null.
- * @param genre A null-terminated C-string specifying the genre to filter by.
- *              This parameter must not be null.
- *
- * @return True if the journal entry's genre matches the specified genre, otherwise false.
- *
- * - If either the journal entry or the genre string is null, the function returns false.
- * - Comparison is performed using `strcmp`, which checks for an exact match between the two strings.
+ * @brief Prints a string as a JSON string literal.
  */
-bool filter_by_genre(JournalEntry *entry, char *genre) {
-    return entry != NULL && genre != NULL && strcmp(entry->genre, genre) == 0;
+void print_json_string(const char *string) {
+    putchar('"');
+    for (const unsigned char *c = (const unsigned char *) string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20) {
+            printf("\\u%04x", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
 }
 
 /**
- * @brief Filters a journal entry based on a minimum score threshold.
- *
- * This function checks whether the `score` of the provided journal entry meets or
- * exceeds a minimum threshold specified as a string input. It converts the input
- * score from a string to an integer before comparing it with the journal entry's score.
- *
- * @param entry A pointer to the `JournalEntry` structure to be evaluated. The pointer
- *              must not be null.
- * @param score A null-terminated C-string representing the minimum score threshold
- *              for filtering. This parameter must not be null.
- *
- * @return True if the journal entry's score is greater than or equal to the specified
- *         minimum score, otherwise returns false.
- *
- * - If either `entry` or `score` is null, the function returns false.
- * - The comparison uses the integer value parsed from the `score` string. If the string
- *   cannot be converted to a valid integer, the behavior is unspecified.
+ * @brief Prints one stage of `bench suite` as a JSON object with its throughput.
  */
-bool filter_by_score(JournalEntry *entry, char *score) {
-    if (entry == NULL || score == NULL) return false;
-    unsigned int score_int = strtol(score, NULL, 10);
-    return entry->score >= score_int;
+void print_bench_stage(const BenchStage *stage, bool last) {
+    double seconds = stage->seconds > 0 ? stage->seconds : 1e-9;
+    printf("    {\"name\": \"%s\", \"records\": %zu, \"bytes\": %zu, \"matched\": %zu, \"seconds\": %.6f, "
+           "\"records_per_sec\": %.0f, \"mb_per_sec\": %.2f, \"peak_rss_kb\": %ld}%s\n",
+           stage->name, stage->records, stage->bytes, stage->matched, stage->seconds,
+           (double) stage->records / seconds, (double) stage->bytes / seconds / 1e6, stage->peak_rss_kb,
+           last ? "" : ",");
 }
 
 /**
- * @brief Filters journal entries that are currently being read.
+ * @brief Runs `bench suite`, which times the stages of the journal code separately on a journal file.
  *
- * This function is used to determine whether a journal entry represents a book
- * that is still being read. An entry is considered to be "currently being read"
- * if it has not been marked with an end date.
+ * `bench suite [--file <path>] [--genre <string>] [--score <int>] [--appends <int>]` reads the journal in
+ * blocks of `BENCH_BLOCK_LINES` lines. Each block is parsed with `load_entry`, then every filter function
+ * (`filter_by_genre`, `filter_by_score`, `filter_if_reading`, `filter_if_completed`) runs over the loaded
+ * entries on its own and `print_entry` formats them into a memory buffer, so no stage pays for the
+ * terminal. Finally the first entries are appended with `write_entry` by `bench_appends`.
  *
- * @param entry A pointer to the JournalEntry to be evaluated. The pointer must
- *              not be null.
- * @param ignored A pointer to a char argument that is ignored by this filter.
- *                It exists for consistency with other filter functions, but it
- *                is not used in this function.
+ * The result is one JSON document on stdout, with records/s, MB/s and the peak RSS of every stage, meant
+ * to be stored and compared across versions.
  *
- * @return True if the entry is not null and the end date of the entry is null,
- *         indicating that the book is still being read. Otherwise, false.
+ * @return The exit code of the program.
  */
-bool filter_if_reading(JournalEntry *entry, char *ignored) {
-    return entry != NULL && entry->end_date == NULL;
+int bench_suite(int argc, char *argv[]) {
+    const char *file = JOURNAL_FILE;
+    const char *genre = "fantasy";
+    const char *score = "4";
+    unsigned long long appends = BENCH_APPENDS;
+    for (int i = 3; i < argc; i++) {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[++i] : NULL;
+        if (strcmp(option, "--appends") == 0) {
+            if (!parse_bench_number(option, value, 10000000, &appends)) return 1;
+        } else if (strcmp(option, "--file") != 0 && strcmp(option, "--genre") != 0 && strcmp(option, "--score") != 0) {
+            printf("Unknown option for bench suite: %s\n", option);
+            return 1;
+        } else if (value == NULL) {
+            printf("Option %s requires a value\n", option);
+            return 1;
+        } else if (strcmp(option, "--file") == 0) {
+            file = value;
+        } else if (strcmp(option, "--genre") == 0) {
+            genre = value;
+        } else {
+            score = value;
+        }
+    }
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        perror("Failed to open file for reading\n");
+        return 1;
+    }
+    MappedJournal journal;
+    if (!map_journal(fd, &journal) || journal.size == 0) {
+        printf("Journal %s cannot be benchmarked, it is empty or not a regular file\n", file);
+        close(fd);
+        return 1;
+    }
+    JournalFilter filter;
+    init_filter(&filter);
+    add_filter_predicate(&filter, FILTER_GENRE, genre, false);
+    add_filter_predicate(&filter, FILTER_SCORE, score, false);
+    add_filter_predicate(&filter, FILTER_READING, NULL, false);
+    add_filter_predicate(&filter, FILTER_COMPLETED, NULL, false);
+    BenchStage stages[] = {{"load_entry", 0, 0, 0, 0, 0}, {"filter_by_genre", 0, 0, 0, 0, 0},
+                           {"filter_by_score", 0, 0, 0, 0, 0}, {"filter_if_reading", 0, 0, 0, 0, 0},
+                           {"filter_if_completed", 0, 0, 0, 0, 0}, {"print_entry", 0, 0, 0, 0, 0},
+                           {"write_entry", 0, 0, 0, 0, 0}};
+    const size_t stage_count = sizeof(stages) / sizeof(stages[0]);
+    JournalEntry **loaded = malloc(BENCH_BLOCK_LINES * sizeof(JournalEntry *));
+    JournalEntry *appended = malloc((appends > 0 ? appends : 1) * sizeof(JournalEntry));
+    if (loaded == NULL || appended == NULL) {
+        perror("Failed to allocate memory for the benchmark");
+        free(loaded);
+        free(appended);
+        unmap_journal(&journal);
+        close(fd);
+        genre_dictionary_free(&genre_dictionary);
+        return 1;
+    }
+    Arena arena;
+    arena_init(&arena);
+    OutputBuffer printed;
+    OutputBuffer invalid;
+    output_init(&printed, -1);
+    output_init(&invalid, -1);
+    size_t append_count = 0;
+    const char *cursor = journal.data;
+    const char *end = journal.data + journal.size;
+    while (cursor < end) {
+        const char *block_start = cursor;
+        size_t lines = 0;
+        size_t count = 0;
+        double start = monotonic_seconds();
+        for (; cursor < end && lines < BENCH_BLOCK_LINES; lines++) {
+            const char *newline = memchr(cursor, '\n', end - cursor);
+            const char *line_end = newline != NULL ? newline : end;
+            JournalEntry *entry = load_entry(&arena, cursor, line_end - cursor, &invalid);
+            if (entry != NULL) loaded[count++] = entry;
+            cursor = newline != NULL ? newline + 1 : end;
+        }
+        stages[0].seconds += monotonic_seconds() - start;
+        stages[0].records += lines;
+        stages[0].bytes += cursor - block_start;
+        stages[0].matched += count;
+        invalid.used = 0;
+
+        for (size_t i = 0; i < filter.count; i++) {
+            BenchStage *stage = &stages[1 + i];
+            start = monotonic_seconds();
+            stage->matched += count_filter_matches(&filter.predicates[i], loaded, count);
+            stage->seconds += monotonic_seconds() - start;
+            stage->records += count;
+            stage->bytes += cursor - block_start;
+        }
+
+        start = monotonic_seconds();
+        for (size_t i = 0; i < count; i++) print_entry(&printed, loaded[i]);
+        stages[5].seconds += monotonic_seconds() - start;
+        stages[5].records += count;
+        stages[5].matched += count;
+        stages[5].bytes += printed.used;
+        printed.used = 0;
+
+        for (size_t i = 0; i < count && append_count < appends; i++) appended[append_count++] = *loaded[i];
+        arena_reset(&arena);
+    }
+    long scan_peak = peak_rss_kb();
+    for (size_t i = 0; i + 1 < stage_count; i++) stages[i].peak_rss_kb = scan_peak;
+    bool ok = !printed.failed && (append_count == 0 || bench_appends(appended, append_count, &stages[6]));
+    stages[6].peak_rss_kb = peak_rss_kb();
+
+    if (ok) {
+        printf("{\n  \"benchmark\": \"journal\",\n  \"file\": ");
+        print_json_string(file);
+        printf(",\n  \"lines\": %zu,\n  \"bytes\": %zu,\n  \"invalid_lines\": %zu,\n  \"block_lines\": %d,\n",
+               stages[0].records, journal.size, stages[0].records - stages[0].matched, BENCH_BLOCK_LINES);
+        printf("  \"stages\": [\n");
+        for (size_t i = 0; i < stage_count; i++) print_bench_stage(&stages[i], i + 1 == stage_count);
+        printf("  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+    }
+    output_free(&printed);
+    output_free(&invalid);
+    arena_free(&arena);
+    free(loaded);
+    free(appended);
+    unmap_journal(&journal);
+    close(fd);
+    genre_dictionary_free(&genre_dictionary);
+    return ok ? 0 : 1;
 }
 
 /**
- * @brief Filters journal entries to include only completed books.
- *
- * This function checks if a journal entry is marked as completed, which is determined
- * by the presence of a non-null `end_date` field. It is typically used as a filter
- * function when processing or listing journal entries to focus only on books that
- * have been finished.
- *
- * @param entry A pointer to a `JournalEntry` structure representing the entry to be evaluated.
- *              The entry should not be null, and its `end_date` field is checked for completion status.
- * @param ignored A placeholder parameter for compatibility with list command filters.
- *                This parameter is not utilized in the function's logic.
+ * @brief Runs `bench tokenize`, which compares the ways of splitting a journal into entries.
  *
- * @return True if the `JournalEntry` is not null and has a non-null `end_date` field, otherwise false.
+ * `bench tokenize [--lines <count>] [--note-length <bytes>]` compares splitting a journal into entries with
+ * `strsep` (the original stream path), with `memchr` line by line and with the `LineTokenizer` using each
+ * delimiter scanner the CPU supports. All of them must report the same checksum.
  *
- * - If the `entry` parameter is null, the function returns false.
- * - The `ignored` parameter is ignored and does not affect the function's result.
+ * @return The exit code of the program.
  */
-bool filter_if_completed(JournalEntry *entry, char *ignored) {
-    return entry != NULL && entry->end_date != NULL;
+int bench_tokenize(int argc, char *argv[]) {
+
+    size_t lines = 200000;
+    size_t note_length = 400;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--lines") == 0) {
+            lines = strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--note-length") == 0) {
+            note_length = strtoul(argv[i + 1], NULL, 10);
+        }
+    }
+    if (lines == 0) {
+        printf("Benchmark needs at least one line\n");
+        return 1;
+    }
+    size_t size;
+    char *data = build_bench_journal(lines, note_length, &size);
+    if (data == NULL) {
+        perror("Failed to allocate memory for benchmark journal");
+        return 1;
+    }
+    printf("Tokenizer benchmark: %zu lines, %zu bytes, note length %zu\n", lines, size, note_length);
+    report_bench_tokenizer("strsep", data, size, lines, NULL, bench_strsep);
+    report_bench_tokenizer("memchr", data, size, lines, NULL, bench_memchr);
+    report_bench_tokenizer("scalar", data, size, lines, scan_delimiters_scalar, NULL);
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) report_bench_tokenizer("sse2", data, size, lines, scan_delimiters_sse2, NULL);
+    if (__builtin_cpu_supports("avx2")) report_bench_tokenizer("avx2", data, size, lines, scan_delimiters_avx2, NULL);
+#endif
+    free(data);
+    return 0;
 }
 
 /**
- * @brief Lists journal entries from the journal file, applying an optional filter.
- *
- * This function reads entries from the journal file, parses them into `JournalEntry` structures,
- * optionally filters them using the provided filter function, and displays the filtered results.
- * It also reports the total number of entries and the number of filtered entries that were listed.
- *
- * @param filter A pointer to a filtering function that takes a `JournalEntry` and a filter argument,
- *               and returns `true` if the entry satisfies the filter criteria, or `false` otherwise.
- *               If `filter` is `NULL`, no filtering is applied, and all entries are listed.
- * @param filter_argv A filter-specific argument to pass to the filter function. This can be `NULL`
- *                    if the filter does not require additional arguments or if no filter is provided.
+ * @brief Handles the "bench" command, which runs the benchmarks of the journal internals.
  *
- * @note The journal entries are expected to be stored in a file defined by the `JOURNAL_FILE` macro.
- *       Each line of the file should represent a single entry in a specific delimited format. The
- *       exact format of the entries is handled by the `load_entry` function.
+ * - `bench tokenize` compares the tokenizers on an in-memory journal (`bench_tokenize`).
+ * - `bench generate` writes a synthetic journal of a given size and shape (`bench_generate`).
+ * - `bench suite` times loading, filtering, printing and appending on a journal file and prints JSON
+ *   (`bench_suite`).
  *
- * - If the journal file cannot be opened for reading, an error is displayed, and the function exits early.
- * - For each entry, the function ensures the entry is properly loaded before applying the filter and
- *   printing the entry if it matches the filter criteria.
- * - Memory allocated for each entry is freed after it is processed.
- * - At the end of the process, a summary is printed indicating the number of entries listed and the
- *   total number of entries in the file.
+ * @param argc The number of arguments passed to the program.
+ * @param argv The arguments passed to the program.
  *
- * @warning If the journal file is not in the expected format or contains invalid entries, those entries
- *          are skipped, and the function continues processing the remaining entries.
+ * @return The exit code of the program.
  */
-void list_entries(bool (*filter)(JournalEntry *, char *), char *filter_argv) {
-    FILE *file = fopen(JOURNAL_FILE, "r");
-    if (file == NULL) {
-        perror("Failed to open file for reading\n");
-        return;
-    }
-    printf("Reading journal:\n");
-    char *line = NULL;
-    size_t len = 0;
-    size_t read;
-    int total_entries = 0;
-    int filtered_entries = 0;
-    while ((read = getline(&line, &len, file)) != (size_t) -1) {
-        line[strcspn(line, "\n")] = '\0';
-        JournalEntry *entry = load_entry(line);
-        if (entry == NULL) continue;
-        total_entries++;
-        if (filter != NULL && filter(entry, filter_argv)) {
-            print_entry(entry);
-            filtered_entries++;
-        } else if (filter == NULL) {
-            print_entry(entry);
-            filtered_entries++;
-        }
-        free_entry(entry);
-    }
-    printf("\nListed entries %d/%d\n", filtered_entries, total_entries);
-    free(line);
-    fclose(file);
+int bench_cmd(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[2], "tokenize") == 0) return bench_tokenize(argc, argv);
+    if (argc >= 3 && strcmp(argv[2], "generate") == 0) return bench_generate(argc, argv);
+    if (argc >= 3 && strcmp(argv[2], "suite") == 0) return bench_suite(argc, argv);
+    printf("Unknown benchmark, expected: bench tokenize, bench generate or bench suite\n");
+    return 1;
 }
 
 /**
- * @brief Handles the "list" command for displaying journal entries based on various filters or criteria.
- *
- * This function processes command-line arguments to determine which subset of journal entries to display.
- * It supports filtering entries by genre, reading status, completion status, or score, or listing all entries
- * when no specific filter is provided.
+ * @brief Removes global options from the arguments so that commands only see their own options.
  *
- * @param argc The number of arguments passed to the program, including the program name.
- *             Must be at least 2 for the command to work, as the "list" command itself requires input.
- * @param argv An array of null-terminated C-strings representing the arguments passed to the program.
- *             For filtering, additional arguments in the following formats are expected:
- *             - "--genre <genre_name>" to filter entries by a specific genre.
- *             - "--reading" to filter entries that are currently being read.
- *             - "--completed" to filter entries that have been completed.
- *             - "--score <score_threshold>" to filter entries with a score equal to or higher than the given value.
+ * Supported global options:
+ * - `--alloc-stats`: report arena allocation counters of the command to stderr.
+ * - `--no-daemon`: run `list` and `new` in this process even if a daemon (`serve`) is running.
+ * - `--profile`: report the time of the phases of `list` and `new` and their counters to stderr. These
+ *   commands then run in this process, not in the daemon.
  *
- * @details
- * - If fewer than 2 arguments are provided, an error message is displayed and help information is shown.
- * - If a filter option is provided (e.g., "--genre", "--reading"), the function checks for supported options
- *   and invokes `list_entries` with the appropriate filter function and argument.
- * - If no filter option is provided, the function lists all entries by calling `list_entries` without a filter.
- * - If an unsupported filter option is provided, an error message is displayed and help information is shown.
- *
- * Functions invoked within this function:
- * - `print_help()`: Displays help information about the command.
- * - `list_entries(bool (*filter)(JournalEntry *, char *), char *filter_argv)`: Executes the filtering and listing of journal entries.
- * - Filter functions like `filter_by_genre`, `filter_if_reading`, `filter_if_completed`, and `filter_by_score` are passed
- *   as function pointers to `list_entries` for specific filtering behavior.
- *
- * Edge cases handled:
- * - If an invalid filter option is provided, an error message is displayed with usage instructions.
- * - If a required argument for a filter (e.g., genre name for "--genre") is missing, the function avoids invalid memory access.
+ * @return The new number of arguments.
  */
-void list_cmd(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Not enough arguments for list command\n");
-        print_help();
-        return;
-    }
-    if (argc >= 3) {
-        if (strcmp(argv[2], "--genre") == 0) {
-            list_entries(filter_by_genre, argv[3]);
-        } else if (strcmp(argv[2], "--reading") == 0) {
-            list_entries(filter_if_reading, NULL);
-        } else if (strcmp(argv[2], "--completed") == 0) {
-            list_entries(filter_if_completed, NULL);
-        } else if (strcmp(argv[2], "--score") == 0) {
-            list_entries(filter_by_score, argv[3]);
+int strip_global_options(int argc, char *argv[]) {
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--alloc-stats") == 0) {
+            alloc_stats_enabled = true;
+        } else if (strcmp(argv[i], "--no-daemon") == 0) {
+            daemon_enabled = false;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile_enabled = true;
         } else {
-            printf("Unknown filter option: %s\n", argv[2]);
-            print_help();
+            argv[kept++] = argv[i];
         }
-    } else {
-        list_entries(NULL, NULL);
     }
+    argv[kept] = NULL;
+    return kept;
 }
 
 int main(int argc, char *argv[]) {
+    argc = strip_global_options(argc, argv);
+    profile_enter(PROFILE_OTHER);
     if (argc <= 1) {
         print_help();
         return 0;
@@ -663,11 +9602,50 @@ int main(int argc, char *argv[]) {
             print_help();
             return 0;
         } else if (strcmp(argv[a], "new") == 0) {
-            new_cmd(argc, argv);
-            return 0;
+            int status = 0;
+            if (!daemon_enabled || profile_enabled || !forward_to_daemon(argc, argv, &status)) new_cmd(argc, argv);
+            print_profile("new");
+            return status;
         } else if (strcmp(argv[a], "list") == 0) {
-            list_cmd(argc, argv);
+            // A follower runs until interrupted, so it is not sent to the daemon, which runs one at a time
+            int status = 0;
+            if (!daemon_enabled || profile_enabled || has_argument(argc, argv, "--follow") ||
+                !forward_to_daemon(argc, argv, &status)) {
+                list_cmd(argc, argv);
+            }
+            print_profile("list");
+            return status;
+        } else if (strcmp(argv[a], "index") == 0) {
+            index_cmd(argc, argv);
+            return 0;
+        } else if (strcmp(argv[a], "import") == 0) {
+            import_cmd(argc, argv);
+            return 0;
+        } else if (strcmp(argv[a], "export") == 0) {
+            export_cmd(argc, argv);
+            print_profile("list");
+            return 0;
+        } else if (strcmp(argv[a], "update") == 0) {
+            return change_cmd(argc, argv, CHANGE_UPDATE);
+        } else if (strcmp(argv[a], "delete") == 0) {
+            return change_cmd(argc, argv, CHANGE_DELETE);
+        } else if (strcmp(argv[a], "compact") == 0) {
+            return compact_cmd();
+        } else if (strcmp(argv[a], "pack") == 0) {
+            pack_cmd(argc, argv);
+            return 0;
+        } else if (strcmp(argv[a], "serve") == 0) {
+            return serve_cmd(argc, argv);
+        } else if (strcmp(argv[a], "search") == 0) {
+            search_cmd(argc, argv);
+            return 0;
+        } else if (strcmp(argv[a], "stats") == 0) {
+            stats_cmd(argc, argv);
             return 0;
+        } else if (strcmp(argv[a], "verify") == 0) {
+            return verify_cmd(argc, argv);
+        } else if (strcmp(argv[a], "bench") == 0) {
+            return bench_cmd(argc, argv);
         }
     }
 
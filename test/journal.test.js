@@ -3,6 +3,18 @@ import * as path from "node:path";
 
 const binDir = process.env.BIN_DIR || "../bin";
 const journal = path.join(binDir, "journal");
+const binary = path.resolve(journal);
+
+/**
+ * Returns a shell command that runs `commands` in a new temporary directory, whose journal consists of
+ * `lines` (each terminated by a newline) unless `lines` is empty. Lines go through printf, so they must
+ * not contain a single quote.
+ */
+function inTempJournal(lines, commands) {
+	const text = lines.map((line) => line + "\\n").join("");
+	const fixture = lines.length > 0 ? `printf '${text}' > reading_journal.txt && ` : "";
+	return `cd "$(mktemp -d)" && ${fixture}${commands}`;
+}
 
 test.use({shell: Shell.Bash, rows: 50});
 
@@ -21,4 +33,326 @@ test("should print help", async ({terminal}) => {
 	}
 	await expect(terminal).toMatchSnapshot();
 	if (!passed) throw new Error("Help text not found");
-});
\ No newline at end of file
+});
+
+test("should list the same entries from a mapped journal and from a pipe", async ({terminal}) => {
+	const lines = ["Hobbit|Tolkien|fantasy|2024-01-01|2024-01-10|5|", "broken|line", "Dune|Herbert|scifi|2024-02-01|||"];
+	terminal.submit(inTempJournal(lines,
+		`${binary} list > mapped.txt && mv reading_journal.txt lines.txt && mkfifo reading_journal.txt && ` +
+		`(cat lines.txt > reading_journal.txt &) && ${binary} list > piped.txt && ` +
+		`cmp -s mapped.txt piped.txt && echo "pipe: same"; grep Failed mapped.txt; tail -n 1 mapped.txt`));
+	await expect(terminal.getByText("pipe: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Failed to load journal entry from line: broken|line")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 2/2")).toBeVisible();
+});
+
+test("should allocate the entries of a piped journal from one arena block", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 10000 --seed 3 --file lines.txt > /dev/null && ` +
+		`cp lines.txt reading_journal.txt && ${binary} --alloc-stats list 2>&1 > /dev/null | sed "s/^/mapped /" && ` +
+		`rm reading_journal.txt && mkfifo reading_journal.txt && (cat lines.txt > reading_journal.txt &) && ` +
+		`${binary} --alloc-stats list 2>&1 > /dev/null | sed "s/^/piped /"`));
+	await expect(terminal.getByText("mapped list: 0 arena allocations, 0 malloc calls, peak 0 arena bytes"))
+		.toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("piped list: 10000 arena allocations, 1 malloc calls")).toBeVisible();
+});
+
+test("should list the same entries with the index as without it and refresh it on append", async ({terminal}) => {
+	const filter = "--genre mystery --score 4 --not --reading";
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 20000 --seed 7 > /dev/null && ` +
+		`printf 'broken line\\n' >> reading_journal.txt && ${binary} list --no-index ${filter} > plain.txt && ` +
+		`${binary} index > /dev/null && ${binary} list ${filter} > index.txt && ` +
+		`cmp -s plain.txt index.txt && echo "index: same"; tail -n 1 plain.txt; ` +
+		`${binary} new --name Hobbit --author Tolkien --genre mystery --start 2024-01-01 --end 2024-02-01 --score 5 > /dev/null && ` +
+		`${binary} list ${filter} | tail -n 1 && ${binary} index`));
+	await expect(terminal.getByText("index: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Listed entries 1837/20000")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 1838/20001")).toBeVisible();
+	await expect(terminal.getByText("Journal index reading_journal.idx is up to date: 20002 lines")).toBeVisible();
+});
+
+test("should list a genre from its posting list with invalid lines in place", async ({terminal}) => {
+	const lines = ["Hobbit|Tolkien|fantasy|2024-01-01|||", "broken line", "Dune|Herbert|scifi|2024-02-01|||",
+		"Silmarillion|Tolkien|fantasy|2024-03-01|||"];
+	terminal.submit(inTempJournal(lines,
+		`${binary} list --no-index --genre fantasy > scan.txt && ` +
+		`${binary} index > /dev/null && ${binary} list --genre fantasy > index.txt && ` +
+		`cmp -s scan.txt index.txt && echo "index: same"; ` +
+		`grep -e "^-- " -e Failed index.txt | sed "s/^Failed to load .*: /invalid: /" | tr "\\n" " " && echo && ` +
+		`tail -n 1 index.txt && ${binary} list --genre poetry | tail -n 1`));
+	await expect(terminal.getByText("index: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("-- Hobbit -- invalid: broken line -- Silmarillion --")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 2/3")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 0/3")).toBeVisible();
+});
+
+test("should keep the order of entries and invalid lines across filter blocks", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 3000 --seed 5 > /dev/null && sed -i "1500a broken line" reading_journal.txt && ` +
+		`awk -F"|" '$0 == "broken line" {print "Failed to load journal entry from line: " $0; next} ` +
+		`$6 >= 4 {print "-- " $1 " --"}' reading_journal.txt > expected.txt && ` +
+		`${binary} list --no-index --score 4 | grep -e "^-- " -e "^Failed" > listed.txt && ` +
+		`cmp -s expected.txt listed.txt && echo "order: same"; wc -l < listed.txt | sed "s/^/listed lines: /"`));
+	await expect(terminal.getByText("order: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("listed lines: 2087")).toBeVisible();
+});
+
+test("should list the same entries with threads as without them", async ({terminal}) => {
+	const filter = "--genre mystery --score 4 --not --reading";
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 20000 --seed 7 > /dev/null && ` +
+		`printf 'broken line\\nHobbit|Tolkien|mystery|2024-01-01||5|\\n' >> reading_journal.txt && ` +
+		`${binary} list --no-index ${filter} > plain.txt && ` +
+		`for threads in 2 4 7; do ${binary} list --no-index --threads $threads ${filter} > threads.txt && ` +
+		`cmp -s plain.txt threads.txt && echo "threads $threads: same"; done; tail -n 1 plain.txt`));
+	await expect(terminal.getByText("threads 2: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("threads 4: same")).toBeVisible();
+	await expect(terminal.getByText("threads 7: same")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 1837/20001")).toBeVisible();
+});
+
+test("should split lines longer than the scan window and agree across tokenizers", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||"],
+		`printf 'Long|Writer|essay|2024-02-01||4|' >> reading_journal.txt && ` +
+		`head -c 20000 /dev/zero | tr "\\0" x >> reading_journal.txt && ` +
+		`printf '\\nDune|Herbert|scifi|2024-02-01|||\\n' >> reading_journal.txt && ` +
+		`${binary} list | grep -e "^-- " -e Listed | tr "\\n" " " && echo && ` +
+		`${binary} list | grep "^note:" | tr -cd x | wc -c | sed "s/^/note length: /" && ` +
+		`${binary} bench tokenize --lines 2000 | grep -o "checksum [0-9]*" | sort -u | wc -l | sed "s/^/checksums: /"`));
+	await expect(terminal.getByText("-- Hobbit -- -- Long -- -- Dune -- Listed entries 3/3")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("note length: 20000")).toBeVisible();
+	await expect(terminal.getByText("checksums: 1")).toBeVisible();
+});
+
+test("should keep invalid lines and the summary in order with the buffered output", async ({terminal}) => {
+	terminal.submit(inTempJournal(["broken first"],
+		`${binary} bench generate --lines 5000 --seed 9 --file generated.txt > /dev/null && ` +
+		`cat generated.txt >> reading_journal.txt && printf 'broken last\\n' >> reading_journal.txt && ` +
+		`${binary} list > listed.txt && sed -n 2p listed.txt | sed "s/^/second: /" && ` +
+		`tail -n 3 listed.txt | head -n 1 | sed "s/^/before summary: /" && tail -n 1 listed.txt && ` +
+		`grep -c "^-- " listed.txt | sed "s/^/entries: /"`));
+	await expect(terminal.getByText("second: Failed to load journal entry from line: broken first"))
+		.toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("before summary: Failed to load journal entry from line: broken last"))
+		.toBeVisible();
+	await expect(terminal.getByText("Listed entries 5000/5000")).toBeVisible();
+	await expect(terminal.getByText("entries: 5000")).toBeVisible();
+});
+
+test("should import valid lines and report rejected ones", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||"],
+		`printf 'Dune|Herbert|scifi|2024-02-01\\nbroken line\\nEmma|Austen|classic|2024-03-01||7|\\n' | ${binary} import && ` +
+		`printf '{"name": "Ulysses", "author": "Joyce", "genre": "classic", "start": "2024-04-01", "score": 4}\\n{"name": "X"}\\n' | ` +
+		`${binary} import --format jsonl && ${binary} list | tail -n 1`));
+	await expect(terminal.getByText("Line 2 rejected: expected at least 4 fields separated by '|'")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Line 3 rejected: score must be from 1 to 5")).toBeVisible();
+	await expect(terminal.getByText("Imported 1 entries, rejected 2 lines")).toBeVisible();
+	await expect(terminal.getByText("Imported 1 entries, rejected 1 lines")).toBeVisible();
+	await expect(terminal.getByText("Listed entries 3/3")).toBeVisible();
+});
+
+test("should keep every record of parallel writers", async ({terminal}) => {
+	const writers = 200;
+	terminal.submit(inTempJournal([],
+		`for i in $(seq ${writers}); do ` +
+		`${binary} new --name "Book $i" --author "Author $i" --genre stress --start 2024-01-01 --score 3 ` +
+		`--note "note $i" $([ $((i % 2)) = 0 ] && echo --group-commit) > /dev/null & done; wait; ` +
+		`echo "journal lines: $(wc -l < reading_journal.txt)"; ` +
+		`${binary} list --no-index | grep -c "Failed to load" | sed "s/^/invalid lines: /"; ` +
+		`${binary} list --no-index | tail -n 1`));
+	await expect(terminal.getByText(`journal lines: ${writers}`)).toBeVisible({timeout: 60000});
+	await expect(terminal.getByText("invalid lines: 0")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText(`Listed entries ${writers}/${writers}`)).toBeVisible({timeout: 10000});
+});
+
+test("should negate the filter that follows --not", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|2024-01-10|5|", "Dune|Herbert|scifi|2024-02-01|2024-03-01|3|",
+		"Emma|Austen|classic|2024-03-01|||"],
+		`${binary} list --completed --not --genre fantasy | grep -e "^-- " -e Listed | tr "\\n" " " && echo && ` +
+		`${binary} list --not --score 4 | grep -e "^-- " -e Listed | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Dune -- Listed entries 1/3")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("-- Dune -- -- Emma -- Listed entries 2/3")).toBeVisible();
+});
+
+test("should filter by start date with and without the index", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`${binary} new --name "Early" --author "A" --genre fantasy --start 2023-12-31 > /dev/null && ` +
+		`${binary} new --name "Inside" --author "B" --genre fantasy --start 2024-01-15 --end 2024-02-01 > /dev/null && ` +
+		`${binary} new --name "Late" --author "C" --genre crime --start 2024-02-01 > /dev/null && ` +
+		`${binary} list --no-index --started-after 2023-12-31 --started-before 2024-02-01 | tail -n 1 | sed "s/^/scan: /"; ` +
+		`${binary} index > /dev/null && ` +
+		`${binary} list --started-after 2023-12-31 --started-before 2024-02-01 | tail -n 1 | sed "s/^/index: /"`));
+	await expect(terminal.getByText("scan: Listed entries 1/3")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("index: Listed entries 1/3")).toBeVisible({timeout: 10000});
+});
+
+test("should verify the journal and report invalid lines", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|J.R.R. Tolkien|fantasy|2024-02-29|||", "Dune|F. Herbert|sci-fi|2023-02-29|||"],
+		`${binary} verify; echo "verify exit: $?"`));
+	await expect(terminal.getByText("Invalid line at offset 44: start date is not a valid YYYY-MM-DD date"))
+		.toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Verified 2 lines, 1 invalid")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("verify exit: 1")).toBeVisible({timeout: 10000});
+});
+
+test("should list the highest scored books first", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Low|A|fantasy|2024-01-01||2|", "Top|B|fantasy|2024-01-02||5|", "Mid|C|crime|2024-01-03||4|"],
+		`${binary} list --sort score --desc --limit 2 | grep -e "^-- " -e "Listed" | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Top -- -- Mid -- Listed entries 2/3")).toBeVisible({timeout: 10000});
+});
+
+test("should aggregate stats and keep them up to date on append", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|2024-01-11|4|"],
+		`${binary} stats > /dev/null && ` +
+		`${binary} new --name Silmarillion --author Tolkien --genre fantasy --start 2024-02-01 --score 5 > /dev/null && ` +
+		`${binary} stats --by author | grep Tolkien`));
+	await expect(terminal.getByText("Tolkien                        2      4.50      50.0%      10.0")).toBeVisible({timeout: 10000});
+});
+
+test("should search names, authors and notes with the trigram index", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||", "Dune|Herbert|scifi|2024-02-01|||"],
+		`${binary} search tolk > /dev/null && ` +
+		`${binary} new --name Emma --author Austen --genre classic --start 2024-03-01 --note "Matchmaking in HIGHBURY" > /dev/null && ` +
+		`${binary} search highbury | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Emma -- author:           Austen")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Found 1 entries")).toBeVisible();
+});
+
+test("should list books by author from the author index", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|J.R.R. Tolkien|fantasy|2024-01-01|||", "Dune|Herbert|scifi|2024-02-01|||"],
+		`${binary} list --author "j.r.r.  tolkien" > /dev/null && ` +
+		`${binary} new --name Silmarillion --author "J.R.R. TOLKIEN" --genre fantasy --start 2024-03-01 > /dev/null && ` +
+		`${binary} list --author-prefix "j.r.r. tol" | grep -e "^-- " -e Listed | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Hobbit -- -- Silmarillion -- Listed entries 2/3")).toBeVisible({timeout: 10000});
+});
+
+test("should answer list and new through the serve daemon", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||"],
+		`{ ${binary} serve > serve.log & } && sleep 1 && ` +
+		`${binary} new --name Emma --author Austen --genre classic --start 2024-03-01 > /dev/null && ` +
+		`echo 'Dune|Herbert|scifi|2024-02-01|||' >> reading_journal.txt && ` +
+		`${binary} list --not --genre fantasy | grep -e "^-- " -e Listed | tr "\\n" " " && ` +
+		`kill %1 && sleep 1 && tail -1 serve.log`));
+	await expect(terminal.getByText("-- Emma -- -- Dune -- Listed entries 2/3")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Daemon stopped")).toBeVisible();
+});
+
+test("should follow entries appended to the journal", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||"],
+		`printf 'Emma|Austen|clas' >> reading_journal.txt && ` +
+		`{ ${binary} list --follow --not --genre fantasy > follow.log & } && sleep 1 && ` +
+		`printf 'sic|2024-03-01|||\\n' >> reading_journal.txt && ` +
+		`${binary} new --name Dune --author Herbert --genre scifi --start 2024-02-01 > /dev/null && ` +
+		`sleep 1 && kill %1 && sleep 1 && grep -e "^-- " -e Listed follow.log | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Emma -- -- Dune -- Listed entries 2/3")).toBeVisible({timeout: 10000});
+});
+
+test("should list from the compressed store and skip blocks by their zone maps", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`for i in $(seq 1 5000); do echo "Book $i|Author|fantasy|2001-01-01|2001-02-01|3|"; done > reading_journal.txt && ` +
+		`printf 'Hobbit|Tolkien|fantasy|2024-01-01||5|\\n' >> reading_journal.txt && ` +
+		`${binary} pack | grep -o "2 blocks" && ` +
+		`printf 'Dune|Herbert|scifi|2024-02-01||5|\\n' >> reading_journal.txt && ` +
+		`${binary} list --score 5 | grep -e "^-- " -e Listed | tr "\\n" " "`));
+	await expect(terminal.getByText("2 blocks")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("-- Hobbit -- -- Dune -- Listed entries 2/5002")).toBeVisible();
+});
+
+test("should list the same entries from the compressed store as from the text", async ({terminal}) => {
+	const filter = "--genre mystery --score 4 --not --reading";
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 20000 --seed 7 > /dev/null && ` +
+		`printf 'broken line\\nHobbit|Tolkien|mystery|2024-01-01||5|\\n' >> reading_journal.txt && ` +
+		`${binary} list --no-index ${filter} > plain.txt && ` +
+		`${binary} pack > /dev/null && ${binary} list ${filter} > store.txt && ` +
+		`cmp -s plain.txt store.txt && echo "store: same"; tail -n 1 store.txt`));
+	await expect(terminal.getByText("store: same")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Listed entries 1837/20001")).toBeVisible();
+});
+
+
+test("should page through the journal with an offset and a cursor", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`for i in $(seq 1 3000); do echo "Book $i|Author|genre$((i % 2))|2024-01-01|||"; done > reading_journal.txt && ` +
+		`${binary} list --offset 2500 --limit 2 | grep "^-- " | tr "\\n" " " && ` +
+		`${binary} list --genre genre1 --offset 1 --limit 1 > page.txt && ` +
+		`${binary} list --genre genre1 --limit 2 --cursor $(grep -o "cursor [^ ]*" page.txt | cut -d" " -f2) | ` +
+		`grep -e "^-- " -e Listed | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Book 2501 -- -- Book 2502 --")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("-- Book 5 -- -- Book 7 -- Listed entries 2")).toBeVisible();
+});
+
+test("should generate a journal and report the benchmark suite as JSON", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`${binary} bench generate --lines 20000 --reading 10 --seed 7 && ${binary} verify && ` +
+		`${binary} bench suite --appends 100 | grep -o '"name": "write_entry", "records": 100,' && ls`));
+	await expect(terminal.getByText("Generated 20000 entries")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Verified 20000 lines, 0 invalid")).toBeVisible();
+	await expect(terminal.getByText('"name": "write_entry", "records": 100,')).toBeVisible();
+});
+
+test("should profile the phases of list", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01||5|", "broken line", "Dune|Herbert|scifi|2024-02-01|||"],
+		`${binary} --profile list --score 5 2>&1 >/dev/null | grep -e "Profile of" -e "tokenize" -e "lines rejected"`));
+	await expect(terminal.getByText("Profile of list:")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("tokenize")).toBeVisible();
+	await expect(terminal.getByText("bytes read 83, lines rejected 1")).toBeVisible();
+});
+
+test("should update and delete entries and compact the journal", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||", "Dune|Herbert|scifi|2024-02-01|||", "Emma|Austen|classic|2024-03-01|||"],
+		`${binary} list --ids | grep "^id:" | tr -s " " | cut -d" " -f2 > ids.txt && ` +
+		`${binary} update --id $(sed -n 2p ids.txt) --end 2024-02-20 --score 5 > /dev/null && ` +
+		`${binary} delete --id $(sed -n 1p ids.txt) | grep -o "deleted" && ` +
+		`${binary} update --id $(sed -n 3p ids.txt) --score 9; ` +
+		`${binary} list --completed | grep -e "^-- " -e Listed | tr "\\n" " " && ` +
+		`${binary} compact && cat reading_journal.txt | tr "\\n" " " && ` +
+		`${binary} update --id $(sed -n 3p ids.txt) --score 4 || echo "stale ID rejected"`));
+	await expect(terminal.getByText("deleted")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("Invalid score 9, expected a whole number from 1 to 5")).toBeVisible();
+	await expect(terminal.getByText("-- Dune -- Listed entries 1/2")).toBeVisible();
+	await expect(terminal.getByText("Dune|Herbert|scifi|2024-02-01|2024-02-20|5| Emma|Austen|classic|2024-03-01|||")).toBeVisible();
+	await expect(terminal.getByText("stale ID rejected")).toBeVisible();
+});
+
+test("should apply updates and deletes in stats, search and verify", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01||5|", "Dune|Herbert|scifi|2024-02-01|||"],
+		`${binary} stats > /dev/null && ${binary} search hobbit > /dev/null && ` +
+		`${binary} list --ids | grep "^id:" | tr -s " " | cut -d" " -f2 > ids.txt && ` +
+		`${binary} delete --id $(sed -n 1p ids.txt) > /dev/null && ` +
+		`${binary} update --id $(sed -n 2p ids.txt) --score 3 --note "Arrakis" > /dev/null && ` +
+		`${binary} stats | grep Total && ${binary} search hobbit | tail -n 1 | sed "s/^/hobbit: /" && ` +
+		`${binary} search arrakis | tail -n 1 | sed "s/^/arrakis: /" && ${binary} verify`));
+	await expect(terminal.getByText("Total                          1      3.00       0.0%         -")).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("hobbit: Found 0 entries")).toBeVisible();
+	await expect(terminal.getByText("arrakis: Found 1 entries")).toBeVisible();
+	await expect(terminal.getByText("Verified 1 lines, 0 invalid")).toBeVisible();
+});
+
+test("should keep following the journal after it is compacted", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01|||", "Dune|Herbert|scifi|2024-02-01|||"],
+		`{ ${binary} list --follow > follow.log & } && sleep 1 && ` +
+		`${binary} delete --id $(${binary} list --ids | grep "^id:" | head -n 1 | tr -s " " | cut -d" " -f2) > /dev/null && ` +
+		`${binary} compact > /dev/null && sleep 1 && ` +
+		`${binary} new --name Emma --author Austen --genre classic --start 2024-03-01 > /dev/null && ` +
+		`sleep 1 && kill %1 && sleep 1 && grep -e "^-- " -e compacted follow.log | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Hobbit -- -- Dune -- Journal was compacted, following the new journal file -- Emma --"))
+		.toBeVisible({timeout: 10000});
+});
+
+test("should page by offset past deleted entries", async ({terminal}) => {
+	terminal.submit(inTempJournal([],
+		`for i in $(seq 1 3000); do echo "Book $i|Author|fantasy|2024-01-01|||"; done > reading_journal.txt && ` +
+		`${binary} delete --id $(${binary} list --ids --limit 1 | grep "^id:" | tr -s " " | cut -d" " -f2) > /dev/null && ` +
+		`for offset in 1023 1024 2000; do ${binary} list --offset $offset --limit 1 | grep "^-- "; done | tr "\\n" " "`));
+	await expect(terminal.getByText("-- Book 1025 -- -- Book 1026 -- -- Book 2002 --")).toBeVisible({timeout: 10000});
+});
+
+test("should export books as JSON lines and tab separated values", async ({terminal}) => {
+	terminal.submit(inTempJournal(["Hobbit|Tolkien|fantasy|2024-01-01||5|a \"great\" read", "Dune|Herbert|scifi|2024-02-01|||"],
+		`${binary} export --score 5 --file books.jsonl && cat books.jsonl && ` +
+		`${binary} list --format tsv --genre scifi 2>/dev/null | tr "\\t" "," | tr "\\n" " "`));
+	await expect(terminal.getByText('{"name":"Hobbit","author":"Tolkien","genre":"fantasy","start":"2024-01-01","end":null,"score":5,"note":"a \\"great\\" read"}')).toBeVisible({timeout: 10000});
+	await expect(terminal.getByText("name,author,genre,start,end,score,note Dune,Herbert,scifi,2024-02-01,,,")).toBeVisible();
+});